@@ -0,0 +1,471 @@
+/*############################################################################
+  # Copyright (C) 2021 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef __MFXCPU_H__
+#define __MFXCPU_H__
+
+#include "vpl/mfxdefs.h"
+#include "vpl/mfxsession.h"
+#include "vpl/mfxstructures.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Extension buffers specific to the CPU reference runtime. */
+enum {
+    MFX_EXTBUFF_CPU_VPP_DEPTH_CONVERSION  = MFX_MAKEFOURCC('C', 'D', 'E', 'P'),
+    MFX_EXTBUFF_CPU_MEMORY_BUDGET         = MFX_MAKEFOURCC('C', 'M', 'E', 'M'),
+    MFX_EXTBUFF_CPU_DECODE_THREADING      = MFX_MAKEFOURCC('C', 'D', 'T', 'H'),
+    MFX_EXTBUFF_CPU_DECODE_STAT           = MFX_MAKEFOURCC('C', 'D', 'S', 'T'),
+    MFX_EXTBUFF_CPU_DECODE_FLUSH          = MFX_MAKEFOURCC('C', 'D', 'F', 'L'),
+    MFX_EXTBUFF_CPU_DECODE_THUMBNAIL      = MFX_MAKEFOURCC('C', 'D', 'T', 'N'),
+    MFX_EXTBUFF_CPU_DECODE_AV1            = MFX_MAKEFOURCC('C', 'D', 'A', 'V'),
+    MFX_EXTBUFF_CPU_DECODE_ERROR_RECOVERY = MFX_MAKEFOURCC('C', 'D', 'E', 'R'),
+    MFX_EXTBUFF_CPU_DECODE_ANALYTICS      = MFX_MAKEFOURCC('C', 'D', 'A', 'N'),
+    MFX_EXTBUFF_CPU_ENCODE_OUTPUT         = MFX_MAKEFOURCC('C', 'E', 'O', 'U'),
+};
+
+/* mfxBitstream::DataFlag value specific to the CPU runtime. */
+enum {
+    /* Data is a ring of MaxLength bytes: the DataLength bytes from DataOffset continue at
+       Data[0] past the end, and decoding advances DataOffset modulo MaxLength. The app
+       appends at (DataOffset + DataLength) % MaxLength, no compaction is needed.
+       MFX_BITSTREAM_COMPLETE_FRAME is ignored for a ring. */
+    MFX_CPU_BITSTREAM_RING = 0x8000,
+};
+
+/* Methods used to drop the extra bits when reducing 10-bit input to 8-bit output. */
+enum {
+    MFX_CPU_DEPTH_CONVERSION_DEFAULT  = 0, /* same as MFX_CPU_DEPTH_CONVERSION_ROUND */
+    MFX_CPU_DEPTH_CONVERSION_ROUND    = 1, /* round to nearest */
+    MFX_CPU_DEPTH_CONVERSION_DITHER   = 2, /* 2x2 ordered (Bayer) dither */
+    MFX_CPU_DEPTH_CONVERSION_TRUNCATE = 3, /* drop the low bits */
+};
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   Controls I010/P010 to I420/NV12 conversion in VPP and in decode+VPP channels.
+   Attach to mfxVideoParam (VPP) or mfxVideoChannelParam (decode+VPP).
+*/
+typedef struct {
+    /*! Extension buffer header. BufferId must be MFX_EXTBUFF_CPU_VPP_DEPTH_CONVERSION. */
+    mfxExtBuffer Header;
+    mfxU16 Method; /*!< One of MFX_CPU_DEPTH_CONVERSION_*. */
+    mfxU16 reserved[11];
+} mfxExtCpuVPPDepthConversion;
+MFX_PACK_END()
+
+/* Decoder threading, may be combined. */
+enum {
+    MFX_CPU_DECODE_THREADING_DEFAULT = 0,      /* backend default */
+    MFX_CPU_DECODE_THREADING_FRAME   = 0x0001, /* frames in parallel, adds output latency */
+    MFX_CPU_DECODE_THREADING_SLICE   = 0x0002, /* slices of one frame in parallel, no latency */
+    MFX_CPU_DECODE_THREADING_GOP     = 0x0004, /* AVC/HEVC Annex B only: segments starting at
+                                                  IDR frames in parallel, for offline decode,
+                                                  adds output latency */
+};
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   Selects how the decoder uses threads. Attach to mfxVideoParam for decode Init().
+   Attach to mfxVideoParam for decode GetVideoParam() to read what is in use.
+*/
+typedef struct {
+    /*! Extension buffer header. BufferId must be MFX_EXTBUFF_CPU_DECODE_THREADING. */
+    mfxExtBuffer Header;
+    /*! Combination of MFX_CPU_DECODE_THREADING_*. On GetVideoParam(), the threading in use. */
+    mfxU16 Mode;
+    /*! Number of threads, 0 for automatic. On GetVideoParam(), the number in use. */
+    mfxU16 NumThreads;
+    /*! Output only. Frames of output delay added by frame or GOP threading. */
+    mfxU16 LatencyFrames;
+    mfxU16 reserved[9];
+} mfxExtCpuDecodeThreading;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_STRUCT_W_L_TYPE()
+/*!
+   Decoder counters since Init(), a superset of mfxDecodeStat with timing.
+   Attach to mfxVideoParam for decode GetVideoParam(). All fields are output.
+*/
+typedef struct {
+    /*! Extension buffer header. BufferId must be MFX_EXTBUFF_CPU_DECODE_STAT. */
+    mfxExtBuffer Header;
+    mfxU32 NumFrame;        /*!< Frames returned. */
+    mfxU32 NumCorrupted;    /*!< Frames returned with Data.Corrupted set. */
+    mfxU32 NumError;        /*!< DecodeFrameAsync() calls that failed. */
+    mfxU32 MaxDecodeTimeUs; /*!< Longest DecodeFrameAsync() call. */
+    mfxU64 BytesConsumed;   /*!< Bitstream bytes consumed. */
+    mfxU64 ParserCalls;     /*!< Calls into the bitstream parser. */
+    mfxU64 DecodeTimeUs;    /*!< Total time spent in DecodeFrameAsync(). */
+    /*! Frames dropped by MFX_CPU_DECODE_ERROR_SKIP_TO_RAP, whether before or after decoding. */
+    mfxU32 NumDropped;
+    mfxU32 reserved1;
+    /*! Bytes of packets the decoder copied, 0 when every frame was passed by reference. */
+    mfxU64 BytesCopied;
+    mfxU32 reserved[4];
+} mfxExtCpuDecodeStat;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   Limits the frame memory decoders and VPPs may need. Each Init() and Reset() adds
+   the estimate for the given resolution, format and reference depth to a total
+   shared by all sessions in the process, Close() takes it off again. Init() and
+   Reset() return MFX_ERR_MEMORY_ALLOC when the total would be over the limit.
+   Attach to mfxVideoParam (decode, VPP) or mfxVideoChannelParam (decode+VPP).
+*/
+typedef struct {
+    /*! Extension buffer header. BufferId must be MFX_EXTBUFF_CPU_MEMORY_BUDGET. */
+    mfxExtBuffer Header;
+    mfxU32 MaxMemoryMB; /*!< Limit in MiB. 0 means half of the physical memory. */
+    mfxU16 reserved[10];
+} mfxExtCpuMemoryBudget;
+MFX_PACK_END()
+
+/* Output after a decoder flush. */
+enum {
+    MFX_CPU_DECODE_FLUSH_DEFAULT     = 0, /* output every frame decoded after the flush */
+    MFX_CPU_DECODE_FLUSH_SKIP_TO_RAP = 1, /* no output until the next random access point */
+};
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   Turns decode Reset() into a flush, e.g. for a seek. Buffered frames and parser
+   state are dropped and frames held by the decoder are released, the configuration
+   is kept and the other fields of mfxVideoParam are ignored.
+   Attach to mfxVideoParam for decode Reset().
+*/
+typedef struct {
+    /*! Extension buffer header. BufferId must be MFX_EXTBUFF_CPU_DECODE_FLUSH. */
+    mfxExtBuffer Header;
+    mfxU16 Mode; /*!< One of MFX_CPU_DECODE_FLUSH_*. */
+    mfxU16 reserved[11];
+} mfxExtCpuDecodeFlush;
+MFX_PACK_END()
+
+/* Decoder reaction to a corrupted stream. */
+enum {
+    MFX_CPU_DECODE_ERROR_CONCEAL     = 0, /* keep decoding, damaged output has Data.Corrupted */
+    MFX_CPU_DECODE_ERROR_SKIP_TO_RAP = 1, /* drop everything up to the next random access point */
+};
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   Error recovery policy. With MFX_CPU_DECODE_ERROR_SKIP_TO_RAP, a packet the decoder
+   rejects or a frame it reports as damaged starts a skip: packets the parser sees are
+   not key frames are dropped without decoding and other frames decoded meanwhile are
+   discarded. Output resumes at the next key frame (IDR/IRAP, AV1 key frame).
+   mfxExtCpuDecodeStat::NumDropped counts the frames lost this way.
+   Attach to mfxVideoParam for decode Init() or Reset().
+*/
+typedef struct {
+    /*! Extension buffer header. BufferId must be MFX_EXTBUFF_CPU_DECODE_ERROR_RECOVERY. */
+    mfxExtBuffer Header;
+    mfxU16 Mode; /*!< One of MFX_CPU_DECODE_ERROR_*. */
+    mfxU16 reserved[11];
+} mfxExtCpuDecodeErrorRecovery;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   Thumbnail mode. Only key frames are decoded, the other frames are parsed and
+   dropped. Each key frame is scaled straight to Width x Height 8-bit I420, so output
+   surfaces have that size, while GetVideoParam() keeps reporting the stream.
+   JPEG is decoded at 1/2, 1/4 or 1/8 size with a reduced IDCT when that is still no
+   smaller than the thumbnail. Attached for DecodeVPP, the channels scale from the
+   thumbnail. Attach to mfxVideoParam for decode Init().
+*/
+typedef struct {
+    /*! Extension buffer header. BufferId must be MFX_EXTBUFF_CPU_DECODE_THUMBNAIL. */
+    mfxExtBuffer Header;
+    mfxU16 Width;  /*!< Thumbnail width, even. */
+    mfxU16 Height; /*!< Thumbnail height, even. */
+    /*! Minimum mfxFrameData::TimeStamp distance between thumbnails (90 kHz units), 0 for
+        every key frame. Key frames without a time stamp are always taken. */
+    mfxU32 Interval;
+    /*! Thumbnails to return, 0 for no limit. Once reached, DecodeFrameAsync() leaves the
+        bitstream untouched and returns MFX_ERR_NONE with *surface_out set to null, a
+        drain (null bitstream) returns MFX_ERR_MORE_DATA. DecodeVPP returns a null
+        surface array the same way. */
+    mfxU32 MaxCount;
+    mfxU16 reserved[6];
+} mfxExtCpuDecodeThumbnail;
+MFX_PACK_END()
+
+/* AV1 film grain handling. */
+enum {
+    MFX_CPU_DECODE_AV1_FILM_GRAIN_DEFAULT = 0, /* apply unless mfxInfoMFX::FilmGrain is 0 */
+    MFX_CPU_DECODE_AV1_FILM_GRAIN_APPLY   = 1, /* synthesize grain on the output */
+    MFX_CPU_DECODE_AV1_FILM_GRAIN_SKIP    = 2, /* output without grain */
+    MFX_CPU_DECODE_AV1_FILM_GRAIN_EXPORT  = 3, /* output without grain, parameters as payload */
+};
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   AV1 decoder (dav1d) tuning. Frame threads decode frames ahead of output, tile threads
+   split one frame, both come out of mfxExtCpuDecodeThreading::NumThreads. Unset counts
+   follow mfxExtCpuDecodeThreading::Mode (SLICE alone: one frame thread, FRAME alone: one
+   tile thread) and DecodedOrder (one frame thread).
+   Attach to mfxVideoParam for decode Init().
+*/
+typedef struct {
+    /*! Extension buffer header. BufferId must be MFX_EXTBUFF_CPU_DECODE_AV1. */
+    mfxExtBuffer Header;
+    mfxU16 TileThreads; /*!< Threads per frame, 0 for automatic, at most 64. */
+    /*! Frames decoded ahead of output, which is the number of frame threads. 0 for
+        automatic, 1 for none, at most 256. */
+    mfxU16 MaxFrameDelay;
+    mfxU16 FilmGrain; /*!< One of MFX_CPU_DECODE_AV1_FILM_GRAIN_*. */
+    mfxU16 reserved[9];
+} mfxExtCpuDecodeAV1;
+MFX_PACK_END()
+
+/* How encoded data reaches the app's mfxBitstream. */
+enum {
+    MFX_CPU_ENCODE_OUTPUT_COPY      = 0, /* each packet is copied behind the bitstream's data */
+    MFX_CPU_ENCODE_OUTPUT_DIRECT    = 1, /* the encoder writes behind the bitstream's data */
+    MFX_CPU_ENCODE_OUTPUT_REFERENCE = 2, /* Data is pointed at the encoder's own packet */
+};
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   Selects how EncodeFrameAsync() returns the bitstream.
+   MFX_CPU_ENCODE_OUTPUT_DIRECT: encoders that take an output buffer from the caller
+   write straight into the free space of the mfxBitstream, which needs room for the
+   packet plus 64 bytes of padding. Packets that do not fit are copied as before.
+   MFX_CPU_ENCODE_OUTPUT_REFERENCE: the bitstream must be empty (DataLength 0). Data,
+   DataLength and MaxLength are set to the packet the encoder allocated, nothing is
+   copied. The app returns it with MFXVideoENCODE_ReleaseBitstream(), packets not
+   returned are freed by Close().
+   Attach to mfxVideoParam for encode Init(). On GetVideoParam(), Mode is the mode in use,
+   MFX_CPU_ENCODE_OUTPUT_COPY for DIRECT with an encoder that does not support it.
+*/
+typedef struct {
+    /*! Extension buffer header. BufferId must be MFX_EXTBUFF_CPU_ENCODE_OUTPUT. */
+    mfxExtBuffer Header;
+    mfxU16 Mode; /*!< One of MFX_CPU_ENCODE_OUTPUT_*. */
+    mfxU16 reserved[11];
+} mfxExtCpuEncodeOutput;
+MFX_PACK_END()
+
+/* mfxPayload::Type values outside the SEI payloadType range. */
+enum {
+    MFX_CPU_PAYLOAD_AV1_FILM_GRAIN = 0x8000, /* Data is a mfxCpuAV1FilmGrain */
+    MFX_CPU_PAYLOAD_TIMECODE       = 0x8001, /* Data is 1 to 3 mfxCpuTimecode */
+};
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   SMPTE ST 12-1 time code of an output frame, one per clock timestamp the stream
+   carries for it (up to 3 for repeated fields). The count is NumBit / 8 divided by the
+   size of this struct. Above 30 fps Frames counts frame pairs, as coded.
+*/
+typedef struct {
+    mfxU8 Hours;
+    mfxU8 Minutes;
+    mfxU8 Seconds;
+    mfxU8 Frames;
+    mfxU8 DropFrame; /*!< 1 for drop frame counting. */
+    mfxU8 reserved[3];
+} mfxCpuTimecode;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   AV1 film_grain_params() of one output frame, as exported with
+   MFX_CPU_DECODE_AV1_FILM_GRAIN_EXPORT. Fields coded with an offset have it removed.
+*/
+typedef struct {
+    mfxU16 GrainSeed;
+    mfxU8 NumYPoints;
+    mfxU8 ChromaScalingFromLuma;
+    mfxU8 PointY[14][2]; /*!< Value, scaling. */
+    mfxU8 NumCbPoints;
+    mfxU8 NumCrPoints;
+    mfxU8 PointCb[10][2];
+    mfxU8 PointCr[10][2];
+    mfxU8 ScalingShift; /*!< grain_scaling_minus_8 + 8. */
+    mfxU8 ArCoeffLag;
+    mfxI8 ArCoeffsY[24]; /*!< ar_coeffs_y_plus_128 - 128. */
+    mfxI8 ArCoeffsCb[25];
+    mfxI8 ArCoeffsCr[25];
+    mfxU8 ArCoeffShift; /*!< ar_coeff_shift_minus_6 + 6. */
+    mfxU8 GrainScaleShift;
+    mfxI16 CbMult;     /*!< cb_mult - 128. */
+    mfxI16 CbLumaMult; /*!< cb_luma_mult - 128. */
+    mfxI16 CbOffset;   /*!< cb_offset - 256. */
+    mfxI16 CrMult;
+    mfxI16 CrLumaMult;
+    mfxI16 CrOffset;
+    mfxU8 OverlapFlag;
+    mfxU8 ClipToRestrictedRange;
+    mfxU16 reserved[7];
+} mfxCpuAV1FilmGrain;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   Exports what the decoder knows about each frame for analytics, read through
+   MFX_GUID_CPU_FRAME_ANALYTICS on the output surface. Only codecs whose decoder exports
+   the data fill it (AVC for both), the others return empty tables.
+   Attach to mfxVideoParam for decode Init().
+*/
+typedef struct {
+    /*! Extension buffer header. BufferId must be MFX_EXTBUFF_CPU_DECODE_ANALYTICS. */
+    mfxExtBuffer Header;
+    mfxU16 MotionVectors; /*!< MFX_CODINGOPTION_ON to export motion vectors. */
+    mfxU16 QP;            /*!< MFX_CODINGOPTION_ON to export the QP of each block. */
+    mfxU16 reserved[10];
+} mfxExtCpuDecodeAnalytics;
+MFX_PACK_END()
+
+/*!
+   mfxFrameSurfaceInterface::QueryInterface() GUID of the analytics of a surface from the
+   decoder's pool, the interface is a mfxCpuFrameAnalytics.
+*/
+#define MFX_GUID_CPU_FRAME_ANALYTICS                                                           \
+    {                                                                                          \
+        {                                                                                      \
+            0x5b, 0x0e, 0x7c, 0x3d, 0x91, 0x2a, 0x4f, 0x6b, 0xa8, 0x43, 0x1d, 0xe6, 0x27, 0xc9, \
+                0x50, 0xf4                                                                     \
+        }                                                                                      \
+    }
+
+MFX_PACK_BEGIN_STRUCT_W_PTR()
+/*!
+   Motion vectors and QP map of one decoded frame, as structure of arrays. Every array
+   starts on a 64 byte boundary and has room for NumMotionVectors rounded up to a
+   multiple of 64 entries, the entries past the count are zero, so vector loops need no
+   tail handling. Valid until the surface is released or queried again.
+*/
+typedef struct {
+    mfxU32 NumMotionVectors; /*!< One per block and reference, 0 if none were exported. */
+    mfxU32 reserved1;
+    mfxI16 *BlockX;   /*!< Block centre in the frame, in pixels. */
+    mfxI16 *BlockY;   /*!< Block centre in the frame, in pixels. */
+    mfxI16 *MotionX;  /*!< Position in the reference minus BlockX, in quarter pixels. */
+    mfxI16 *MotionY;  /*!< Position in the reference minus BlockY, in quarter pixels. */
+    mfxU8 *BlockW;    /*!< Block width in pixels. */
+    mfxU8 *BlockH;    /*!< Block height in pixels. */
+    mfxI8 *Reference; /*!< -1 for a past reference, 1 for a future one. */
+    /*! Pixels covered by a QP entry in each direction, 0 if no QP was exported. */
+    mfxU16 QPBlockSize;
+    mfxU16 QPWidth;  /*!< QP entries per row. */
+    mfxU16 QPHeight; /*!< QP rows. */
+    mfxU16 reserved2;
+    mfxU32 QPPitch; /*!< Bytes from one QP row to the next, a multiple of 64. */
+    mfxU8 *QP;      /*!< QP of the block at each position, null if none was exported. */
+    mfxU32 reserved[8];
+} mfxCpuFrameAnalytics;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_STRUCT_W_PTR()
+/*!
+   One stream of a MFXVideoDECODE_DecodeFrameBatch() call.
+*/
+typedef struct {
+    /*! Input. Session whose decoder gets the data, at most once per batch. */
+    mfxSession Session;
+    /*! Input. As for MFXVideoDECODE_DecodeFrameAsync(), null to drain. */
+    mfxBitstream *Bitstream;
+    /*! Output. Decoded frame from the internal pool, the app releases it. Null if none. */
+    mfxFrameSurface1 *SurfaceOut;
+    /*! Output. What MFXVideoDECODE_DecodeFrameAsync() returned for this stream. */
+    mfxStatus Status;
+    mfxU32 reserved[7];
+} mfxCpuDecodeBatchItem;
+MFX_PACK_END()
+
+/*!
+   Runs MFXVideoDECODE_DecodeFrameAsync() with internal memory for each item, spread
+   over worker threads shared by all sessions. Cheaper than a call per stream when
+   many small streams are decoded, best with one decode thread per session
+   (mfxExtCpuDecodeThreading::NumThreads = 1). The threads stop when the last session
+   is closed. Not exposed through the dispatcher, get the address from the runtime library.
+   Returns MFX_ERR_NONE once every item has run, per stream results are in the items.
+   MFX_ERR_UNDEFINED_BEHAVIOR if a session appears more than once.
+*/
+mfxStatus MFX_CDECL MFXVideoDECODE_DecodeFrameBatch(mfxCpuDecodeBatchItem *items, mfxU32 count);
+
+/*!
+   Reads from the file descriptor into the free space of a MFX_CPU_BITSTREAM_RING
+   bitstream, both parts of it if it wraps, and adds the bytes to DataLength. For
+   seekable files the kernel is asked to read ahead what the next call will need.
+   Not exposed through the dispatcher, get the address from the runtime library.
+   Returns MFX_ERR_NONE with *bytesRead = 0 at end of file, MFX_ERR_NOT_ENOUGH_BUFFER if
+   the ring is full, MFX_ERR_UNKNOWN if the read fails.
+*/
+mfxStatus MFX_CDECL MFXBitstream_FillRing(mfxBitstream *bs, int fd, mfxU32 *bytesRead);
+
+/*!
+   Gets a buffer owned by the runtime for one complete frame of up to MaxLength bytes, at
+   least size. The decoder passes such frames to libavcodec by reference, with any codec and
+   decoder threading, where frames in app memory are copied. Write the frame, set DataLength
+   and MFX_BITSTREAM_COMPLETE_FRAME, and do not write to the buffer once the frame has gone
+   to MFXVideoDECODE_DecodeFrameAsync(). The bytes after the frame are zeroed then.
+   Not exposed through the dispatcher, get the address from the runtime library.
+   Returns MFX_ERR_UNSUPPORTED if size is more than 1 GiB.
+*/
+mfxStatus MFX_CDECL MFXBitstream_GetBuffer(mfxU32 size, mfxBitstream *bs);
+
+/*!
+   Gives a buffer from MFXBitstream_GetBuffer() back and clears Data, DataOffset, DataLength
+   and MaxLength of the bitstream. It may be called right after the frame has gone to the
+   decoder, which keeps the memory until it no longer needs it.
+   Returns MFX_ERR_UNDEFINED_BEHAVIOR if Data is not such a buffer.
+*/
+mfxStatus MFX_CDECL MFXBitstream_ReleaseBuffer(mfxBitstream *bs);
+
+/*! Handle of a file opened with MFXBitstreamReader_Open(). */
+typedef struct _mfxCpuBitstreamReader *mfxCpuBitstreamReader;
+
+/*!
+   Maps a file read only and indexes its complete frames: access units of an Annex B
+   stream for MFX_CODEC_AVC and MFX_CODEC_HEVC, SOI to EOI images for MFX_CODEC_JPEG, and
+   the frames of an IVF file for any codec, which is how MFX_CODEC_AV1 is read.
+   Not exposed through the dispatcher, get the address from the runtime library.
+   Returns MFX_ERR_NOT_FOUND if the file cannot be opened, MFX_ERR_UNSUPPORTED for other
+   codecs or if the file is not in the expected format.
+*/
+mfxStatus MFX_CDECL MFXBitstreamReader_Open(const char *path,
+                                            mfxU32 codecId,
+                                            mfxCpuBitstreamReader *reader,
+                                            mfxU32 *numFrames);
+
+/*!
+   Points bs at the next frame inside the mapping, with MFX_BITSTREAM_COMPLETE_FRAME set,
+   ready for MFXVideoDECODE_DecodeFrameAsync(). Nothing is copied, the decoder passes the
+   frame to libavcodec by reference too, except for a last frame that ends less than 64
+   bytes before a page boundary. The data is read only and stays valid until the reader
+   is closed.
+   Returns MFX_ERR_MORE_DATA after the last frame.
+*/
+mfxStatus MFX_CDECL MFXBitstreamReader_GetFrame(mfxCpuBitstreamReader reader, mfxBitstream *bs);
+
+/*! Starts again at the first frame, bitstreams already handed out stay valid. */
+mfxStatus MFX_CDECL MFXBitstreamReader_Rewind(mfxCpuBitstreamReader reader);
+
+/*!
+   Closes the reader, bitstreams from it may no longer be used. Frames already given to a
+   decoder stay valid, the file is unmapped once the decoder has none of them left.
+*/
+mfxStatus MFX_CDECL MFXBitstreamReader_Close(mfxCpuBitstreamReader reader);
+
+/*!
+   Frees a packet EncodeFrameAsync() handed out with MFX_CPU_ENCODE_OUTPUT_REFERENCE and
+   clears Data, DataOffset, DataLength and MaxLength of the bitstream.
+   Not exposed through the dispatcher, get the address from the runtime library.
+   Returns MFX_ERR_UNDEFINED_BEHAVIOR if Data is not such a packet of this session.
+*/
+mfxStatus MFX_CDECL MFXVideoENCODE_ReleaseBitstream(mfxSession session, mfxBitstream *bs);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif /* __cplusplus */
+
+#endif /* __MFXCPU_H__ */
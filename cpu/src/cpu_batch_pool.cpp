@@ -0,0 +1,110 @@
+/*############################################################################
+  # Copyright (C) 2021 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "src/cpu_batch_pool.h"
+
+// the pool and the number of open sessions, see AddSession()
+static std::mutex g_poolMutex;
+static mfxU32 g_poolSessions = 0;
+static CpuBatchPool *g_pool  = nullptr;
+
+void CpuBatchPool::AddSession() {
+    std::lock_guard<std::mutex> lock(g_poolMutex);
+    g_poolSessions++;
+}
+
+// the last session stops the threads, a later session starts new ones on first use
+void CpuBatchPool::ReleaseSession() {
+    CpuBatchPool *pool = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(g_poolMutex);
+        if (g_poolSessions && --g_poolSessions == 0) {
+            pool   = g_pool;
+            g_pool = nullptr;
+        }
+    }
+    delete pool;
+}
+
+CpuBatchPool &CpuBatchPool::GetInstance() {
+    std::lock_guard<std::mutex> lock(g_poolMutex);
+    if (!g_pool)
+        g_pool = new CpuBatchPool();
+    return *g_pool;
+}
+
+CpuBatchPool::CpuBatchPool()
+        : m_threads(),
+          m_batches(),
+          m_mutex(),
+          m_batchReady(),
+          m_batchDone(),
+          m_stop(false) {
+    // the calling thread is the last worker
+    unsigned int numThreads = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+    for (unsigned int i = 0; i < numThreads; i++)
+        m_threads.emplace_back(&CpuBatchPool::WorkerThread, this);
+}
+
+CpuBatchPool::~CpuBatchPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_batchReady.notify_all();
+
+    for (std::thread &thread : m_threads)
+        thread.join();
+}
+
+// called with the lock held, it is released while the item runs
+void CpuBatchPool::RunItem(Batch *batch, std::unique_lock<std::mutex> &lock) {
+    mfxU32 index = batch->next++;
+    if (batch->next == batch->count)
+        m_batches.erase(std::find(m_batches.begin(), m_batches.end(), batch));
+
+    lock.unlock();
+    (*batch->task)(index);
+    lock.lock();
+
+    if (--batch->remaining == 0)
+        m_batchDone.notify_all();
+}
+
+void CpuBatchPool::WorkerThread() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;) {
+        m_batchReady.wait(lock, [this] {
+            return m_stop || !m_batches.empty();
+        });
+        if (m_stop)
+            return;
+
+        RunItem(m_batches.front(), lock);
+    }
+}
+
+void CpuBatchPool::Run(mfxU32 count, const std::function<void(mfxU32)> &task) {
+    if (!count)
+        return;
+
+    Batch batch     = {};
+    batch.task      = &task;
+    batch.count     = count;
+    batch.remaining = count;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_batches.push_back(&batch);
+    m_batchReady.notify_all();
+
+    while (batch.next < batch.count)
+        RunItem(&batch, lock);
+
+    m_batchDone.wait(lock, [&batch] {
+        return batch.remaining == 0;
+    });
+}
@@ -0,0 +1,60 @@
+/*############################################################################
+  # Copyright (C) 2021 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef CPU_SRC_CPU_BATCH_POOL_H_
+#define CPU_SRC_CPU_BATCH_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "src/cpu_common.h"
+
+// Worker threads shared by every session in the process, for batch calls such as
+// MFXVideoDECODE_DecodeFrameBatch(). The threads start on first use and stop when the
+// last session closes, not in static destruction: on Windows that runs under the loader
+// lock, and joining a thread there deadlocks. The calling thread runs items of its own
+// batch too, so concurrent batches from several app threads all make progress.
+class CpuBatchPool {
+public:
+    // every open session holds the pool
+    static void AddSession();
+    static void ReleaseSession();
+
+    // valid while the calling session is open
+    static CpuBatchPool &GetInstance();
+
+    // calls task(0) .. task(count - 1) in any order, returns when all have finished
+    void Run(mfxU32 count, const std::function<void(mfxU32)> &task);
+
+private:
+    struct Batch {
+        const std::function<void(mfxU32)> *task;
+        mfxU32 count;
+        mfxU32 next; // first item not yet started
+        mfxU32 remaining; // items not yet finished
+    };
+
+    CpuBatchPool();
+    ~CpuBatchPool();
+    void WorkerThread();
+    void RunItem(Batch *batch, std::unique_lock<std::mutex> &lock);
+
+    std::vector<std::thread> m_threads;
+    std::deque<Batch *> m_batches; // with items not yet started
+    std::mutex m_mutex;
+    std::condition_variable m_batchReady;
+    std::condition_variable m_batchDone;
+    bool m_stop;
+
+    /* copy not allowed */
+    CpuBatchPool(const CpuBatchPool &);
+    CpuBatchPool &operator=(const CpuBatchPool &);
+};
+
+#endif // CPU_SRC_CPU_BATCH_POOL_H_
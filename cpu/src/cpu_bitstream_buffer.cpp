@@ -0,0 +1,121 @@
+/*############################################################################
+  # Copyright (C) 2021 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "src/cpu_bitstream_buffer.h"
+#include <mutex>
+
+// sizes are rounded up to a power of two from 16 KiB to MAX_SIZE, one pool for each
+#define MIN_SIZE_LOG2 14
+#define MAX_SIZE_LOG2 30
+
+struct BitstreamBuffer {
+    AVBufferRef *buf; // until ReleaseBuffer() or Unregister()
+    size_t size; // readable from data, padding included
+    bool writable; // from a pool, the app writes frames into it
+};
+
+// buffers the app holds and registered memory by their data, and the pools
+static std::mutex g_buffersMutex;
+static std::map<const mfxU8 *, BitstreamBuffer> g_buffers;
+static AVBufferPool *g_pools[MAX_SIZE_LOG2 - MIN_SIZE_LOG2 + 1] = {};
+
+// no threads involved, so the pools can go in static destruction, each is freed
+// once the last of its buffers is back
+static struct BitstreamPoolsCleanup {
+    ~BitstreamPoolsCleanup() {
+        for (AVBufferPool *&pool : g_pools)
+            av_buffer_pool_uninit(&pool);
+    }
+} g_poolsCleanup;
+
+mfxStatus CpuBitstreamBuffers::GetBuffer(mfxU32 size, mfxBitstream *bs) {
+    RET_IF_FALSE(bs, MFX_ERR_NULL_PTR);
+    RET_IF_FALSE(size <= MAX_SIZE, MFX_ERR_UNSUPPORTED);
+
+    int sizeLog2 = MIN_SIZE_LOG2;
+    while ((1u << sizeLog2) < size)
+        sizeLog2++;
+    mfxU32 classSize = 1u << sizeLog2;
+
+    std::lock_guard<std::mutex> lock(g_buffersMutex);
+
+    AVBufferPool *&pool = g_pools[sizeLog2 - MIN_SIZE_LOG2];
+    if (!pool)
+        pool = av_buffer_pool_init(classSize + AV_INPUT_BUFFER_PADDING_SIZE, nullptr);
+    RET_IF_FALSE(pool, MFX_ERR_MEMORY_ALLOC);
+
+    AVBufferRef *buf = av_buffer_pool_get(pool);
+    RET_IF_FALSE(buf, MFX_ERR_MEMORY_ALLOC);
+
+    g_buffers[buf->data] = { buf, (size_t)buf->size, true };
+
+    bs->Data       = buf->data;
+    bs->DataOffset = 0;
+    bs->DataLength = 0;
+    bs->MaxLength  = classSize;
+
+    return MFX_ERR_NONE;
+}
+
+// the memory goes back to its pool when the decoder has no frame from it left
+mfxStatus CpuBitstreamBuffers::ReleaseBuffer(mfxBitstream *bs) {
+    RET_IF_FALSE(bs, MFX_ERR_NULL_PTR);
+
+    std::lock_guard<std::mutex> lock(g_buffersMutex);
+
+    auto buffer = g_buffers.find(bs->Data);
+    RET_IF_FALSE(buffer != g_buffers.end() && buffer->second.writable,
+                 MFX_ERR_UNDEFINED_BEHAVIOR);
+
+    av_buffer_unref(&buffer->second.buf);
+    g_buffers.erase(buffer);
+
+    bs->Data       = nullptr;
+    bs->DataOffset = 0;
+    bs->DataLength = 0;
+    bs->MaxLength  = 0;
+
+    return MFX_ERR_NONE;
+}
+
+void CpuBitstreamBuffers::Register(AVBufferRef *buf, size_t size) {
+    std::lock_guard<std::mutex> lock(g_buffersMutex);
+    g_buffers[buf->data] = { buf, size, false };
+}
+
+// the memory is freed when the decoder has no frame from it left
+void CpuBitstreamBuffers::Unregister(const mfxU8 *data) {
+    std::lock_guard<std::mutex> lock(g_buffersMutex);
+
+    auto buffer = g_buffers.find(data);
+    if (buffer != g_buffers.end()) {
+        av_buffer_unref(&buffer->second.buf);
+        g_buffers.erase(buffer);
+    }
+}
+
+AVBufferRef *CpuBitstreamBuffers::RefFrame(const mfxU8 *data, mfxU32 size) {
+    std::lock_guard<std::mutex> lock(g_buffersMutex);
+
+    // the last buffer that starts at or before the frame
+    auto buffer = g_buffers.upper_bound(data);
+    if (buffer == g_buffers.begin())
+        return nullptr;
+    buffer--;
+
+    size_t offset = (size_t)(data - buffer->first);
+    if (offset > buffer->second.size ||
+        buffer->second.size - offset < (size_t)size + AV_INPUT_BUFFER_PADDING_SIZE)
+        return nullptr;
+
+    // the app fills the buffer and may leave anything after the frame, read only memory
+    // is passed as it is, libavcodec needs the padding readable and only uses zeros in it
+    // to stop early on damaged streams
+    if (buffer->second.writable)
+        memset(const_cast<mfxU8 *>(data) + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    return av_buffer_ref(buffer->second.buf);
+}
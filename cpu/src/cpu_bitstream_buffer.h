@@ -0,0 +1,37 @@
+/*############################################################################
+  # Copyright (C) 2021 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef CPU_SRC_CPU_BITSTREAM_BUFFER_H_
+#define CPU_SRC_CPU_BITSTREAM_BUFFER_H_
+
+#include "src/cpu_common.h"
+
+// Bitstream memory owned by the runtime, which the decoder passes to libavcodec by
+// reference instead of copying each packet: buffers handed out by MFXBitstream_GetBuffer()
+// and the file mappings of CpuBitstreamReader. A packet holds a reference of its own, so
+// a buffer may be released while libavcodec still has frames from it, as frame threads
+// and libdav1d do. Shared by every session in the process.
+class CpuBitstreamBuffers {
+public:
+    // largest size GetBuffer() hands out
+    static const mfxU32 MAX_SIZE = 1u << 30;
+
+    // a buffer for a frame of up to size bytes, followed by AV_INPUT_BUFFER_PADDING_SIZE
+    // bytes which are zeroed when the frame goes to the decoder
+    static mfxStatus GetBuffer(mfxU32 size, mfxBitstream *bs);
+    static mfxStatus ReleaseBuffer(mfxBitstream *bs);
+
+    // memory the runtime does not write to, readable up to size bytes from buf->data,
+    // the registry takes over the reference
+    static void Register(AVBufferRef *buf, size_t size);
+    static void Unregister(const mfxU8 *data);
+
+    // a new reference to the buffer the frame is in if it is followed by padding inside it,
+    // otherwise nullptr
+    static AVBufferRef *RefFrame(const mfxU8 *data, mfxU32 size);
+};
+
+#endif // CPU_SRC_CPU_BITSTREAM_BUFFER_H_
@@ -0,0 +1,303 @@
+/*############################################################################
+  # Copyright (C) 2021 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "src/cpu_bitstream_reader.h"
+#include <climits>
+#include "src/cpu_bitstream_buffer.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+CpuBitstreamReader::~CpuBitstreamReader() {
+    UnmapFile();
+}
+
+mfxStatus CpuBitstreamReader::Open(const char *path, mfxU32 codecId) {
+    RET_IF_FALSE(path, MFX_ERR_NULL_PTR);
+
+    UnmapFile();
+    m_frames.clear();
+    m_next    = 0;
+    m_codecId = codecId;
+
+    mfxStatus sts = MapFile(path);
+    RET_IF_FALSE(sts == MFX_ERR_NONE, sts);
+
+    // an empty file has no frames in any format
+    if (!m_size)
+        return MFX_ERR_NONE;
+
+    // any codec can come in IVF, the other formats are given by the codec
+    if (m_size >= 4 && !memcmp(m_data, "DKIF", 4))
+        return IndexIVF();
+
+    switch (codecId) {
+        case MFX_CODEC_AVC:
+        case MFX_CODEC_HEVC:
+            return IndexAnnexB();
+        case MFX_CODEC_JPEG:
+            return IndexJPEG();
+        default:
+            return MFX_ERR_UNSUPPORTED;
+    }
+}
+
+mfxStatus CpuBitstreamReader::GetFrame(mfxBitstream *bs) {
+    RET_IF_FALSE(bs, MFX_ERR_NULL_PTR);
+    if (m_next >= m_frames.size())
+        return MFX_ERR_MORE_DATA;
+
+    const Frame &frame = m_frames[m_next];
+    m_next++;
+
+    // the rest of the mapping follows the frame, the decoder passes the frame by reference
+    // with what comes after it as padding, see MapFile()
+    size_t maxLength = m_size - frame.offset;
+    if (maxLength > 0xFFFFFFFF)
+        maxLength = 0xFFFFFFFF;
+
+    bs->Data       = const_cast<mfxU8 *>(m_data + frame.offset);
+    bs->DataOffset = 0;
+    bs->DataLength = frame.size;
+    bs->MaxLength  = (mfxU32)maxLength;
+    bs->DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
+    bs->CodecId    = m_codecId;
+
+    return MFX_ERR_NONE;
+}
+
+// frees the mapping with its last reference, opaque is the size of the file
+static void UnmapBuffer(void *opaque, uint8_t *data) {
+#if defined(_WIN32) || defined(_WIN64)
+    UnmapViewOfFile(data);
+#else
+    munmap(data, reinterpret_cast<size_t>(opaque));
+#endif
+}
+
+// read only and private, the decoder never writes to the bitstream
+mfxStatus CpuBitstreamReader::MapFile(const char *path) {
+#if defined(_WIN32) || defined(_WIN64)
+    SYSTEM_INFO info = {};
+    GetSystemInfo(&info);
+    size_t pageSize = info.dwPageSize;
+
+    HANDLE file = CreateFileA(path,
+                              GENERIC_READ,
+                              FILE_SHARE_READ,
+                              nullptr,
+                              OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN,
+                              nullptr);
+    RET_IF_FALSE(file != INVALID_HANDLE_VALUE, MFX_ERR_NOT_FOUND);
+
+    LARGE_INTEGER size = {};
+    HANDLE mapping     = nullptr;
+    if (GetFileSizeEx(file, &size) && size.QuadPart)
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    // the view keeps the mapping and the file open
+    if (mapping) {
+        m_data = static_cast<const mfxU8 *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+
+    RET_IF_FALSE(m_data || !size.QuadPart, MFX_ERR_MEMORY_ALLOC);
+    m_size = (size_t)size.QuadPart;
+#else
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+
+    int fd = open(path, O_RDONLY);
+    RET_IF_FALSE(fd >= 0, MFX_ERR_NOT_FOUND);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return MFX_ERR_UNKNOWN;
+    }
+
+    // the mapping keeps the file open
+    void *data = nullptr;
+    if (st.st_size)
+        data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    RET_IF_FALSE(data != MAP_FAILED, MFX_ERR_MEMORY_ALLOC);
+
+    // indexing reads all of it right away
+    if (data)
+        madvise(data, (size_t)st.st_size, MADV_WILLNEED);
+
+    m_data = static_cast<const mfxU8 *>(data);
+    m_size = (size_t)st.st_size;
+#endif
+    if (!m_data)
+        return MFX_ERR_NONE;
+
+    // the decoder references frames in the mapping, so it stays until the reader is closed
+    // and the decoder has no frame from it left. libavcodec may read AV_INPUT_BUFFER_PADDING_SIZE
+    // bytes past a frame, after one comes the next, starting with a start code, SOI or an
+    // IVF frame header, the last one is followed by the zeroed rest of its page
+    AVBufferRef *buf = av_buffer_create(const_cast<mfxU8 *>(m_data),
+                                        (m_size < INT_MAX) ? (int)m_size : INT_MAX,
+                                        UnmapBuffer,
+                                        reinterpret_cast<void *>(m_size),
+                                        AV_BUFFER_FLAG_READONLY);
+    if (!buf) {
+        UnmapBuffer(reinterpret_cast<void *>(m_size), const_cast<mfxU8 *>(m_data));
+        m_data = nullptr;
+        m_size = 0;
+        return MFX_ERR_MEMORY_ALLOC;
+    }
+    CpuBitstreamBuffers::Register(buf, (m_size + pageSize - 1) / pageSize * pageSize);
+
+    return MFX_ERR_NONE;
+}
+
+void CpuBitstreamReader::UnmapFile() {
+    if (m_data)
+        CpuBitstreamBuffers::Unregister(m_data);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+// position of the next 00 00 01 start code at or after pos, size if there is none
+static size_t FindStartCode(const mfxU8 *data, size_t size, size_t pos) {
+    for (; pos + 2 < size; pos++) {
+        if (data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 1)
+            return pos;
+    }
+    return size;
+}
+
+// an access unit ends before the parameter sets, AUD or prefix SEI that follow its slices,
+// or before the first slice of the next picture
+mfxStatus CpuBitstreamReader::IndexAnnexB() {
+    bool isHEVC    = (m_codecId == MFX_CODEC_HEVC);
+    bool seenSlice = false;
+
+    // leading zeros go with the first access unit, the zero_byte of a 4 byte start code
+    // with the one before it, as libavcodec's parsers split the stream
+    size_t startCode = FindStartCode(m_data, m_size, 0);
+    size_t auStart   = 0;
+    RET_IF_FALSE(startCode < m_size, MFX_ERR_UNSUPPORTED);
+
+    while (startCode < m_size) {
+        size_t nal = startCode + 3;
+        if (nal >= m_size)
+            break;
+
+        int type = isHEVC ? (m_data[nal] >> 1) & 0x3F : m_data[nal] & 0x1F;
+
+        bool isSlice   = isHEVC ? (type <= 31) : (type >= 1 && type <= 5);
+        bool startsAU  = isHEVC ? ((type >= 32 && type <= 35) || type == 39 ||
+                                  (type >= 41 && type <= 44) || (type >= 48 && type <= 55))
+                                : ((type >= 6 && type <= 9) || (type >= 14 && type <= 18));
+        size_t flagPos = nal + (isHEVC ? 2 : 1);
+
+        // first_slice_segment_in_pic_flag, or first_mb_in_slice = 0 coded as a single 1 bit
+        if (isSlice && flagPos < m_size && (m_data[flagPos] & 0x80))
+            startsAU = true;
+
+        if (seenSlice && startsAU) {
+            m_frames.push_back({ auStart, (mfxU32)(startCode - auStart) });
+            auStart   = startCode;
+            seenSlice = false;
+        }
+        if (isSlice)
+            seenSlice = true;
+
+        startCode = FindStartCode(m_data, m_size, nal);
+    }
+
+    m_frames.push_back({ auStart, (mfxU32)(m_size - auStart) });
+    return MFX_ERR_NONE;
+}
+
+// marker segments are skipped by their length, so APPn thumbnails with their own SOI/EOI
+// stay inside the image
+mfxStatus CpuBitstreamReader::IndexJPEG() {
+    size_t pos = 0;
+
+    while (pos + 1 < m_size) {
+        // anything between images is dropped
+        if (m_data[pos] != 0xFF || m_data[pos + 1] != 0xD8) {
+            pos++;
+            continue;
+        }
+
+        size_t start  = pos;
+        bool complete = false;
+
+        pos += 2;
+
+        while (!complete && pos + 1 < m_size) {
+            if (m_data[pos] != 0xFF || m_data[pos + 1] == 0xFF) {
+                pos++;
+                continue;
+            }
+
+            mfxU8 marker = m_data[pos + 1];
+            pos += 2;
+
+            if (marker == 0xD9) {
+                complete = true;
+                continue;
+            }
+            // TEM and RSTn have no length
+            if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7) || pos + 1 >= m_size)
+                continue;
+
+            pos = pos + ((m_data[pos] << 8) | m_data[pos + 1]);
+
+            // entropy coded data runs to the first marker that is not stuffing or RSTn
+            if (marker == 0xDA) {
+                while (pos + 1 < m_size &&
+                       (m_data[pos] != 0xFF || !m_data[pos + 1] ||
+                        (m_data[pos + 1] >= 0xD0 && m_data[pos + 1] <= 0xD7)))
+                    pos++;
+            }
+        }
+
+        // a truncated last image goes to the decoder as it is
+        if (pos > m_size)
+            pos = m_size;
+        m_frames.push_back({ start, (mfxU32)(pos - start) });
+    }
+
+    RET_IF_FALSE(!m_frames.empty(), MFX_ERR_UNSUPPORTED);
+    return MFX_ERR_NONE;
+}
+
+static mfxU32 ReadLE32(const mfxU8 *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((mfxU32)p[3] << 24);
+}
+
+// 32 byte file header, then each frame after a 4 byte size and an 8 byte timestamp
+mfxStatus CpuBitstreamReader::IndexIVF() {
+    RET_IF_FALSE(m_size >= 32, MFX_ERR_UNSUPPORTED);
+
+    size_t pos = m_data[6] | (m_data[7] << 8);
+    while (pos + 12 <= m_size) {
+        mfxU32 size = ReadLE32(m_data + pos);
+        pos         = pos + 12;
+
+        // a truncated last frame is dropped, the decoder could not use it
+        if (size > m_size - pos)
+            break;
+
+        m_frames.push_back({ pos, size });
+        pos = pos + size;
+    }
+
+    return MFX_ERR_NONE;
+}
@@ -0,0 +1,66 @@
+/*############################################################################
+  # Copyright (C) 2021 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef CPU_SRC_CPU_BITSTREAM_READER_H_
+#define CPU_SRC_CPU_BITSTREAM_READER_H_
+
+#include <vector>
+#include "src/cpu_common.h"
+
+// Maps a file read only and splits it into complete frames, which are handed out as
+// mfxBitstream pointing into the mapping, nothing is copied.
+//  - AVC/HEVC: Annex B elementary stream, split into access units
+//  - JPEG: concatenated images, SOI to EOI
+//  - AV1: IVF container, one temporal unit per IVF frame
+// The whole file is indexed in Open(), so getting a frame costs the same for every
+// frame and Rewind() can replay the file, as benchmarks do.
+class CpuBitstreamReader {
+public:
+    CpuBitstreamReader()
+            : m_data(nullptr),
+              m_size(0),
+              m_codecId(0),
+              m_frames(),
+              m_next(0) {}
+    ~CpuBitstreamReader();
+
+    mfxStatus Open(const char *path, mfxU32 codecId);
+
+    // the frame stays valid until the reader is closed, MFX_ERR_MORE_DATA after the last one
+    mfxStatus GetFrame(mfxBitstream *bs);
+
+    void Rewind() {
+        m_next = 0;
+    }
+
+    mfxU32 GetNumFrames() {
+        return (mfxU32)m_frames.size();
+    }
+
+private:
+    struct Frame {
+        size_t offset;
+        mfxU32 size;
+    };
+
+    mfxStatus MapFile(const char *path);
+    void UnmapFile();
+    mfxStatus IndexAnnexB();
+    mfxStatus IndexJPEG();
+    mfxStatus IndexIVF();
+
+    const mfxU8 *m_data;
+    size_t m_size;
+    mfxU32 m_codecId;
+    std::vector<Frame> m_frames;
+    size_t m_next;
+
+    /* copy not allowed */
+    CpuBitstreamReader(const CpuBitstreamReader &);
+    CpuBitstreamReader &operator=(const CpuBitstreamReader &);
+};
+
+#endif // CPU_SRC_CPU_BITSTREAM_READER_H_
@@ -4,9 +4,16 @@
   # SPDX-License-Identifier: MIT
   ############################################################################*/
 
+#include <atomic>
 #include "src/cpu_common.h"
 #include "src/frame_lock.h"
 
+#if defined(_WIN32) || defined(_WIN64)
+    #include <windows.h>
+#else
+    #include <unistd.h>
+#endif
+
 AVPixelFormat MFXFourCC2AVPixelFormat(uint32_t fourcc) {
     switch (fourcc) {
         case MFX_FOURCC_I010:
@@ -120,6 +127,19 @@ mfxStatus AVFrame2mfxFrameSurface(mfxFrameSurface1 *surface,
             info->BitDepthChroma = 8;
             info->ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
             break;
+        case AV_PIX_FMT_NV12:
+            info->FourCC         = MFX_FOURCC_NV12;
+            info->BitDepthLuma   = 8;
+            info->BitDepthChroma = 8;
+            info->ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+            break;
+        case AV_PIX_FMT_P010LE:
+            info->FourCC         = MFX_FOURCC_P010;
+            info->BitDepthLuma   = 10;
+            info->BitDepthChroma = 10;
+            info->ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+            info->Shift          = 1;
+            break;
         case AV_PIX_FMT_BGRA:
             info->FourCC         = MFX_FOURCC_BGRA;
             info->BitDepthLuma   = 8;
@@ -165,6 +185,18 @@ mfxStatus AVFrame2mfxFrameSurface(mfxFrameSurface1 *surface,
         w = info->Width;
         h = info->Height;
     }
+    else if (frame->format == AV_PIX_FMT_NV12) {
+        RET_IF_FALSE(info->FourCC == MFX_FOURCC_NV12, MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+
+        w = info->Width;
+        h = info->Height;
+    }
+    else if (frame->format == AV_PIX_FMT_P010LE) {
+        RET_IF_FALSE(info->FourCC == MFX_FOURCC_P010, MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+
+        w = info->Width * 2;
+        h = info->Height;
+    }
     else if (frame->format == AV_PIX_FMT_BGRA) {
         RET_IF_FALSE(info->FourCC == MFX_FOURCC_RGB4, MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
 
@@ -202,6 +234,19 @@ mfxStatus AVFrame2mfxFrameSurface(mfxFrameSurface1 *surface,
             memcpy_s(data->V + offset, w / 2, frame->data[2] + y * frame->linesize[2], w / 2);
         }
     }
+    else if ((frame->format == AV_PIX_FMT_NV12) || (frame->format == AV_PIX_FMT_P010LE)) {
+        // copy Y plane
+        for (y = 0; y < h; y++) {
+            offset = pitch * (y + info->CropY) + info->CropX;
+            memcpy_s(data->Y + offset, w, frame->data[0] + y * frame->linesize[0], w);
+        }
+
+        // copy interleaved UV plane
+        for (y = 0; y < h / 2; y++) {
+            offset = pitch * (y + info->CropY) + info->CropX;
+            memcpy_s(data->UV + offset, w, frame->data[1] + y * frame->linesize[1], w);
+        }
+    }
     else {
         // copy Y plane
         for (y = 0; y < h; y++) {
@@ -230,6 +275,105 @@ mfxStatus AVFrame2mfxFrameSurface(mfxFrameSurface1 *surface,
     return MFX_ERR_NONE;
 }
 
+mfxExtBuffer *GetExtBuffer(mfxExtBuffer **extParam, mfxU16 numExtParam, mfxU32 bufferId) {
+    if (!extParam)
+        return nullptr;
+
+    for (mfxU16 i = 0; i < numExtParam; i++) {
+        if (extParam[i] && extParam[i]->BufferId == bufferId)
+            return extParam[i];
+    }
+
+    return nullptr;
+}
+
+bool GetDecodeMaxResolution(mfxU32 codecId, mfxU32 *maxWidth, mfxU32 *maxHeight) {
+    switch (codecId) {
+        case MFX_CODEC_AVC: // level 6.2
+        case MFX_CODEC_HEVC: // level 6.2
+            *maxWidth  = 8192;
+            *maxHeight = 4320;
+            return true;
+        case MFX_CODEC_AV1: // level 6.3
+            *maxWidth  = 16384;
+            *maxHeight = 8704;
+            return true;
+        case MFX_CODEC_JPEG:
+            *maxWidth  = 16384;
+            *maxHeight = 16384;
+            return true;
+        default:
+            return false;
+    }
+}
+
+mfxU64 GetFrameSizeBytes(const mfxFrameInfo *info) {
+    int size = av_image_get_buffer_size(MFXFourCC2AVPixelFormat(info->FourCC),
+                                        info->Width,
+                                        info->Height,
+                                        1);
+    // unknown format, assume the largest one we handle
+    if (size < 0)
+        return (mfxU64)info->Width * info->Height * 4;
+
+    return (mfxU64)size;
+}
+
+// half of the physical memory, 0 (no limit) if it cannot be queried
+static mfxU64 GetDefaultMemoryBudget() {
+#if defined(_WIN32) || defined(_WIN64)
+    MEMORYSTATUSEX status = {};
+    status.dwLength       = sizeof(status);
+    if (!GlobalMemoryStatusEx(&status))
+        return 0;
+    return status.ullTotalPhys / 2;
+#else
+    long pages    = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGE_SIZE);
+    if (pages <= 0 || pageSize <= 0)
+        return 0;
+    return (mfxU64)pages * pageSize / 2;
+#endif
+}
+
+// frame memory reserved by all decoders and VPPs in the process
+static std::atomic<mfxU64> g_reservedMemory(0);
+
+mfxStatus CpuMemoryReservation::Reserve(mfxVideoParam *par, mfxU64 bytes) {
+    RET_IF_FALSE(par, MFX_ERR_NULL_PTR);
+
+    mfxU64 budget = 0;
+
+    mfxExtCpuMemoryBudget *budgetBuf = reinterpret_cast<mfxExtCpuMemoryBudget *>(
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_MEMORY_BUDGET));
+    if (budgetBuf)
+        RET_IF_FALSE(budgetBuf->Header.BufferSz == sizeof(mfxExtCpuMemoryBudget),
+                     MFX_ERR_INVALID_VIDEO_PARAM);
+
+    if (budgetBuf && budgetBuf->MaxMemoryMB)
+        budget = (mfxU64)budgetBuf->MaxMemoryMB << 20;
+    else
+        budget = GetDefaultMemoryBudget();
+
+    // other instances reserve concurrently, the check and the update must be one step
+    mfxU64 total = g_reservedMemory.load();
+    mfxU64 next  = 0;
+    do {
+        next = total - m_bytes + bytes;
+        if (budget && next > budget)
+            return MFX_ERR_MEMORY_ALLOC;
+    } while (!g_reservedMemory.compare_exchange_weak(total, next));
+
+    m_bytes = bytes;
+
+    return MFX_ERR_NONE;
+}
+
+void CpuMemoryReservation::Release() {
+    g_reservedMemory -= m_bytes;
+    m_bytes = 0;
+}
+
 mfxStatus CheckFrameInfoCommon(mfxFrameInfo *info, mfxU32 codecId) {
     RET_IF_FALSE(info, MFX_ERR_NULL_PTR);
 
@@ -290,7 +434,8 @@ mfxStatus CheckFrameInfoCodecs(mfxFrameInfo *info, mfxU32 codecId) {
 
     switch (codecId) {
         case MFX_CODEC_JPEG:
-            if (info->FourCC != MFX_FOURCC_I420)
+            // I422 keeps 4:2:2 jpegs unconverted, other layouts are converted to I420
+            if (info->FourCC != MFX_FOURCC_I420 && info->FourCC != MFX_FOURCC_I422)
                 return MFX_ERR_INVALID_VIDEO_PARAM;
             break;
         case MFX_CODEC_AVC:
@@ -321,19 +466,10 @@ mfxStatus CheckFrameInfoCodecs(mfxFrameInfo *info, mfxU32 codecId) {
             break;
     }
 
-    switch (codecId) {
-        case MFX_CODEC_JPEG:
-        case MFX_CODEC_AVC:
-        case MFX_CODEC_AV1:
-            if (info->Width > 3840 || info->Height > 2160)
-                return MFX_ERR_INVALID_VIDEO_PARAM;
-            break;
-        case MFX_CODEC_HEVC:
-            if (info->Width > 8192 || info->Height > 4096)
-                return MFX_ERR_INVALID_VIDEO_PARAM;
-            break;
-        default:
-            break;
+    mfxU32 maxWidth, maxHeight;
+    if (GetDecodeMaxResolution(codecId, &maxWidth, &maxHeight)) {
+        if (info->Width > maxWidth || info->Height > maxHeight)
+            return MFX_ERR_INVALID_VIDEO_PARAM;
     }
 
     return MFX_ERR_NONE;
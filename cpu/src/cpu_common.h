@@ -15,6 +15,7 @@
 #include <string>
 #include <vector>
 
+#include "vpl/mfxcpu.h"
 #include "vpl/mfxjpeg.h"
 #include "vpl/mfxstructures.h"
 #include "vpl/mfxsurfacepool.h"
@@ -37,8 +38,12 @@ extern "C" {
 #include "libavfilter/buffersink.h"
 #include "libavfilter/buffersrc.h"
 #include "libavformat/avformat.h"
+#include "libavutil/film_grain_params.h"
 #include "libavutil/imgutils.h"
+#include "libavutil/mastering_display_metadata.h"
+#include "libavutil/motion_vector.h"
 #include "libavutil/opt.h"
+#include "libavutil/video_enc_params.h"
 #include "libswscale/swscale.h"
 }
 
@@ -120,6 +125,39 @@ mfxStatus AVFrame2mfxFrameSurface(mfxFrameSurface1 *surface,
                                   AVFrame *frame,
                                   mfxFrameAllocator *allocator);
 
+// return attached extension buffer with given id, nullptr if not present
+mfxExtBuffer *GetExtBuffer(mfxExtBuffer **extParam, mfxU16 numExtParam, mfxU32 bufferId);
+
+// largest frame the decoder for codecId handles, kept in sync with libmfxvplsw_caps_dec.h
+// returns false for unsupported codecs
+bool GetDecodeMaxResolution(mfxU32 codecId, mfxU32 *maxWidth, mfxU32 *maxHeight);
+
+// bytes used by one frame with the given size and FourCC
+mfxU64 GetFrameSizeBytes(const mfxFrameInfo *info);
+
+// frame memory of one decoder or VPP instance, counted against a budget shared by all
+// instances in the process and given back on destruction
+class CpuMemoryReservation {
+public:
+    CpuMemoryReservation() : m_bytes(0) {}
+    ~CpuMemoryReservation() {
+        Release();
+    }
+
+    // replaces the current reservation, MFX_ERR_MEMORY_ALLOC if the process total would go
+    // over the limit set with mfxExtCpuMemoryBudget, or half of the physical memory if par
+    // has no such buffer, the current reservation is kept then
+    mfxStatus Reserve(mfxVideoParam *par, mfxU64 bytes);
+    void Release();
+
+private:
+    mfxU64 m_bytes;
+
+    /* copy not allowed */
+    CpuMemoryReservation(const CpuMemoryReservation &);
+    CpuMemoryReservation &operator=(const CpuMemoryReservation &);
+};
+
 mfxStatus CheckFrameInfoCommon(mfxFrameInfo *info, mfxU32 codecId);
 mfxStatus CheckFrameInfoCodecs(mfxFrameInfo *info, mfxU32 codecId);
 mfxStatus CheckVideoParamCommon(mfxVideoParam *in);
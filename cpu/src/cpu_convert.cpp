@@ -0,0 +1,286 @@
+/*############################################################################
+  # Copyright (C) 2021 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "src/cpu_convert.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define CPU_CONVERT_SSE2
+    #include <emmintrin.h>
+#endif
+
+// 10 -> 8 bit drops two bits, so every bias value is in [0, 3]
+static const uint16_t kDitherMatrix[2][2] = { { 0, 2 }, { 3, 1 } };
+
+// bias pattern for row y, entry i applies to plane column (i & 7)
+static void GetRowBias(mfxU16 method, int y, uint16_t bias[8]) {
+    for (int i = 0; i < 8; i++) {
+        switch (method) {
+            case MFX_CPU_DEPTH_CONVERSION_DITHER:
+                bias[i] = kDitherMatrix[y & 1][i & 1];
+                break;
+            case MFX_CPU_DEPTH_CONVERSION_TRUNCATE:
+                bias[i] = 0;
+                break;
+            default:
+                bias[i] = 2;
+                break;
+        }
+    }
+}
+
+static inline uint8_t ReduceSample(uint16_t s, int shift, uint16_t bias) {
+    uint32_t v = ((uint32_t)(s >> shift) + bias) >> 2;
+    return (uint8_t)(v > 255 ? 255 : v);
+}
+
+#ifdef CPU_CONVERT_SSE2
+// 8 samples, result stays in 16-bit lanes (packus saturates to 255 afterwards)
+static inline __m128i Reduce8(__m128i s, __m128i shift, __m128i bias) {
+    return _mm_srli_epi16(_mm_adds_epu16(_mm_srl_epi16(s, shift), bias), 2);
+}
+#endif
+
+// n samples, same layout in and out (planar or interleaved)
+static void ReduceRow(const uint16_t *src, uint8_t *dst, int n, int shift, const uint16_t *bias) {
+    int i = 0;
+#ifdef CPU_CONVERT_SSE2
+    const __m128i vshift = _mm_cvtsi32_si128(shift);
+    const __m128i vbias  = _mm_loadu_si128((const __m128i *)bias);
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = Reduce8(_mm_loadu_si128((const __m128i *)(src + i)), vshift, vbias);
+        __m128i b = Reduce8(_mm_loadu_si128((const __m128i *)(src + i + 8)), vshift, vbias);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(a, b));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = ReduceSample(src[i], shift, bias[i & 7]);
+}
+
+// n chroma pairs, planar U/V in, interleaved UV out (I010 -> NV12)
+static void ReduceRowInterleave(const uint16_t *srcU,
+                                const uint16_t *srcV,
+                                uint8_t *dstUV,
+                                int n,
+                                int shift,
+                                const uint16_t *bias) {
+    int i = 0;
+#ifdef CPU_CONVERT_SSE2
+    const __m128i vshift = _mm_cvtsi32_si128(shift);
+    const __m128i vbias  = _mm_loadu_si128((const __m128i *)bias);
+    for (; i + 8 <= n; i += 8) {
+        __m128i u = Reduce8(_mm_loadu_si128((const __m128i *)(srcU + i)), vshift, vbias);
+        __m128i v = Reduce8(_mm_loadu_si128((const __m128i *)(srcV + i)), vshift, vbias);
+        __m128i p = _mm_packus_epi16(u, v); // u0..u7 v0..v7
+        _mm_storeu_si128((__m128i *)(dstUV + 2 * i), _mm_unpacklo_epi8(p, _mm_srli_si128(p, 8)));
+    }
+#endif
+    for (; i < n; i++) {
+        dstUV[2 * i]     = ReduceSample(srcU[i], shift, bias[i & 7]);
+        dstUV[2 * i + 1] = ReduceSample(srcV[i], shift, bias[i & 7]);
+    }
+}
+
+// n chroma pairs, interleaved UV in, planar U/V out (P010 -> I420)
+static void ReduceRowDeinterleave(const uint16_t *srcUV,
+                                  uint8_t *dstU,
+                                  uint8_t *dstV,
+                                  int n,
+                                  int shift,
+                                  const uint16_t *bias) {
+    int i = 0;
+#ifdef CPU_CONVERT_SSE2
+    // both samples of a pair share the bias of their plane column
+    uint16_t biasLo[8], biasHi[8];
+    for (int j = 0; j < 8; j++) {
+        biasLo[j] = bias[j >> 1];
+        biasHi[j] = bias[4 + (j >> 1)];
+    }
+    const __m128i vshift  = _mm_cvtsi32_si128(shift);
+    const __m128i vbiasLo = _mm_loadu_si128((const __m128i *)biasLo);
+    const __m128i vbiasHi = _mm_loadu_si128((const __m128i *)biasHi);
+    const __m128i lowByte = _mm_set1_epi16(0x00ff);
+    for (; i + 8 <= n; i += 8) {
+        const __m128i *in = (const __m128i *)(srcUV + 2 * i);
+        __m128i a         = Reduce8(_mm_loadu_si128(in), vshift, vbiasLo);
+        __m128i b         = Reduce8(_mm_loadu_si128(in + 1), vshift, vbiasHi);
+        __m128i p  = _mm_packus_epi16(a, b); // u0 v0 u1 v1 .. u7 v7
+        __m128i uv = _mm_packus_epi16(_mm_and_si128(p, lowByte), _mm_srli_epi16(p, 8));
+        _mm_storel_epi64((__m128i *)(dstU + i), uv);
+        _mm_storel_epi64((__m128i *)(dstV + i), _mm_srli_si128(uv, 8));
+    }
+#endif
+    for (; i < n; i++) {
+        dstU[i] = ReduceSample(srcUV[2 * i], shift, bias[i & 7]);
+        dstV[i] = ReduceSample(srcUV[2 * i + 1], shift, bias[i & 7]);
+    }
+}
+
+static inline const uint16_t *SrcRow(const AVFrame *frame, int plane, int y) {
+    return (const uint16_t *)(frame->data[plane] + (ptrdiff_t)y * frame->linesize[plane]);
+}
+
+static inline uint8_t *DstRow(const AVFrame *frame, int plane, int y) {
+    return frame->data[plane] + (ptrdiff_t)y * frame->linesize[plane];
+}
+
+bool IsDepthConversionSupported(mfxU32 srcFourCC, mfxU32 dstFourCC) {
+    return (srcFourCC == MFX_FOURCC_I010 || srcFourCC == MFX_FOURCC_P010) &&
+           (dstFourCC == MFX_FOURCC_I420 || dstFourCC == MFX_FOURCC_NV12);
+}
+
+mfxStatus ConvertFrameTo8Bit(const AVFrame *src, AVFrame *dst, mfxU16 method) {
+    RET_IF_FALSE(src && dst, MFX_ERR_NULL_PTR);
+    RET_IF_FALSE(IsDepthConversionSupported(AVPixelFormat2MFXFourCC(src->format),
+                                            AVPixelFormat2MFXFourCC(dst->format)),
+                 MFX_ERR_UNSUPPORTED);
+    RET_IF_FALSE(dst->width >= src->width && dst->height >= src->height,
+                 MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+
+    bool srcPlanar = (src->format == AV_PIX_FMT_YUV420P10LE);
+    bool dstPlanar = (dst->format == AV_PIX_FMT_YUV420P);
+    RET_IF_FALSE(src->data[0] && src->data[1] && (!srcPlanar || src->data[2]), MFX_ERR_NULL_PTR);
+    RET_IF_FALSE(dst->data[0] && dst->data[1] && (!dstPlanar || dst->data[2]), MFX_ERR_NULL_PTR);
+
+    // P010 keeps its 10 bits in the msbs
+    int shift  = srcPlanar ? 0 : 6;
+    int width  = src->width;
+    int height = src->height;
+    int cw     = (width + 1) / 2;
+    int ch     = (height + 1) / 2;
+    uint16_t bias[8];
+    uint16_t pairBias[8];
+
+    for (int y = 0; y < height; y++) {
+        GetRowBias(method, y, bias);
+        ReduceRow(SrcRow(src, 0, y), DstRow(dst, 0, y), width, shift, bias);
+    }
+
+    for (int y = 0; y < ch; y++) {
+        GetRowBias(method, y, bias);
+        if (srcPlanar && dstPlanar) {
+            ReduceRow(SrcRow(src, 1, y), DstRow(dst, 1, y), cw, shift, bias);
+            ReduceRow(SrcRow(src, 2, y), DstRow(dst, 2, y), cw, shift, bias);
+        }
+        else if (srcPlanar) {
+            ReduceRowInterleave(SrcRow(src, 1, y),
+                                SrcRow(src, 2, y),
+                                DstRow(dst, 1, y),
+                                cw,
+                                shift,
+                                bias);
+        }
+        else if (dstPlanar) {
+            ReduceRowDeinterleave(SrcRow(src, 1, y),
+                                  DstRow(dst, 1, y),
+                                  DstRow(dst, 2, y),
+                                  cw,
+                                  shift,
+                                  bias);
+        }
+        else {
+            for (int j = 0; j < 8; j++)
+                pairBias[j] = bias[j >> 1];
+            ReduceRow(SrcRow(src, 1, y), DstRow(dst, 1, y), 2 * cw, shift, pairBias);
+        }
+    }
+
+    return MFX_ERR_NONE;
+}
+
+// average of two rows (4:2:2 -> 4:2:0), rounds half up
+static void AverageRows(const uint8_t *src0, const uint8_t *src1, uint8_t *dst, int n) {
+    int i = 0;
+#ifdef CPU_CONVERT_SSE2
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src0 + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src1 + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_avg_epu8(a, b));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = (uint8_t)((src0[i] + src1[i] + 1) >> 1);
+}
+
+// average of 2x2 blocks (4:4:4 -> 4:2:0), n output samples
+static void AverageBlocks(const uint8_t *src0, const uint8_t *src1, uint8_t *dst, int n, int srcW) {
+    int i = 0;
+#ifdef CPU_CONVERT_SSE2
+    const __m128i lowByte = _mm_set1_epi16(0x00ff);
+    const __m128i two     = _mm_set1_epi16(2);
+    for (; i + 16 <= n && 2 * i + 32 <= srcW; i += 16) {
+        __m128i s[2];
+        for (int k = 0; k < 2; k++) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src0 + 2 * i + 16 * k));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src1 + 2 * i + 16 * k));
+            // horizontal pair sums of both rows in 16-bit lanes
+            __m128i sum = _mm_add_epi16(_mm_and_si128(a, lowByte), _mm_srli_epi16(a, 8));
+            sum         = _mm_add_epi16(sum, _mm_and_si128(b, lowByte));
+            sum         = _mm_add_epi16(sum, _mm_srli_epi16(b, 8));
+            s[k]        = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(s[0], s[1]));
+    }
+#endif
+    for (; i < n; i++) {
+        // odd width: last column pairs with itself
+        int x0 = 2 * i;
+        int x1 = (x0 + 1 < srcW) ? x0 + 1 : x0;
+        dst[i] = (uint8_t)((src0[x0] + src0[x1] + src1[x0] + src1[x1] + 2) >> 2);
+    }
+}
+
+bool IsChromaDownsampleSupported(int srcFormat) {
+    switch (srcFormat) {
+        case AV_PIX_FMT_YUV422P:
+        case AV_PIX_FMT_YUVJ422P:
+        case AV_PIX_FMT_YUV444P:
+        case AV_PIX_FMT_YUVJ444P:
+            return true;
+        default:
+            return false;
+    }
+}
+
+mfxStatus DownsampleFrameTo420(const AVFrame *src, AVFrame *dst) {
+    RET_IF_FALSE(src && dst, MFX_ERR_NULL_PTR);
+    RET_IF_FALSE(IsChromaDownsampleSupported(src->format), MFX_ERR_UNSUPPORTED);
+    RET_IF_FALSE(dst->format == AV_PIX_FMT_YUV420P || dst->format == AV_PIX_FMT_YUVJ420P,
+                 MFX_ERR_UNSUPPORTED);
+    RET_IF_FALSE(dst->width >= src->width && dst->height >= src->height,
+                 MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+    RET_IF_FALSE(src->data[0] && src->data[1] && src->data[2], MFX_ERR_NULL_PTR);
+    RET_IF_FALSE(dst->data[0] && dst->data[1] && dst->data[2], MFX_ERR_NULL_PTR);
+
+    bool is444 = (src->format == AV_PIX_FMT_YUV444P || src->format == AV_PIX_FMT_YUVJ444P);
+    int width  = src->width;
+    int height = src->height;
+    int srcCW  = is444 ? width : (width + 1) / 2;
+    int cw     = (width + 1) / 2;
+    int ch     = (height + 1) / 2;
+
+    av_image_copy_plane(dst->data[0],
+                        dst->linesize[0],
+                        src->data[0],
+                        src->linesize[0],
+                        width,
+                        height);
+
+    for (int plane = 1; plane < 3; plane++) {
+        for (int y = 0; y < ch; y++) {
+            // odd height: last row pairs with itself
+            int y0              = 2 * y;
+            int y1              = (y0 + 1 < height) ? y0 + 1 : y0;
+            const uint8_t *src0 = DstRow(src, plane, y0);
+            const uint8_t *src1 = DstRow(src, plane, y1);
+            if (is444)
+                AverageBlocks(src0, src1, DstRow(dst, plane, y), cw, srcCW);
+            else
+                AverageRows(src0, src1, DstRow(dst, plane, y), cw);
+        }
+    }
+
+    return MFX_ERR_NONE;
+}
@@ -0,0 +1,27 @@
+/*############################################################################
+  # Copyright (C) 2021 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef CPU_SRC_CPU_CONVERT_H_
+#define CPU_SRC_CPU_CONVERT_H_
+
+#include "src/cpu_common.h"
+
+// true if src -> dst is handled by ConvertFrameTo8Bit()
+bool IsDepthConversionSupported(mfxU32 srcFourCC, mfxU32 dstFourCC);
+
+// reduce I010/P010 frame to I420/NV12
+// dst must already have buffers allocated, at least as large as src
+// method is one of MFX_CPU_DEPTH_CONVERSION_*
+mfxStatus ConvertFrameTo8Bit(const AVFrame *src, AVFrame *dst, mfxU16 method);
+
+// true if src format is handled by DownsampleFrameTo420()
+bool IsChromaDownsampleSupported(int srcFormat);
+
+// 8-bit planar 4:2:2/4:4:4 (incl. full range yuvj) to I420, sample values are not rescaled
+// dst must already have buffers allocated, at least as large as src
+mfxStatus DownsampleFrameTo420(const AVFrame *src, AVFrame *dst);
+
+#endif // CPU_SRC_CPU_CONVERT_H_
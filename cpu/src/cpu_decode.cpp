@@ -7,21 +7,73 @@
 #include "src/cpu_decode.h"
 #include <memory>
 #include <utility>
+#include "src/cpu_bitstream_buffer.h"
+#include "src/cpu_convert.h"
 #include "src/cpu_workstream.h"
 
+// each level discards more work, the last one decodes key frames only (trick play)
+// below the last level, deblocking and idct are only skipped on frames no other frame
+// references, so skipping does not drift until the next IDR
+struct SkipLevel {
+    AVDiscard frame;
+    AVDiscard loopFilter;
+    AVDiscard idct;
+};
+
+static const SkipLevel skipLevels[] = {
+    { AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+    { AVDISCARD_NONREF, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+    { AVDISCARD_BIDIR, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+    { AVDISCARD_BIDIR, AVDISCARD_NONREF, AVDISCARD_DEFAULT },
+    { AVDISCARD_BIDIR, AVDISCARD_BIDIR, AVDISCARD_BIDIR },
+    { AVDISCARD_NONKEY, AVDISCARD_ALL, AVDISCARD_ALL },
+};
+
+static const mfxU32 maxSkipLevel = sizeof(skipLevels) / sizeof(skipLevels[0]) - 1;
+
 CpuDecode::CpuDecode(CpuWorkstream *session)
         : m_avDecCodec(nullptr),
           m_avDecContext(nullptr),
           m_avDecParser(nullptr),
           m_avDecPacket(nullptr),
           m_avDecFrameOut(nullptr),
+          m_avDecFrameJPEG(nullptr),
+          m_jpegPool(nullptr),
+          m_jpegPoolSize(0),
           m_swsContext(nullptr),
+          m_avDecFrameThumb(nullptr),
+          m_thumbnail(),
+          m_thumbLastPts(AV_NOPTS_VALUE),
+          m_thumbCount(0),
+          m_pendingInput(),
+          m_pendingPos(0),
+          m_parallelDecode(),
           m_param(),
           m_decSurfaces(),
+          m_initThreading(),
+          m_initAV1(),
+          m_initAnalytics(),
+          m_memory(),
           m_bFrameBuffered(false),
-          m_bStreamInfo(false),
+          m_bSkipToKeyFrame(false),
+          m_bExportFilmGrain(false),
+          m_errorRecovery(MFX_CPU_DECODE_ERROR_CONCEAL),
+          m_bRecovering(false),
+          m_avKeyParser(nullptr),
           m_session(session),
-          m_frameOrder(0) {}
+          m_frameOrder(0),
+          m_skipLevel(0),
+          m_payloads(),
+          m_statNumFrame(0),
+          m_statNumCorrupted(0),
+          m_statNumError(0),
+          m_statNumDropped(0),
+          m_statNumBadFrames(0),
+          m_statMaxDecodeTimeUs(0),
+          m_statBytesConsumed(0),
+          m_statParserCalls(0),
+          m_statDecodeTimeUs(0),
+          m_statBytesCopied(0) {}
 
 mfxStatus CpuDecode::ValidateDecodeParams(mfxVideoParam *par, bool canCorrect) {
     bool fixedIncompatible = false;
@@ -47,7 +99,7 @@ mfxStatus CpuDecode::ValidateDecodeParams(mfxVideoParam *par, bool canCorrect) {
         if (par->Protected)
             par->Protected = 0;
 
-        if (par->NumExtParam)
+        if (par->NumExtParam && CheckExtParam(par->ExtParam, par->NumExtParam) != MFX_ERR_NONE)
             par->NumExtParam = 0;
 
         par->IOPattern = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
@@ -65,7 +117,7 @@ mfxStatus CpuDecode::ValidateDecodeParams(mfxVideoParam *par, bool canCorrect) {
 
         if (par->Protected)
             return MFX_ERR_INVALID_VIDEO_PARAM;
-        if (par->NumExtParam)
+        if (CheckExtParam(par->ExtParam, par->NumExtParam) != MFX_ERR_NONE)
             return MFX_ERR_INVALID_VIDEO_PARAM;
 
         if (par->IOPattern != MFX_IOPATTERN_OUT_SYSTEM_MEMORY)
@@ -172,8 +224,9 @@ mfxStatus CpuDecode::ValidateDecodeParams(mfxVideoParam *par, bool canCorrect) {
         return MFX_ERR_INVALID_VIDEO_PARAM;
     }
 
-    mfxU32 MAX_WIDTH  = 3840;
-    mfxU32 MAX_HEIGHT = 2160;
+    mfxU32 MAX_WIDTH, MAX_HEIGHT;
+    if (!GetDecodeMaxResolution(par->mfx.CodecId, &MAX_WIDTH, &MAX_HEIGHT))
+        return MFX_ERR_INVALID_VIDEO_PARAM;
 
     //width and height must be <= max
     if (par->mfx.FrameInfo.Width > MAX_WIDTH || par->mfx.FrameInfo.Height > MAX_HEIGHT ||
@@ -199,10 +252,123 @@ mfxStatus CpuDecode::ValidateDecodeParams(mfxVideoParam *par, bool canCorrect) {
         return MFX_ERR_NONE;
 }
 
+static bool IsCodingOption(mfxU16 option) {
+    return option == MFX_CODINGOPTION_UNKNOWN || option == MFX_CODINGOPTION_ON ||
+           option == MFX_CODINGOPTION_OFF;
+}
+
+// only the CPU runtime's own extension buffers are accepted
+mfxStatus CpuDecode::CheckExtParam(mfxExtBuffer **ppExtParam, mfxU16 count) {
+    if (!count)
+        return MFX_ERR_NONE;
+
+    RET_IF_FALSE(ppExtParam, MFX_ERR_NULL_PTR);
+
+    for (mfxU16 i = 0; i < count; i++) {
+        RET_IF_FALSE(ppExtParam[i], MFX_ERR_NULL_PTR);
+
+        switch (ppExtParam[i]->BufferId) {
+            case MFX_EXTBUFF_CPU_MEMORY_BUDGET:
+                RET_IF_FALSE(ppExtParam[i]->BufferSz == sizeof(mfxExtCpuMemoryBudget),
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                break;
+            case MFX_EXTBUFF_CPU_DECODE_STAT:
+                RET_IF_FALSE(ppExtParam[i]->BufferSz == sizeof(mfxExtCpuDecodeStat),
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                break;
+            case MFX_EXTBUFF_CPU_DECODE_FLUSH: {
+                RET_IF_FALSE(ppExtParam[i]->BufferSz == sizeof(mfxExtCpuDecodeFlush),
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                mfxExtCpuDecodeFlush *flush =
+                    reinterpret_cast<mfxExtCpuDecodeFlush *>(ppExtParam[i]);
+                RET_IF_FALSE(flush->Mode <= MFX_CPU_DECODE_FLUSH_SKIP_TO_RAP,
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                break;
+            }
+            case MFX_EXTBUFF_CPU_DECODE_THUMBNAIL: {
+                RET_IF_FALSE(ppExtParam[i]->BufferSz == sizeof(mfxExtCpuDecodeThumbnail),
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                mfxExtCpuDecodeThumbnail *thumbnail =
+                    reinterpret_cast<mfxExtCpuDecodeThumbnail *>(ppExtParam[i]);
+                RET_IF_FALSE(thumbnail->Width && thumbnail->Height, MFX_ERR_INVALID_VIDEO_PARAM);
+                RET_IF_FALSE(!(thumbnail->Width & 1) && !(thumbnail->Height & 1),
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                break;
+            }
+            case MFX_EXTBUFF_CPU_DECODE_ERROR_RECOVERY: {
+                RET_IF_FALSE(ppExtParam[i]->BufferSz == sizeof(mfxExtCpuDecodeErrorRecovery),
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                mfxExtCpuDecodeErrorRecovery *recovery =
+                    reinterpret_cast<mfxExtCpuDecodeErrorRecovery *>(ppExtParam[i]);
+                RET_IF_FALSE(recovery->Mode <= MFX_CPU_DECODE_ERROR_SKIP_TO_RAP,
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                break;
+            }
+            case MFX_EXTBUFF_CPU_DECODE_ANALYTICS: {
+                RET_IF_FALSE(ppExtParam[i]->BufferSz == sizeof(mfxExtCpuDecodeAnalytics),
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                mfxExtCpuDecodeAnalytics *analytics =
+                    reinterpret_cast<mfxExtCpuDecodeAnalytics *>(ppExtParam[i]);
+                RET_IF_FALSE(IsCodingOption(analytics->MotionVectors) &&
+                                 IsCodingOption(analytics->QP),
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                break;
+            }
+            case MFX_EXTBUFF_CPU_DECODE_AV1: {
+                RET_IF_FALSE(ppExtParam[i]->BufferSz == sizeof(mfxExtCpuDecodeAV1),
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                mfxExtCpuDecodeAV1 *av1 = reinterpret_cast<mfxExtCpuDecodeAV1 *>(ppExtParam[i]);
+                // dav1d's DAV1D_MAX_TILE_THREADS and DAV1D_MAX_FRAME_THREADS
+                RET_IF_FALSE(av1->TileThreads <= 64 && av1->MaxFrameDelay <= 256,
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                RET_IF_FALSE(av1->FilmGrain <= MFX_CPU_DECODE_AV1_FILM_GRAIN_EXPORT,
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                break;
+            }
+            case MFX_EXTBUFF_CPU_DECODE_THREADING: {
+                RET_IF_FALSE(ppExtParam[i]->BufferSz == sizeof(mfxExtCpuDecodeThreading),
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                mfxExtCpuDecodeThreading *threading =
+                    reinterpret_cast<mfxExtCpuDecodeThreading *>(ppExtParam[i]);
+                RET_IF_FALSE(!(threading->Mode & ~(MFX_CPU_DECODE_THREADING_FRAME |
+                                                   MFX_CPU_DECODE_THREADING_SLICE |
+                                                   MFX_CPU_DECODE_THREADING_GOP)),
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                break;
+            }
+            default:
+                return MFX_ERR_INVALID_VIDEO_PARAM;
+        }
+    }
+
+    return MFX_ERR_NONE;
+}
+
+// copy of the buffer with the given id, zeroed if par has none
+static void KeepExtBuffer(mfxVideoParam *par, mfxExtBuffer *kept, mfxU32 id, size_t size) {
+    mfxExtBuffer *buf = GetExtBuffer(par->ExtParam, par->NumExtParam, id);
+    if (buf)
+        memcpy_s(kept, size, buf, size);
+    else
+        memset(kept, 0, size);
+}
+
+// true if par has the buffer kept at Init with the same values, or neither has one
+static bool IsSameExtBuffer(mfxVideoParam *par,
+                            const mfxExtBuffer *kept,
+                            mfxU32 id,
+                            size_t size) {
+    mfxExtBuffer *buf = GetExtBuffer(par->ExtParam, par->NumExtParam, id);
+    if (!buf)
+        return kept->BufferId == 0;
+
+    return kept->BufferId == id && memcmp(buf, kept, size) == 0;
+}
+
 //InitDecode can operate in two modes:
 // With no bitstream: assumes header decoded elsewhere, validates params given
 // With bitstream
-//  1. Attempts to decode a frame
+//  1. Parses the stream headers, no decoder is opened
 //  2. Gets parameters
 mfxStatus CpuDecode::InitDecode(mfxVideoParam *par, mfxBitstream *bs) {
     AVCodecID cid = MFXCodecId_to_AVCodecID(par->mfx.CodecId);
@@ -212,6 +378,11 @@ mfxStatus CpuDecode::InitDecode(mfxVideoParam *par, mfxBitstream *bs) {
     if (!bs) {
         valSts = ValidateDecodeParams(par, false);
         RET_ERROR(valSts);
+
+        // header probing (bs != null) allocates nothing worth budgeting
+        RET_ERROR(m_memory.Reserve(par, GetDecodeMemoryEstimate(par)));
+
+        m_payloads.Init(MAX_PAYLOADS, MAX_PAYLOAD_SIZE);
     }
 
     m_avDecCodec = avcodec_find_decoder(cid);
@@ -229,20 +400,78 @@ mfxStatus CpuDecode::InitDecode(mfxVideoParam *par, mfxBitstream *bs) {
         return MFX_ERR_INVALID_VIDEO_PARAM;
     }
 
+    if (bs) {
+        m_param = *par;
+        RET_ERROR(ProbeHeader(bs));
+        GetVideoParam(par);
+        return MFX_ERR_NONE;
+    }
+
 #ifdef ENABLE_LIBAV_AUTO_THREADS
     m_avDecContext->thread_count = 0;
 #endif
 
-    if (!bs) {
-        if (m_avDecCodec->id == AV_CODEC_ID_AV1) {
-            if (par->mfx.FilmGrain == 0) { // disable film-grain denoise
-                int ret = av_opt_set_int(m_avDecContext->priv_data,
-                                         "filmgrain",
-                                         par->mfx.FilmGrain,
-                                         AV_OPT_SEARCH_CHILDREN);
-                if (ret != 0)
-                    return MFX_ERR_INVALID_VIDEO_PARAM;
-            }
+    mfxExtCpuDecodeThreading *threading = reinterpret_cast<mfxExtCpuDecodeThreading *>(
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_DECODE_THREADING));
+    if (threading) {
+        // GOP threading runs on separate contexts, see below
+        if (threading->Mode & (MFX_CPU_DECODE_THREADING_FRAME | MFX_CPU_DECODE_THREADING_SLICE)) {
+            m_avDecContext->thread_type = 0;
+            if (threading->Mode & MFX_CPU_DECODE_THREADING_FRAME)
+                m_avDecContext->thread_type |= FF_THREAD_FRAME;
+            if (threading->Mode & MFX_CPU_DECODE_THREADING_SLICE)
+                m_avDecContext->thread_type |= FF_THREAD_SLICE;
+
+            // asking for a threading mode implies more than one thread
+            m_avDecContext->thread_count = 0;
+        }
+        if (threading->NumThreads)
+            m_avDecContext->thread_count = threading->NumThreads;
+    }
+
+    // low delay: frames leave in decode order as soon as they are decoded,
+    // so no reorder buffering and no frame threading
+    // send MFX_BITSTREAM_COMPLETE_FRAME input to also skip the parser's one frame lookahead
+    if (par->mfx.DecodedOrder) {
+        m_avDecContext->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        m_avDecContext->thread_type = FF_THREAD_SLICE;
+    }
+
+    if (m_avDecCodec->id == AV_CODEC_ID_AV1)
+        RET_ERROR(SetAV1Options(par));
+
+    SetErrorRecovery(par);
+
+    // libavcodec attaches the tables to each frame, the output surface converts them when
+    // the app asks
+    mfxExtCpuDecodeAnalytics *analytics = reinterpret_cast<mfxExtCpuDecodeAnalytics *>(
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_DECODE_ANALYTICS));
+    if (analytics && analytics->MotionVectors == MFX_CODINGOPTION_ON)
+        m_avDecContext->export_side_data |= AV_CODEC_EXPORT_DATA_MVS;
+    if (analytics && analytics->QP == MFX_CODINGOPTION_ON)
+        m_avDecContext->export_side_data |= AV_CODEC_EXPORT_DATA_VIDEO_ENC_PARAMS;
+
+    mfxExtCpuDecodeThumbnail *thumbnail = reinterpret_cast<mfxExtCpuDecodeThumbnail *>(
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_DECODE_THUMBNAIL));
+    if (thumbnail) {
+        m_thumbnail       = *thumbnail;
+        m_avDecFrameThumb = av_frame_alloc();
+        RET_IF_FALSE(m_avDecFrameThumb, MFX_ERR_MEMORY_ALLOC);
+        m_avDecContext->skip_frame = GetSkipFrame();
+
+        // mjpeg can decode at 1/2, 1/4 or 1/8 size with a reduced IDCT, the scale pass
+        // then starts from the smallest of those still as large as the thumbnail
+        if (m_avDecCodec->id == AV_CODEC_ID_MJPEG) {
+            int width  = par->mfx.FrameInfo.CropW ? par->mfx.FrameInfo.CropW
+                                                  : par->mfx.FrameInfo.Width;
+            int height = par->mfx.FrameInfo.CropH ? par->mfx.FrameInfo.CropH
+                                                  : par->mfx.FrameInfo.Height;
+            int lowres = 0;
+            while (lowres < m_avDecCodec->max_lowres &&
+                   AV_CEIL_RSHIFT(width, lowres + 1) >= thumbnail->Width &&
+                   AV_CEIL_RSHIFT(height, lowres + 1) >= thumbnail->Height)
+                lowres++;
+            m_avDecContext->lowres = lowres;
         }
     }
 
@@ -250,6 +479,16 @@ mfxStatus CpuDecode::InitDecode(mfxVideoParam *par, mfxBitstream *bs) {
         return MFX_ERR_INVALID_VIDEO_PARAM;
     }
 
+    // mjpeg has no frame threading, its independent frames are spread over several
+    // decoder contexts instead, and so are AVC/HEVC segments starting at IDR frames
+    int numContexts = GetParallelDecodeContexts(par);
+    if (numContexts > 1) {
+        int maxFrames = (par->mfx.CodecId == MFX_CODEC_JPEG) ? 1 : GOP_DECODE_MAX_FRAMES;
+        m_parallelDecode.reset(new CpuParallelDecode());
+        RET_IF_FALSE(m_parallelDecode, MFX_ERR_MEMORY_ALLOC);
+        RET_ERROR(m_parallelDecode->Init(m_avDecContext, numContexts, maxFrames));
+    }
+
     m_avDecPacket = av_packet_alloc();
     if (!m_avDecPacket) {
         return MFX_ERR_MEMORY_ALLOC;
@@ -260,27 +499,335 @@ mfxStatus CpuDecode::InitDecode(mfxVideoParam *par, mfxBitstream *bs) {
         return MFX_ERR_MEMORY_ALLOC;
     }
 
-    m_param = *par;
-
-    if (bs) {
-        // create copy to not modify caller's mfxBitstream
-        // todo: this only works if input is large enough to
-        // decode a frame
-        mfxBitstream bs2 = *bs;
-        bs2.DataFlag |= MFX_BITSTREAM_EOS;
-        m_bStreamInfo = true;
-        DecodeFrame(&bs2, nullptr, nullptr);
-        GetVideoParam(par);
+    if (m_avDecCodec->id == AV_CODEC_ID_MJPEG) {
+        m_avDecFrameJPEG = av_frame_alloc();
+        if (!m_avDecFrameJPEG) {
+            return MFX_ERR_MEMORY_ALLOC;
+        }
     }
 
+    KeepExtBuffer(par,
+                  &m_initThreading.Header,
+                  MFX_EXTBUFF_CPU_DECODE_THREADING,
+                  sizeof(m_initThreading));
+    KeepExtBuffer(par, &m_initAV1.Header, MFX_EXTBUFF_CPU_DECODE_AV1, sizeof(m_initAV1));
+    KeepExtBuffer(par,
+                  &m_initAnalytics.Header,
+                  MFX_EXTBUFF_CPU_DECODE_ANALYTICS,
+                  sizeof(m_initAnalytics));
+
+    // the app's buffers may be gone after Init
+    m_param             = *par;
+    m_param.ExtParam    = nullptr;
+    m_param.NumExtParam = 0;
+
     return valSts;
 }
 
+// drops buffered frames and parser state, e.g. for a seek, the configuration is kept
+// frames referenced by the codec are released, so pool surfaces return once the app
+// releases its own references
+// skipToKeyFrame: output restarts at the next random access point, frames that would
+// be decoded from missing references are not decoded at all
+mfxStatus CpuDecode::FlushDecode(bool skipToKeyFrame) {
+    avcodec_flush_buffers(m_avDecContext);
+    if (m_parallelDecode)
+        m_parallelDecode->Flush();
+
+    // parsers have no flush, a new one drops any partial frame
+    av_parser_close(m_avDecParser);
+    m_avDecParser = av_parser_init(m_avDecCodec->id);
+    RET_IF_FALSE(m_avDecParser, MFX_ERR_MEMORY_ALLOC);
+
+    av_frame_unref(m_avDecFrameOut);
+    if (m_avDecFrameJPEG)
+        av_frame_unref(m_avDecFrameJPEG);
+    if (m_avDecFrameThumb)
+        av_frame_unref(m_avDecFrameThumb);
+    m_bFrameBuffered = false;
+
+    std::vector<mfxU8>().swap(m_pendingInput);
+    m_pendingPos = 0;
+
+    // the thumbnail interval restarts after a seek, the count goes on
+    m_thumbLastPts = AV_NOPTS_VALUE;
+
+    m_bRecovering              = false;
+    m_bSkipToKeyFrame          = skipToKeyFrame;
+    m_avDecContext->skip_frame = GetSkipFrame();
+
+    return MFX_ERR_NONE;
+}
+
+// settings applied before avcodec_open2() need a new context, anything else is reset in place
+bool CpuDecode::CanResetInPlace(mfxVideoParam *par) {
+    if (par->mfx.CodecId != m_param.mfx.CodecId ||
+        par->mfx.DecodedOrder != m_param.mfx.DecodedOrder)
+        return false;
+
+    if (par->mfx.CodecId == MFX_CODEC_AV1 && par->mfx.FilmGrain != m_param.mfx.FilmGrain)
+        return false;
+
+    // thread mode, parallel contexts, dav1d options and side data export
+    if (!IsSameExtBuffer(par,
+                         &m_initThreading.Header,
+                         MFX_EXTBUFF_CPU_DECODE_THREADING,
+                         sizeof(m_initThreading)) ||
+        !IsSameExtBuffer(par, &m_initAV1.Header, MFX_EXTBUFF_CPU_DECODE_AV1, sizeof(m_initAV1)) ||
+        !IsSameExtBuffer(par,
+                         &m_initAnalytics.Header,
+                         MFX_EXTBUFF_CPU_DECODE_ANALYTICS,
+                         sizeof(m_initAnalytics)))
+        return false;
+
+    if (m_avDecFrameThumb ||
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_DECODE_THUMBNAIL))
+        return false;
+
+    return true;
+}
+
+// same result as Close/Init for a compatible stream, but the codec context and the
+// surface pool are kept, surfaces still held by the app stay valid
+mfxStatus CpuDecode::ResetDecode(mfxVideoParam *par) {
+    RET_ERROR(ValidateDecodeParams(par, false));
+
+    // the new stream may need more frame memory than the one reserved at Init
+    RET_ERROR(m_memory.Reserve(par, GetDecodeMemoryEstimate(par)));
+
+    RET_ERROR(FlushDecode(false));
+
+    m_frameOrder = 0;
+    SetSkipMode(MFX_SKIPMODE_NOSKIP);
+    SetErrorRecovery(par);
+    m_payloads.Init(MAX_PAYLOADS, MAX_PAYLOAD_SIZE);
+
+    m_statNumFrame        = 0;
+    m_statNumCorrupted    = 0;
+    m_statNumError        = 0;
+    m_statNumDropped      = 0;
+    m_statNumBadFrames    = 0;
+    m_statMaxDecodeTimeUs = 0;
+    m_statBytesConsumed   = 0;
+    m_statParserCalls     = 0;
+    m_statDecodeTimeUs    = 0;
+    m_statBytesCopied     = 0;
+
+    m_param             = *par;
+    m_param.ExtParam    = nullptr;
+    m_param.NumExtParam = 0;
+
+    return MFX_ERR_NONE;
+}
+
+// reads the jpeg frame header (SOFn) that precedes the first scan
+static bool ParseJPEGFrameHeader(const mfxU8 *data, int size, AVCodecContext *ctx) {
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+        return false;
+
+    int pos = 2;
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xFF)
+            return false;
+
+        int marker = data[pos + 1];
+        if (marker == 0xFF) { // fill byte
+            pos++;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) { // no length field
+            pos += 2;
+            continue;
+        }
+        if (marker == 0xDA) // scan data without a frame header
+            return false;
+
+        int length = (data[pos + 2] << 8) | data[pos + 3];
+        if (length < 2 || pos + 2 + length > size)
+            return false;
+
+        // SOF0-SOF15, except DHT, JPG and DAC which share the range
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 &&
+            marker != 0xCC) {
+            const mfxU8 *sof = data + pos + 4;
+            int components   = (length >= 8) ? sof[5] : 0;
+            if (!components || length < 8 + 3 * components)
+                return false;
+
+            ctx->height = (sof[1] << 8) | sof[2];
+            ctx->width  = (sof[3] << 8) | sof[4];
+            if (!ctx->width || !ctx->height) // height deferred to a DNL marker
+                return false;
+
+            // only the layout matters here, the decoder output is converted from it
+            ctx->pix_fmt = AV_PIX_FMT_NONE;
+            if (sof[0] == 8 && components == 1) {
+                ctx->pix_fmt = AV_PIX_FMT_GRAY8;
+            }
+            else if (sof[0] == 8 && components == 3) {
+                mfxU8 lumaHV   = sof[7];
+                mfxU8 chromaHV = sof[10];
+                if (lumaHV == chromaHV)
+                    ctx->pix_fmt = AV_PIX_FMT_YUVJ444P;
+                else if (lumaHV == 0x21 && chromaHV == 0x11 && sof[13] == 0x11)
+                    ctx->pix_fmt = AV_PIX_FMT_YUVJ422P;
+                else
+                    ctx->pix_fmt = AV_PIX_FMT_YUVJ420P;
+            }
+
+            // FF_PROFILE_MJPEG_* are the marker values
+            ctx->profile = (marker <= 0xC3) ? marker : FF_PROFILE_UNKNOWN;
+            return true;
+        }
+
+        pos += 2 + length;
+    }
+
+    return false;
+}
+
+// AVC/HEVC: position of the first start code of a VPS/SPS, which a stream has to be
+// decoded from. Without one, the last bytes are kept in case a start code is cut off.
+// Other codecs: 0.
+mfxU32 CpuDecode::FindHeaderStart(mfxU32 codecId, const mfxU8 *data, mfxU32 size) {
+    if (codecId != MFX_CODEC_AVC && codecId != MFX_CODEC_HEVC)
+        return 0;
+
+    bool isHEVC = (codecId == MFX_CODEC_HEVC);
+    for (mfxU32 pos = 0; pos + 3 < size; pos++) {
+        if (data[pos] != 0 || data[pos + 1] != 0 || data[pos + 2] != 1)
+            continue;
+
+        int type = isHEVC ? (data[pos + 3] >> 1) & 0x3F : data[pos + 3] & 0x1F;
+        if (isHEVC ? (type == 32 || type == 33) : (type == 7)) {
+            // a zero byte before is part of a 4 byte start code
+            return (pos > 0 && data[pos - 1] == 0) ? pos - 1 : pos;
+        }
+    }
+
+    return (size > 3) ? size - 3 : 0;
+}
+
+// takes over the data, to be decoded before the next input
+void CpuDecode::SetPendingInput(std::vector<mfxU8> &data) {
+    m_pendingInput.swap(data);
+    m_pendingPos = 0;
+}
+
+// header-only probe, the codec parsers fill the context from SPS/PPS/VPS or the AV1
+// sequence header without a decoder being opened
+// bs is not modified, MFX_ERR_MORE_DATA if it holds no complete header
+mfxStatus CpuDecode::ProbeHeader(mfxBitstream *bs) {
+    const mfxU8 *data = bs->Data + bs->DataOffset;
+    int size          = (int)bs->DataLength;
+
+    if (m_avDecCodec->id == AV_CODEC_ID_MJPEG) {
+        RET_IF_FALSE(ParseJPEGFrameHeader(data, size, m_avDecContext), MFX_ERR_MORE_DATA);
+        return MFX_ERR_NONE;
+    }
+
+    // input taken as one frame, so headers are parsed up to the first slice right away
+    // instead of after the start of the next frame is found
+    m_avDecParser->flags |= PARSER_FLAG_COMPLETE_FRAMES;
+
+    uint8_t *outData = nullptr;
+    int outSize      = 0;
+    av_parser_parse2(m_avDecParser,
+                     m_avDecContext,
+                     &outData,
+                     &outSize,
+                     data,
+                     size,
+                     AV_NOPTS_VALUE,
+                     AV_NOPTS_VALUE,
+                     0);
+
+    RET_IF_FALSE(m_avDecParser->width > 0 && m_avDecParser->height > 0, MFX_ERR_MORE_DATA);
+
+    // profile, level and frame rate were set on the context by the parser
+    m_avDecContext->width   = m_avDecParser->width;
+    m_avDecContext->height  = m_avDecParser->height;
+    m_avDecContext->pix_fmt = (AVPixelFormat)m_avDecParser->format;
+
+    return MFX_ERR_NONE;
+}
+
+// decoder contexts for parallel mjpeg or GOP decode, 0 if not used
+int CpuDecode::GetParallelDecodeContexts(mfxVideoParam *par) {
+    if (par->mfx.DecodedOrder)
+        return 0;
+
+    mfxExtCpuDecodeThreading *threading = reinterpret_cast<mfxExtCpuDecodeThreading *>(
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_DECODE_THREADING));
+    if (!threading)
+        return 0;
+
+    switch (par->mfx.CodecId) {
+        case MFX_CODEC_JPEG:
+            if (!(threading->Mode & MFX_CPU_DECODE_THREADING_FRAME))
+                return 0;
+            break;
+        case MFX_CODEC_AVC:
+        case MFX_CODEC_HEVC:
+            if (!(threading->Mode & MFX_CPU_DECODE_THREADING_GOP))
+                return 0;
+            break;
+        default:
+            return 0;
+    }
+
+    return threading->NumThreads ? threading->NumThreads : av_cpu_count();
+}
+
+// worst case frame memory: codec references, the surface pool and frames in flight
+mfxU64 CpuDecode::GetDecodeMemoryEstimate(mfxVideoParam *par) {
+    mfxU32 numRefFrames = 0;
+    switch (par->mfx.CodecId) {
+        case MFX_CODEC_AVC:
+        case MFX_CODEC_HEVC:
+            numRefFrames = 16 + 1;
+            break;
+        case MFX_CODEC_AV1:
+            numRefFrames = 8 + 1;
+            break;
+        default:
+            numRefFrames = 1;
+            break;
+    }
+
+    mfxFrameAllocRequest request = {};
+    DecodeQueryIOSurf(nullptr, &request);
+    mfxU32 numFrames =
+        numRefFrames + request.NumFrameSuggested + std::max<mfxU32>(par->AsyncDepth, 1);
+
+    // every parallel context has its own references and frames decoded ahead
+    mfxU32 numContexts = GetParallelDecodeContexts(par);
+    if (par->mfx.CodecId == MFX_CODEC_JPEG)
+        numFrames += numContexts;
+    else
+        numFrames += numContexts * (numRefFrames + GOP_DECODE_MAX_FRAMES);
+
+    return GetFrameSizeBytes(&par->mfx.FrameInfo) * numFrames;
+}
+
 CpuDecode::~CpuDecode() {
     if (m_swsContext) {
         sws_freeContext(m_swsContext);
     }
 
+    if (m_avDecFrameThumb) {
+        av_frame_free(&m_avDecFrameThumb);
+    }
+
+    if (m_avDecFrameJPEG) {
+        av_frame_free(&m_avDecFrameJPEG);
+    }
+
+    // outstanding pool buffers stay valid, pool is freed with the last one
+    if (m_jpegPool) {
+        av_buffer_pool_uninit(&m_jpegPool);
+    }
+
     if (m_avDecFrameOut) {
         av_frame_free(&m_avDecFrameOut);
         m_avDecFrameOut = nullptr;
@@ -291,6 +838,11 @@ CpuDecode::~CpuDecode() {
         m_avDecParser = nullptr;
     }
 
+    if (m_avKeyParser) {
+        av_parser_close(m_avKeyParser);
+        m_avKeyParser = nullptr;
+    }
+
     if (m_avDecPacket) {
         av_packet_free(&m_avDecPacket);
         m_avDecPacket = nullptr;
@@ -303,10 +855,157 @@ CpuDecode::~CpuDecode() {
     }
 }
 
+// the app owns bitstream memory, there is nothing to free when the last reference goes
+static void NoFreeBuffer(void *opaque, uint8_t *data) {}
+
+// complete frames in the app's own memory, not from MFXBitstream_GetBuffer(), can be
+// handed to the decoder by reference when
+//  - no reference can outlive DecodeFrameAsync(), as the app may then reuse the buffer.
+//    The native AVC and HEVC decoders implement decode(), libavcodec unrefs a video packet
+//    as soon as that returns. mjpeg implements receive_frame() and keeps its last packet
+//    until the next call, frame threads and libdav1d hold packets across calls as well.
+//  - the app buffer already holds the zeroed padding libavcodec may read past the end,
+//    it is checked, not written, bytes after the data can be the app's next frame
+bool CpuDecode::CanWrapBitstream(mfxBitstream *bs) {
+    if ((m_avDecContext->active_thread_type & FF_THREAD_FRAME) || m_parallelDecode)
+        return false;
+
+    switch (m_avDecCodec->id) {
+        case AV_CODEC_ID_H264:
+        case AV_CODEC_ID_HEVC:
+            break;
+        default:
+            return false;
+    }
+
+    if ((mfxU64)bs->DataOffset + bs->DataLength + AV_INPUT_BUFFER_PADDING_SIZE > bs->MaxLength)
+        return false;
+
+    const mfxU8 *padding = bs->Data + bs->DataOffset + bs->DataLength;
+    for (int i = 0; i < AV_INPUT_BUFFER_PADDING_SIZE; i++) {
+        if (padding[i])
+            return false;
+    }
+
+    return true;
+}
+
+// mjpeg with frame threading goes to the parallel decoder instead of the codec context
+int CpuDecode::SendPacket(const AVPacket *pkt) {
+    if (m_parallelDecode)
+        return m_parallelDecode->SendPacket(pkt, m_avDecContext);
+
+    return avcodec_send_packet(m_avDecContext, pkt);
+}
+
+int CpuDecode::ReceiveFrame(AVFrame *frame) {
+    if (m_parallelDecode)
+        return m_parallelDecode->ReceiveFrame(frame, m_avDecContext);
+
+    return avcodec_receive_frame(m_avDecContext, frame);
+}
+
 // bs == 0 is a signal to drain
+// counters are relaxed atomics, there is one writer and readers only need a snapshot
 mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
                                  mfxFrameSurface1 *surface_work,
                                  mfxFrameSurface1 **surface_out) {
+    auto start        = std::chrono::steady_clock::now();
+    mfxU32 dataLength = bs ? bs->DataLength : 0;
+
+    // data kept by the lazy init goes first, bs is left alone until it is used up
+    mfxStatus sts    = MFX_ERR_MORE_DATA;
+    bool usedPending = false;
+    if (m_pendingPos < m_pendingInput.size()) {
+        usedPending          = true;
+        mfxBitstream pending = {};
+        pending.Data         = m_pendingInput.data();
+        pending.MaxLength    = (mfxU32)m_pendingInput.size();
+        pending.DataOffset   = (mfxU32)m_pendingPos;
+        pending.DataLength   = pending.MaxLength - pending.DataOffset;
+
+        sts = DecodeAndOutputFrame(&pending, surface_work, surface_out);
+        m_statBytesConsumed.fetch_add(pending.DataOffset - m_pendingPos,
+                                      std::memory_order_relaxed);
+        m_pendingPos = pending.DataOffset;
+
+        if (m_pendingPos == m_pendingInput.size()) {
+            std::vector<mfxU8>().swap(m_pendingInput);
+            m_pendingPos = 0;
+        }
+    }
+    // an empty bs, e.g. the one the lazy init took, would flush the parser's partial frame
+    if (sts == MFX_ERR_MORE_DATA && !(usedPending && bs && !bs->DataLength)) {
+        if (bs && (bs->DataFlag & MFX_CPU_BITSTREAM_RING))
+            sts = DecodeRing(bs, surface_work, surface_out);
+        else
+            sts = DecodeAndOutputFrame(bs, surface_work, surface_out);
+    }
+
+    mfxU64 elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    m_statDecodeTimeUs.fetch_add(elapsed, std::memory_order_relaxed);
+    if (bs)
+        m_statBytesConsumed.fetch_add(dataLength - bs->DataLength, std::memory_order_relaxed);
+
+    // calls that return no frame (more data, drain, failure) can still be the slow ones
+    if (elapsed > m_statMaxDecodeTimeUs.load(std::memory_order_relaxed))
+        m_statMaxDecodeTimeUs.store((mfxU32)std::min<mfxU64>(elapsed, 0xFFFFFFFF),
+                                    std::memory_order_relaxed);
+
+    bool failed = sts < MFX_ERR_NONE && sts != MFX_ERR_MORE_DATA && sts != MFX_ERR_MORE_SURFACE;
+    bool corrupted = false;
+    if (failed)
+        m_statNumError.fetch_add(1, std::memory_order_relaxed);
+
+    if (sts == MFX_ERR_NONE && surface_out && *surface_out) {
+        m_statNumFrame.fetch_add(1, std::memory_order_relaxed);
+        corrupted = ((*surface_out)->Data.Corrupted != 0);
+        if (corrupted)
+            m_statNumCorrupted.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (failed || corrupted)
+        m_statNumBadFrames.fetch_add(1, std::memory_order_relaxed);
+
+    return sts;
+}
+
+// the data up to the end of the ring goes to the parser first, then the wrapped part,
+// the parser carries a frame split by the wrap over
+mfxStatus CpuDecode::DecodeRing(mfxBitstream *bs,
+                                mfxFrameSurface1 *surface_work,
+                                mfxFrameSurface1 **surface_out) {
+    RET_IF_FALSE(bs->DataOffset < bs->MaxLength && bs->DataLength <= bs->MaxLength,
+                 MFX_ERR_UNDEFINED_BEHAVIOR);
+
+    // an empty segment would flush the parser
+    mfxStatus sts = MFX_ERR_MORE_DATA;
+    while (sts == MFX_ERR_MORE_DATA && bs->DataLength) {
+        mfxBitstream segment = *bs;
+        segment.DataLength   = std::min(bs->DataLength, bs->MaxLength - bs->DataOffset);
+        segment.MaxLength    = bs->DataOffset + segment.DataLength;
+
+        // frames may be split by the wrap, so never complete ones
+        segment.DataFlag &= ~(MFX_CPU_BITSTREAM_RING | MFX_BITSTREAM_COMPLETE_FRAME);
+
+        mfxU32 length = segment.DataLength;
+        sts           = DecodeAndOutputFrame(&segment, surface_work, surface_out);
+
+        mfxU32 consumed = length - segment.DataLength;
+        bs->DataOffset  = (bs->DataOffset + consumed) % bs->MaxLength;
+        bs->DataLength  = bs->DataLength - consumed;
+        if (!consumed)
+            break;
+    }
+
+    return sts;
+}
+
+mfxStatus CpuDecode::DecodeAndOutputFrame(mfxBitstream *bs,
+                                          mfxFrameSurface1 *surface_work,
+                                          mfxFrameSurface1 **surface_out) {
     if (m_bFrameBuffered) {
         if (surface_work && surface_out) {
             RET_ERROR(AVFrame2mfxFrameSurface(surface_work,
@@ -323,6 +1022,14 @@ mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
         }
     }
 
+    // all thumbnails returned, the rest of the stream is not needed: input is left alone
+    // and there is no output, the end of stream is reported when the app drains
+    if (m_thumbnail.MaxCount && m_thumbCount >= m_thumbnail.MaxCount) {
+        if (surface_out)
+            *surface_out = nullptr;
+        return bs ? MFX_ERR_NONE : MFX_ERR_MORE_DATA;
+    }
+
     // Try get AVFrame from surface_work
     AVFrame *avframe    = nullptr;
     CpuFrame *cpu_frame = CpuFrame::TryCast(surface_work);
@@ -345,6 +1052,21 @@ mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
             m_avDecPacket->data = bs->Data + bs->DataOffset;
             m_avDecPacket->size = bs->DataLength;
             bytes_parsed        = bs->DataLength;
+
+            // a packet without a buffer reference is copied by avcodec_send_packet(),
+            // runtime buffers are referenced whatever the codec and threading
+            if (m_avDecPacket->size) {
+                m_avDecPacket->buf =
+                    CpuBitstreamBuffers::RefFrame(m_avDecPacket->data, m_avDecPacket->size);
+                if (!m_avDecPacket->buf && CanWrapBitstream(bs)) {
+                    m_avDecPacket->buf = av_buffer_create(m_avDecPacket->data,
+                                                          m_avDecPacket->size,
+                                                          NoFreeBuffer,
+                                                          nullptr,
+                                                          0);
+                }
+            }
+
             bs->DataOffset += bytes_parsed;
             bs->DataLength -= bytes_parsed;
         }
@@ -352,6 +1074,7 @@ mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
             // parse
             auto data_ptr = bs ? (bs->Data + bs->DataOffset) : nullptr;
             int data_size = bs ? bs->DataLength : 0;
+            m_statParserCalls.fetch_add(1, std::memory_order_relaxed);
             bytes_parsed += av_parser_parse2(m_avDecParser,
                                              m_avDecContext,
                                              &m_avDecPacket->data,
@@ -368,12 +1091,48 @@ mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
             }
         }
 
+        // recovering from corruption: what is not a key frame is not worth decoding,
+        // a key frame ends the skip
+        bool dropPacket = false;
+        if (m_avDecPacket->size && m_bRecovering) {
+            switch (GetPacketKeyFrame(complete_frame_mode)) {
+                case 0:
+                    dropPacket = true;
+                    m_statNumDropped.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                case 1:
+                    m_bRecovering              = false;
+                    m_bSkipToKeyFrame          = false;
+                    m_avDecContext->skip_frame = GetSkipFrame();
+                    break;
+                default:
+                    // unknown, the decoder skips non key frames and the output loop
+                    // below drops what is left
+                    break;
+            }
+        }
+        if (dropPacket) {
+            av_buffer_unref(&m_avDecPacket->buf);
+            m_avDecPacket->size = 0;
+        }
+
         // send packet
         if (m_avDecPacket->size) {
             if (bs && bs->TimeStamp)
                 m_avDecPacket->pts = bs->TimeStamp;
 
-            auto av_ret = avcodec_send_packet(m_avDecContext, m_avDecPacket);
+            if (!m_avDecPacket->buf)
+                m_statBytesCopied.fetch_add(m_avDecPacket->size, std::memory_order_relaxed);
+
+            auto av_ret = SendPacket(m_avDecPacket);
+            av_buffer_unref(&m_avDecPacket->buf);
+
+            if (av_ret == AVERROR_INVALIDDATA &&
+                m_errorRecovery == MFX_CPU_DECODE_ERROR_SKIP_TO_RAP) {
+                m_statNumDropped.fetch_add(1, std::memory_order_relaxed);
+                StartErrorRecovery();
+                av_ret = 0;
+            }
 
             if (av_ret == AVERROR_INVALIDDATA) {
                 // corrupted stream - set Corrupted flag in mfxFrameData and return
@@ -391,23 +1150,59 @@ mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
 
         if (!bs) {
             // null bitstream indicates drain, send EOF packet
-            avcodec_send_packet(m_avDecContext, nullptr);
+            SendPacket(nullptr);
         }
 
-        // receive frame
-        auto av_ret = avcodec_receive_frame(m_avDecContext, avframe);
-        if (av_ret == 0) {
-            // in case mjpeg, convert yuvj420p -> yuv420p
-            if (m_avDecContext->codec_id == AV_CODEC_ID_MJPEG) {
-                if (m_avDecContext->pix_fmt != AV_PIX_FMT_YUV420P) {
-                    avframe = ConvertJPEGOutputColorSpace(avframe, AV_PIX_FMT_YUV420P);
-                    if (avframe == nullptr)
-                        return MFX_ERR_ABORTED;
-                }
+        // receive frame, mjpeg goes through a private frame for colour conversion and
+        // thumbnails through one for scaling
+        AVFrame *decframe = m_avDecFrameJPEG ? m_avDecFrameJPEG : avframe;
+        if (m_avDecFrameThumb)
+            decframe = m_avDecFrameThumb;
+        auto av_ret = ReceiveFrame(decframe);
+
+        // not every decoder honours skip_frame, drop leftovers before the random access point
+        // error recovery also drops frames the decoder reports as damaged and skips on
+        for (; av_ret == 0; av_ret = ReceiveFrame(decframe)) {
+            bool damaged = (decframe->decode_error_flags ||
+                            (decframe->flags & AV_FRAME_FLAG_CORRUPT));
+            if (damaged && m_errorRecovery == MFX_CPU_DECODE_ERROR_SKIP_TO_RAP)
+                StartErrorRecovery();
+            else if (!m_bSkipToKeyFrame || decframe->key_frame)
+                break;
+
+            if (m_bRecovering)
+                m_statNumDropped.fetch_add(1, std::memory_order_relaxed);
+            av_frame_unref(decframe);
+        }
+        if (av_ret == 0 && m_bSkipToKeyFrame) {
+            m_bRecovering              = false;
+            m_bSkipToKeyFrame          = false;
+            m_avDecContext->skip_frame = GetSkipFrame();
+        }
 
+        // same for thumbnails, which also drop key frames within the interval
+        while (av_ret == 0 && m_avDecFrameThumb && !IsThumbnail(decframe)) {
+            av_frame_unref(decframe);
+            av_ret = ReceiveFrame(decframe);
+        }
+
+        if (av_ret == 0) {
+            if (m_avDecFrameThumb) {
+                RET_ERROR(ScaleThumbnail(m_avDecFrameThumb, avframe));
+                m_thumbCount++;
+            }
+            else if (m_avDecFrameJPEG) {
+                RET_ERROR(ConvertJPEGOutput(m_avDecFrameJPEG, avframe));
                 avframe->color_range = AVCOL_RANGE_UNSPECIFIED;
             }
 
+            // dav1d attaches the grain whenever it does not apply it
+            if (!m_bExportFilmGrain)
+                av_frame_remove_side_data(avframe, AV_FRAME_DATA_FILM_GRAIN_PARAMS);
+
+            // same key as the output surface's Data.TimeStamp
+            m_payloads.PushFrame(avframe, (mfxU64)avframe->pts);
+
             if (m_avDecContext->codec_id == AV_CODEC_ID_AV1) {
                 // profile
                 switch (m_avDecContext->profile) {
@@ -463,12 +1258,17 @@ mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
                 }
             }
 
-            if (m_param.mfx.FrameInfo.Width != m_avDecContext->width ||
-                m_param.mfx.FrameInfo.Height != m_avDecContext->height) {
-                m_param.mfx.FrameInfo.Width  = m_avDecContext->width;
-                m_param.mfx.FrameInfo.Height = m_avDecContext->height;
-
-                switch (m_avDecContext->pix_fmt) {
+            // a lowres context reports the reduced size, the stream has the coded size
+            int width  = m_avDecContext->lowres ? m_avDecContext->coded_width
+                                                : m_avDecContext->width;
+            int height = m_avDecContext->lowres ? m_avDecContext->coded_height
+                                                : m_avDecContext->height;
+            if (m_param.mfx.FrameInfo.Width != width || m_param.mfx.FrameInfo.Height != height) {
+                m_param.mfx.FrameInfo.Width  = width;
+                m_param.mfx.FrameInfo.Height = height;
+
+                // output format, which differs from the decoder's for mjpeg
+                switch (avframe->format) {
                     case AV_PIX_FMT_YUV420P10LE:
                         m_param.mfx.FrameInfo.FourCC = MFX_FOURCC_I010;
                         break;
@@ -512,16 +1312,7 @@ mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
                 continue; // we have more input data
             }
             else {
-                if (m_bStreamInfo && bs &&
-                    ((bs->DataFlag & MFX_BITSTREAM_EOS) == MFX_BITSTREAM_EOS)) {
-                    //send a null packet and continue
-                    avcodec_send_packet(m_avDecContext, nullptr);
-                    m_bStreamInfo = false;
-                    continue;
-                }
-                else {
-                    return MFX_ERR_MORE_DATA;
-                }
+                return MFX_ERR_MORE_DATA;
             }
         }
         if (av_ret == AVERROR_EOF) {
@@ -531,43 +1322,153 @@ mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
     }
 }
 
-AVFrame *CpuDecode::ConvertJPEGOutputColorSpace(AVFrame *avframe, AVPixelFormat target_pixfmt) {
-    static int prev_w, prev_h;
-
-    if (!m_swsContext || (prev_w != avframe->width || prev_h != avframe->height)) {
-        if (m_swsContext)
-            sws_freeContext(m_swsContext);
-        m_swsContext = sws_getContext(m_avDecContext->width,
-                                      m_avDecContext->height,
-                                      m_avDecContext->pix_fmt,
-                                      m_avDecContext->width,
-                                      m_avDecContext->height,
-                                      target_pixfmt,
-                                      SWS_BILINEAR,
-                                      NULL,
-                                      NULL,
-                                      NULL);
-        if (!m_swsContext) {
-            return nullptr;
-        }
+// takes the key frames at least the interval apart, m_thumbLastPts is the last one taken
+bool CpuDecode::IsThumbnail(const AVFrame *frame) {
+    if (!frame->key_frame)
+        return false;
+
+    if (frame->pts != AV_NOPTS_VALUE) {
+        if (m_thumbnail.Interval && m_thumbLastPts != AV_NOPTS_VALUE &&
+            frame->pts < m_thumbLastPts + m_thumbnail.Interval)
+            return false;
+        m_thumbLastPts = frame->pts;
     }
 
+    return true;
+}
+
+// scales a decoded key frame straight to the thumbnail size into a pooled I420 frame,
+// area averaging keeps large reductions free of aliasing
+mfxStatus CpuDecode::ScaleThumbnail(AVFrame *src, AVFrame *dst) {
+    av_frame_unref(dst);
+
+    RET_ERROR(GetJPEGOutputBuffer(dst, AV_PIX_FMT_YUV420P, m_thumbnail.Width, m_thumbnail.Height));
+    RET_IF_FALSE(av_frame_copy_props(dst, src) == 0, MFX_ERR_MEMORY_ALLOC);
+    dst->color_range = AVCOL_RANGE_UNSPECIFIED;
+
+    m_swsContext = sws_getCachedContext(m_swsContext,
+                                        src->width,
+                                        src->height,
+                                        (AVPixelFormat)src->format,
+                                        dst->width,
+                                        dst->height,
+                                        AV_PIX_FMT_YUV420P,
+                                        SWS_AREA,
+                                        NULL,
+                                        NULL,
+                                        NULL);
+    RET_IF_FALSE(m_swsContext, MFX_ERR_ABORTED);
+
     int ret = sws_scale(m_swsContext,
-                        avframe->data,
-                        avframe->linesize,
+                        src->data,
+                        src->linesize,
                         0,
-                        avframe->height,
-                        avframe->data,
-                        avframe->linesize);
-    if (ret != avframe->height)
-        return nullptr;
-    else
-        avframe->format = target_pixfmt;
+                        src->height,
+                        dst->data,
+                        dst->linesize);
+    av_frame_unref(src);
+    RET_IF_FALSE(ret == dst->height, MFX_ERR_ABORTED);
 
-    prev_w = avframe->width;
-    prev_h = avframe->height;
+    return MFX_ERR_NONE;
+}
+
+// mjpeg output is I420, or native 4:2:2 when the app asked for I422
+AVPixelFormat CpuDecode::GetJPEGOutputFormat(int decodedFormat) {
+    if (m_param.mfx.FrameInfo.FourCC == MFX_FOURCC_I422 &&
+        (decodedFormat == AV_PIX_FMT_YUVJ422P || decodedFormat == AV_PIX_FMT_YUV422P))
+        return AV_PIX_FMT_YUV422P;
 
-    return avframe;
+    return AV_PIX_FMT_YUV420P;
+}
+
+// planar 8-bit frame from this decoder's buffer pool
+// chroma pitch is half the luma pitch, as apps derive it from Data.Pitch
+mfxStatus CpuDecode::GetJPEGOutputBuffer(AVFrame *avframe,
+                                         AVPixelFormat format,
+                                         int width,
+                                         int height) {
+    int pitch         = FFALIGN(width, 64);
+    int chroma_height = (format == AV_PIX_FMT_YUV422P) ? height : (height + 1) / 2;
+    int size          = pitch * height + pitch * chroma_height;
+
+    if (!m_jpegPool || m_jpegPoolSize != size) {
+        // buffers handed out from the old pool stay valid until released
+        av_buffer_pool_uninit(&m_jpegPool);
+        m_jpegPool = av_buffer_pool_init(size, nullptr);
+        RET_IF_FALSE(m_jpegPool, MFX_ERR_MEMORY_ALLOC);
+        m_jpegPoolSize = size;
+    }
+
+    avframe->buf[0] = av_buffer_pool_get(m_jpegPool);
+    RET_IF_FALSE(avframe->buf[0], MFX_ERR_MEMORY_ALLOC);
+
+    avframe->format      = format;
+    avframe->width       = width;
+    avframe->height      = height;
+    avframe->data[0]     = avframe->buf[0]->data;
+    avframe->data[1]     = avframe->data[0] + pitch * height;
+    avframe->data[2]     = avframe->data[1] + (pitch / 2) * chroma_height;
+    avframe->linesize[0] = pitch;
+    avframe->linesize[1] = pitch / 2;
+    avframe->linesize[2] = pitch / 2;
+
+    return MFX_ERR_NONE;
+}
+
+// mjpeg decodes to full range yuvj formats with any subsampling. When the layout already
+// matches the output format the frame is just relabeled, otherwise it is converted into a
+// pooled frame. Samples keep the full range of the jpeg in both cases.
+mfxStatus CpuDecode::ConvertJPEGOutput(AVFrame *src, AVFrame *dst) {
+    AVPixelFormat dst_fmt = GetJPEGOutputFormat(src->format);
+
+    av_frame_unref(dst);
+
+    if (src->format == dst_fmt ||
+        (src->format == AV_PIX_FMT_YUVJ420P && dst_fmt == AV_PIX_FMT_YUV420P) ||
+        (src->format == AV_PIX_FMT_YUVJ422P && dst_fmt == AV_PIX_FMT_YUV422P)) {
+        av_frame_move_ref(dst, src);
+        dst->format = dst_fmt;
+        return MFX_ERR_NONE;
+    }
+
+    RET_ERROR(GetJPEGOutputBuffer(dst, dst_fmt, src->width, src->height));
+    RET_IF_FALSE(av_frame_copy_props(dst, src) == 0, MFX_ERR_MEMORY_ALLOC);
+
+    if (IsChromaDownsampleSupported(src->format)) {
+        mfxStatus sts = DownsampleFrameTo420(src, dst);
+        av_frame_unref(src);
+        return sts;
+    }
+
+    // uncommon layouts (4:4:0, 4:1:1, gray), cached per decoder instance
+    m_swsContext = sws_getCachedContext(m_swsContext,
+                                        src->width,
+                                        src->height,
+                                        (AVPixelFormat)src->format,
+                                        dst->width,
+                                        dst->height,
+                                        dst_fmt,
+                                        SWS_BILINEAR,
+                                        NULL,
+                                        NULL,
+                                        NULL);
+    RET_IF_FALSE(m_swsContext, MFX_ERR_ABORTED);
+
+    // keep full range like the other paths
+    const int *coefs = sws_getCoefficients(SWS_CS_DEFAULT);
+    sws_setColorspaceDetails(m_swsContext, coefs, 1, coefs, 1, 0, 1 << 16, 1 << 16);
+
+    int ret = sws_scale(m_swsContext,
+                        src->data,
+                        src->linesize,
+                        0,
+                        src->height,
+                        dst->data,
+                        dst->linesize);
+    av_frame_unref(src);
+    RET_IF_FALSE(ret == dst->height, MFX_ERR_ABORTED);
+
+    return MFX_ERR_NONE;
 }
 
 mfxStatus CpuDecode::DecodeQueryIOSurf(mfxVideoParam *par, mfxFrameAllocRequest *request) {
@@ -624,6 +1525,7 @@ mfxStatus CpuDecode::DecodeQuery(mfxVideoParam *in, mfxVideoParam *out) {
         out->mfx.FrameInfo.AspectRatioH   = 1;
         out->mfx.CodecProfile             = 1;
         out->mfx.CodecLevel               = 1;
+        out->mfx.DecodedOrder             = 1;
         out->IOPattern                    = 1;
     }
 
@@ -653,10 +1555,214 @@ mfxStatus CpuDecode::GetDecodeSurface(mfxFrameSurface1 **surface) {
     return sts;
 }
 
+// report the threading libavcodec settled on, known once the codec is open
+void CpuDecode::GetThreadingParam(mfxExtCpuDecodeThreading *threading) {
+    if (m_parallelDecode) {
+        threading->Mode          = (m_avDecCodec->id == AV_CODEC_ID_MJPEG)
+                                       ? MFX_CPU_DECODE_THREADING_FRAME
+                                       : MFX_CPU_DECODE_THREADING_GOP;
+        threading->NumThreads    = (mfxU16)m_parallelDecode->GetNumContexts();
+        threading->LatencyFrames = (mfxU16)m_parallelDecode->GetMaxLatency();
+        return;
+    }
+
+    threading->Mode = MFX_CPU_DECODE_THREADING_DEFAULT;
+    if (m_avDecContext->active_thread_type & FF_THREAD_FRAME)
+        threading->Mode |= MFX_CPU_DECODE_THREADING_FRAME;
+    if (m_avDecContext->active_thread_type & FF_THREAD_SLICE)
+        threading->Mode |= MFX_CPU_DECODE_THREADING_SLICE;
+
+    threading->NumThreads = (mfxU16)std::max(m_avDecContext->thread_count, 1);
+
+    // each extra frame thread holds back one more frame before output starts
+    threading->LatencyFrames = (threading->Mode & MFX_CPU_DECODE_THREADING_FRAME)
+                                   ? threading->NumThreads - 1
+                                   : 0;
+
+    // dav1d does not use libavcodec threads, its frame threads set the delay
+    int64_t frameThreads = 0;
+    if (m_avDecCodec->id == AV_CODEC_ID_AV1 &&
+        av_opt_get_int(m_avDecContext->priv_data,
+                       "framethreads",
+                       AV_OPT_SEARCH_CHILDREN,
+                       &frameThreads) == 0 &&
+        frameThreads > 0)
+        threading->LatencyFrames = (mfxU16)(frameThreads - 1);
+}
+
+// dav1d threads on its own within thread_count: frame threads decode frames ahead, which
+// is its frame delay, tile threads split one frame. Counts not given follow the generic
+// threading mode and low delay.
+mfxStatus CpuDecode::SetAV1Options(mfxVideoParam *par) {
+    mfxExtCpuDecodeThreading *threading = reinterpret_cast<mfxExtCpuDecodeThreading *>(
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_DECODE_THREADING));
+    mfxExtCpuDecodeAV1 *av1 = reinterpret_cast<mfxExtCpuDecodeAV1 *>(
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_DECODE_AV1));
+
+    mfxExtCpuDecodeAV1 opts = {};
+    if (av1)
+        opts = *av1;
+
+    mfxU16 mode = threading ? threading->Mode & (MFX_CPU_DECODE_THREADING_FRAME |
+                                                 MFX_CPU_DECODE_THREADING_SLICE)
+                            : 0;
+    if (!opts.MaxFrameDelay && (par->mfx.DecodedOrder || mode == MFX_CPU_DECODE_THREADING_SLICE))
+        opts.MaxFrameDelay = 1;
+    if (!opts.TileThreads && mode == MFX_CPU_DECODE_THREADING_FRAME)
+        opts.TileThreads = 1;
+
+    if (opts.FilmGrain == MFX_CPU_DECODE_AV1_FILM_GRAIN_DEFAULT && par->mfx.FilmGrain == 0)
+        opts.FilmGrain = MFX_CPU_DECODE_AV1_FILM_GRAIN_SKIP;
+
+    void *priv = m_avDecContext->priv_data;
+    if (opts.MaxFrameDelay) {
+        RET_IF_FALSE(av_opt_set_int(priv,
+                                    "framethreads",
+                                    opts.MaxFrameDelay,
+                                    AV_OPT_SEARCH_CHILDREN) == 0,
+                     MFX_ERR_INVALID_VIDEO_PARAM);
+    }
+    if (opts.TileThreads) {
+        RET_IF_FALSE(
+            av_opt_set_int(priv, "tilethreads", opts.TileThreads, AV_OPT_SEARCH_CHILDREN) == 0,
+            MFX_ERR_INVALID_VIDEO_PARAM);
+    }
+    if (opts.FilmGrain != MFX_CPU_DECODE_AV1_FILM_GRAIN_DEFAULT) {
+        int apply = (opts.FilmGrain == MFX_CPU_DECODE_AV1_FILM_GRAIN_APPLY);
+        RET_IF_FALSE(av_opt_set_int(priv, "filmgrain", apply, AV_OPT_SEARCH_CHILDREN) == 0,
+                     MFX_ERR_INVALID_VIDEO_PARAM);
+    }
+
+    m_bExportFilmGrain = (opts.FilmGrain == MFX_CPU_DECODE_AV1_FILM_GRAIN_EXPORT);
+    if (m_bExportFilmGrain)
+        m_avDecContext->export_side_data |= AV_CODEC_EXPORT_DATA_FILM_GRAIN;
+
+    return MFX_ERR_NONE;
+}
+
+// takes effect from the next packet, decoders read these fields per frame
+mfxStatus CpuDecode::SetSkipMode(mfxSkipMode mode) {
+    mfxU32 level = m_skipLevel;
+
+    switch (mode) {
+        case MFX_SKIPMODE_NOSKIP:
+            level = 0;
+            break;
+        case MFX_SKIPMODE_MORE:
+            if (level < maxSkipLevel)
+                level++;
+            break;
+        case MFX_SKIPMODE_LESS:
+            if (level > 0)
+                level--;
+            break;
+        default:
+            return MFX_ERR_UNSUPPORTED;
+    }
+
+    if (level == m_skipLevel)
+        return MFX_WRN_VALUE_NOT_CHANGED;
+
+    m_skipLevel                      = level;
+    m_avDecContext->skip_loop_filter = skipLevels[level].loopFilter;
+    m_avDecContext->skip_idct        = skipLevels[level].idct;
+    m_avDecContext->skip_frame       = GetSkipFrame();
+
+    return MFX_ERR_NONE;
+}
+
+// the policy may change on Reset(), a skip in progress goes on
+void CpuDecode::SetErrorRecovery(mfxVideoParam *par) {
+    mfxExtCpuDecodeErrorRecovery *recovery = reinterpret_cast<mfxExtCpuDecodeErrorRecovery *>(
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_DECODE_ERROR_RECOVERY));
+    m_errorRecovery = recovery ? recovery->Mode : (mfxU16)MFX_CPU_DECODE_ERROR_CONCEAL;
+}
+
+// references decoded after the damage are unusable until the next key frame
+void CpuDecode::StartErrorRecovery() {
+    m_bRecovering              = true;
+    m_bSkipToKeyFrame          = true;
+    m_avDecContext->skip_frame = GetSkipFrame();
+}
+
+// 1 for a key frame, 0 for another frame, -1 if the parser cannot tell
+// the decoding parser already looked at m_avDecPacket, complete frames bypass it and go
+// through a parser of their own
+int CpuDecode::GetPacketKeyFrame(bool completeFrame) {
+    if (!completeFrame)
+        return m_avDecParser->key_frame;
+
+    if (!m_avKeyParser) {
+        m_avKeyParser = av_parser_init(m_avDecCodec->id);
+        if (!m_avKeyParser)
+            return -1;
+        m_avKeyParser->flags |= PARSER_FLAG_COMPLETE_FRAMES;
+    }
+
+    uint8_t *data = nullptr;
+    int size      = 0;
+    av_parser_parse2(m_avKeyParser,
+                     m_avDecContext,
+                     &data,
+                     &size,
+                     m_avDecPacket->data,
+                     m_avDecPacket->size,
+                     AV_NOPTS_VALUE,
+                     AV_NOPTS_VALUE,
+                     0);
+    return m_avKeyParser->key_frame;
+}
+
+// key frames only while skipping to the next one and in thumbnail mode
+AVDiscard CpuDecode::GetSkipFrame() {
+    if (m_bSkipToKeyFrame || m_avDecFrameThumb)
+        return AVDISCARD_NONKEY;
+
+    return skipLevels[m_skipLevel].frame;
+}
+
+void CpuDecode::GetStatParam(mfxExtCpuDecodeStat *decStat) {
+    decStat->NumFrame        = m_statNumFrame.load(std::memory_order_relaxed);
+    decStat->NumCorrupted    = m_statNumCorrupted.load(std::memory_order_relaxed);
+    decStat->NumError        = m_statNumError.load(std::memory_order_relaxed);
+    decStat->NumDropped      = m_statNumDropped.load(std::memory_order_relaxed);
+    decStat->MaxDecodeTimeUs = m_statMaxDecodeTimeUs.load(std::memory_order_relaxed);
+    decStat->BytesConsumed   = m_statBytesConsumed.load(std::memory_order_relaxed);
+    decStat->ParserCalls     = m_statParserCalls.load(std::memory_order_relaxed);
+    decStat->DecodeTimeUs    = m_statDecodeTimeUs.load(std::memory_order_relaxed);
+    decStat->BytesCopied     = m_statBytesCopied.load(std::memory_order_relaxed);
+}
+
+mfxStatus CpuDecode::GetPayload(mfxU64 *ts, mfxPayload *payload) {
+    return m_payloads.Pop(ts, payload);
+}
+
+mfxStatus CpuDecode::GetDecodeStat(mfxDecodeStat *stat) {
+    *stat = { 0 };
+
+    // corrupted frames are returned but still count as errors
+    stat->NumFrame        = m_statNumFrame.load(std::memory_order_relaxed);
+    stat->NumError        = m_statNumBadFrames.load(std::memory_order_relaxed);
+    stat->NumSkippedFrame = m_statNumDropped.load(std::memory_order_relaxed);
+    stat->NumCachedFrame  = m_bFrameBuffered ? 1 : 0;
+
+    return MFX_ERR_NONE;
+}
+
 mfxStatus CpuDecode::GetVideoParam(mfxVideoParam *par) {
     par->mfx       = m_param.mfx;
     par->IOPattern = m_param.IOPattern;
 
+    mfxExtCpuDecodeThreading *threading = reinterpret_cast<mfxExtCpuDecodeThreading *>(
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_DECODE_THREADING));
+    if (threading)
+        GetThreadingParam(threading);
+
+    mfxExtCpuDecodeStat *decStat = reinterpret_cast<mfxExtCpuDecodeStat *>(
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_DECODE_STAT));
+    if (decStat)
+        GetStatParam(decStat);
+
     //If DecodeFrame() is not executed at all, we can't update params from m_avDecContext
     //but return current params
     if (!m_avDecContext->width && !m_avDecContext->height &&
@@ -678,14 +1784,21 @@ mfxStatus CpuDecode::GetVideoParam(mfxVideoParam *par) {
     //been effectively set
     par->mfx.CodecId = AVCodecID_to_MFXCodecId(m_avDecCodec->id);
 
-    // resolution
-    par->mfx.FrameInfo.Width  = (uint16_t)m_avDecContext->width;
-    par->mfx.FrameInfo.Height = (uint16_t)m_avDecContext->height;
-    par->mfx.FrameInfo.CropW  = (uint16_t)m_avDecContext->width;
-    par->mfx.FrameInfo.CropH  = (uint16_t)m_avDecContext->height;
+    // resolution, the stream's when lowres decoding reduces it
+    int width  = m_avDecContext->lowres ? m_avDecContext->coded_width : m_avDecContext->width;
+    int height = m_avDecContext->lowres ? m_avDecContext->coded_height : m_avDecContext->height;
+
+    par->mfx.FrameInfo.Width  = (uint16_t)width;
+    par->mfx.FrameInfo.Height = (uint16_t)height;
+    par->mfx.FrameInfo.CropW  = (uint16_t)width;
+    par->mfx.FrameInfo.CropH  = (uint16_t)height;
 
-    // FourCC and chroma format
-    switch (m_avDecContext->pix_fmt) {
+    // FourCC and chroma format, mjpeg reports the format it is converted to
+    int pix_fmt = m_avDecContext->pix_fmt;
+    if (m_avDecCodec->id == AV_CODEC_ID_MJPEG && pix_fmt != AV_PIX_FMT_NONE)
+        pix_fmt = GetJPEGOutputFormat(pix_fmt);
+
+    switch (pix_fmt) {
         case AV_PIX_FMT_YUV420P10LE:
             par->mfx.FrameInfo.FourCC         = MFX_FOURCC_I010;
             par->mfx.FrameInfo.BitDepthLuma   = 10;
@@ -791,10 +1904,7 @@ mfxStatus CpuDecode::CheckVideoParamDecoders(mfxVideoParam *in) {
         }
     }
 
-    if (in->mfx.DecodedOrder)
-        return MFX_ERR_UNSUPPORTED;
-
-    if (in->NumExtParam)
+    if (CheckExtParam(in->ExtParam, in->NumExtParam) != MFX_ERR_NONE)
         return MFX_ERR_INVALID_VIDEO_PARAM;
 
     return MFX_ERR_NONE;
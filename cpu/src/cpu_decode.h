@@ -7,9 +7,22 @@
 #ifndef CPU_SRC_CPU_DECODE_H_
 #define CPU_SRC_CPU_DECODE_H_
 
+#include <atomic>
 #include <memory>
 #include "src/cpu_common.h"
 #include "src/cpu_frame_pool.h"
+#include "src/cpu_parallel_decode.h"
+#include "src/cpu_payload.h"
+
+// metadata kept for GetPayload(), older payloads are dropped when the app does not drain them
+#define MAX_PAYLOADS     32
+#define MAX_PAYLOAD_SIZE 4096
+
+// frames each GOP parallel context may decode ahead of the app, bounds the reorder window
+#define GOP_DECODE_MAX_FRAMES 8
+
+// stream bytes decode lazy init keeps while the headers are incomplete
+#define DECODE_INIT_MAX_DATA (4 * 1024 * 1024)
 
 class CpuWorkstream;
 
@@ -20,12 +33,21 @@ public:
 
     static mfxStatus DecodeQuery(mfxVideoParam *in, mfxVideoParam *out);
     static mfxStatus DecodeQueryIOSurf(mfxVideoParam *par, mfxFrameAllocRequest *request);
+    static mfxStatus CheckExtParam(mfxExtBuffer **ppExtParam, mfxU16 count);
+    static mfxU32 FindHeaderStart(mfxU32 codecId, const mfxU8 *data, mfxU32 size);
 
     mfxStatus InitDecode(mfxVideoParam *par, mfxBitstream *bs);
+    bool CanResetInPlace(mfxVideoParam *par);
+    mfxStatus ResetDecode(mfxVideoParam *par);
+    mfxStatus FlushDecode(bool skipToKeyFrame);
+    void SetPendingInput(std::vector<mfxU8> &data);
     mfxStatus DecodeFrame(mfxBitstream *bs,
                           mfxFrameSurface1 *surface_work,
                           mfxFrameSurface1 **surface_out);
     mfxStatus GetVideoParam(mfxVideoParam *par);
+    mfxStatus GetDecodeStat(mfxDecodeStat *stat);
+    mfxStatus SetSkipMode(mfxSkipMode mode);
+    mfxStatus GetPayload(mfxU64 *ts, mfxPayload *payload);
     mfxStatus GetDecodeSurface(mfxFrameSurface1 **surface);
 
     mfxStatus CheckVideoParamDecoders(mfxVideoParam *in);
@@ -33,22 +55,91 @@ public:
 
 private:
     static mfxStatus ValidateDecodeParams(mfxVideoParam *par, bool canCorrect);
-    AVFrame *ConvertJPEGOutputColorSpace(AVFrame *avframe, AVPixelFormat target_pixfmt);
+    static mfxU64 GetDecodeMemoryEstimate(mfxVideoParam *par);
+    static int GetParallelDecodeContexts(mfxVideoParam *par);
+    mfxStatus ProbeHeader(mfxBitstream *bs);
+    AVPixelFormat GetJPEGOutputFormat(int decodedFormat);
+    mfxStatus GetJPEGOutputBuffer(AVFrame *avframe, AVPixelFormat format, int width, int height);
+    mfxStatus ConvertJPEGOutput(AVFrame *src, AVFrame *dst);
+    bool IsThumbnail(const AVFrame *frame);
+    mfxStatus ScaleThumbnail(AVFrame *src, AVFrame *dst);
+    AVDiscard GetSkipFrame();
+    mfxStatus SetAV1Options(mfxVideoParam *par);
+    void SetErrorRecovery(mfxVideoParam *par);
+    void StartErrorRecovery();
+    int GetPacketKeyFrame(bool completeFrame);
+    bool CanWrapBitstream(mfxBitstream *bs);
+    int SendPacket(const AVPacket *pkt);
+    int ReceiveFrame(AVFrame *frame);
+    void GetThreadingParam(mfxExtCpuDecodeThreading *threading);
+    void GetStatParam(mfxExtCpuDecodeStat *decStat);
+    mfxStatus DecodeRing(mfxBitstream *bs,
+                         mfxFrameSurface1 *surface_work,
+                         mfxFrameSurface1 **surface_out);
+    mfxStatus DecodeAndOutputFrame(mfxBitstream *bs,
+                                   mfxFrameSurface1 *surface_work,
+                                   mfxFrameSurface1 **surface_out);
     const AVCodec *m_avDecCodec;
     AVCodecContext *m_avDecContext;
     AVCodecParserContext *m_avDecParser;
     AVPacket *m_avDecPacket;
     AVFrame *m_avDecFrameOut;
+
+    // mjpeg output before colour conversion, and the pool converted frames come from
+    AVFrame *m_avDecFrameJPEG;
+    AVBufferPool *m_jpegPool;
+    int m_jpegPoolSize;
     struct SwsContext *m_swsContext;
 
+    // thumbnail mode: key frames before scaling, the pool above holds the thumbnails
+    AVFrame *m_avDecFrameThumb;
+    mfxExtCpuDecodeThumbnail m_thumbnail;
+    int64_t m_thumbLastPts;
+    mfxU32 m_thumbCount;
+
+    // stream data the lazy init took before the decoder existed, decoded before new input
+    std::vector<mfxU8> m_pendingInput;
+    size_t m_pendingPos;
+
+    // mjpeg frame threading, replaces m_avDecContext for decoding when set
+    std::unique_ptr<CpuParallelDecode> m_parallelDecode;
+
     mfxVideoParam m_param;
     std::unique_ptr<CpuFramePool> m_decSurfaces;
+
+    // Init-time copies of the buffers applied before avcodec_open2(), m_param does not keep
+    // the app's ExtParam, BufferId is 0 for a buffer that was not attached
+    mfxExtCpuDecodeThreading m_initThreading;
+    mfxExtCpuDecodeAV1 m_initAV1;
+    mfxExtCpuDecodeAnalytics m_initAnalytics;
+    CpuMemoryReservation m_memory;
     bool m_bFrameBuffered;
-    bool m_bStreamInfo;
+    bool m_bSkipToKeyFrame;
+    bool m_bExportFilmGrain;
+
+    // error recovery: m_bRecovering drops packets up to the next key frame, output is
+    // held back by m_bSkipToKeyFrame until it is decoded
+    mfxU16 m_errorRecovery;
+    bool m_bRecovering;
+    AVCodecParserContext *m_avKeyParser; // key frame detection for complete frames
 
     CpuWorkstream *m_session;
 
     mfxU32 m_frameOrder;
+    mfxU32 m_skipLevel;
+    CpuPayloadRing m_payloads;
+
+    // statistics, updated by the decoding thread and readable from any thread
+    std::atomic<mfxU32> m_statNumFrame;
+    std::atomic<mfxU32> m_statNumCorrupted;
+    std::atomic<mfxU32> m_statNumError;
+    std::atomic<mfxU32> m_statNumDropped;
+    std::atomic<mfxU32> m_statNumBadFrames; // failed calls and corrupted frames, once each
+    std::atomic<mfxU32> m_statMaxDecodeTimeUs;
+    std::atomic<mfxU64> m_statBytesConsumed;
+    std::atomic<mfxU64> m_statParserCalls;
+    std::atomic<mfxU64> m_statDecodeTimeUs;
+    std::atomic<mfxU64> m_statBytesCopied;
 
     /* copy not allowed */
     CpuDecode(const CpuDecode &);
@@ -53,12 +53,32 @@ mfxStatus CpuDecodeVPP::InitVPP(mfxVideoParam *par,
     memcpy_s(&param.vpp.In, sizeof(mfxFrameInfo), &par->mfx.FrameInfo, sizeof(mfxFrameInfo));
     param.IOPattern = MFX_IOPATTERN_IN_SYSTEM_MEMORY | MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
+    // in thumbnail mode the decoder output is already small (and for mjpeg decoded at
+    // reduced size), the channels scale from that
+    mfxExtCpuDecodeThumbnail *thumbnail = reinterpret_cast<mfxExtCpuDecodeThumbnail *>(
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_DECODE_THUMBNAIL));
+    if (thumbnail) {
+        param.vpp.In.FourCC         = MFX_FOURCC_I420;
+        param.vpp.In.ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+        param.vpp.In.BitDepthLuma   = 8;
+        param.vpp.In.BitDepthChroma = 8;
+        param.vpp.In.Width          = thumbnail->Width;
+        param.vpp.In.Height         = thumbnail->Height;
+        param.vpp.In.CropX          = 0;
+        param.vpp.In.CropY          = 0;
+        param.vpp.In.CropW          = thumbnail->Width;
+        param.vpp.In.CropH          = thumbnail->Height;
+    }
+
     for (mfxU32 i = 0; i < m_numVPPCh; i++) {
         m_cpuVPP[i].SetSession(m_session);
         memcpy_s(&param.vpp.Out,
                  sizeof(mfxFrameInfo),
                  &(vpp_par_array[i]->VPP),
                  sizeof(mfxFrameInfo));
+        // channel specific vpp controls, e.g. depth conversion
+        param.ExtParam    = vpp_par_array[i]->ExtParam;
+        param.NumExtParam = vpp_par_array[i]->NumExtParam;
         RET_ERROR(m_cpuVPP[i].InitVPP(&param));
     }
 
@@ -124,6 +144,14 @@ mfxStatus CpuDecodeVPP::DecodeVPPFrame(mfxBitstream *bs,
     RET_ERROR(
         MFXVideoDECODE_DecodeFrameAsync(m_mfxsession, bs, pWorkSurface, &m_surfOut[0], &syncp));
 
+    // no frame, e.g. all thumbnails are returned
+    if (!m_surfOut[0]) {
+        for (mfxU32 i = 0; i < m_numVPPCh; i++)
+            RET_ERROR(m_surfOut[i + 1]->FrameInterface->Release(m_surfOut[i + 1]));
+        *surf_array_out = nullptr;
+        return MFX_ERR_NONE;
+    }
+
     //output DEC
     RAIISurfaceArray surfArray;
     mfxFrameSurface1 *decChannelSurf = m_surfOut[0];
@@ -208,10 +236,7 @@ mfxStatus CpuDecodeVPP::CheckVideoParamDecodeVPP(mfxVideoParam *in) {
         }
     }
 
-    if (in->mfx.DecodedOrder)
-        return MFX_ERR_UNSUPPORTED;
-
-    if (in->NumExtParam)
+    if (CpuDecode::CheckExtParam(in->ExtParam, in->NumExtParam) != MFX_ERR_NONE)
         return MFX_ERR_INVALID_VIDEO_PARAM;
 
     return MFX_ERR_NONE;
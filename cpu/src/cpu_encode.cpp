@@ -22,13 +22,19 @@ CpuEncode::CpuEncode(CpuWorkstream *session)
           m_param({}),
           m_bFrameEncoded(false),
           m_session(session),
-          m_encSurfaces() {}
+          m_encSurfaces(),
+          m_forcedIdr(0),
+          m_outputMode(MFX_CPU_ENCODE_OUTPUT_COPY),
+          m_outputBs(nullptr),
+          m_lentPackets(),
+          m_lentMutex() {}
 
 CpuEncode::~CpuEncode() {
     if (m_bFrameEncoded) {
         // drain encoder - workaround for encoder hang on avcodec_close
         mfxBitstream bs{};
         mfxStatus sts;
+        m_outputMode = MFX_CPU_ENCODE_OUTPUT_COPY;
         do {
             sts = EncodeFrame(nullptr, nullptr, &bs);
         } while (sts == MFX_ERR_NOT_ENOUGH_BUFFER || sts == MFX_ERR_NONE);
@@ -46,6 +52,10 @@ CpuEncode::~CpuEncode() {
         av_packet_free(&m_avEncPacket);
         m_avEncPacket = nullptr;
     }
+
+    // packets the app did not release
+    for (auto &lent : m_lentPackets)
+        av_buffer_unref(&lent.second);
 }
 
 mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
@@ -61,7 +71,7 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
 
         if (par->Protected)
             par->Protected = 0;
-        if (par->NumExtParam)
+        if (par->NumExtParam && CheckExtParam(par->ExtParam, par->NumExtParam) != MFX_ERR_NONE)
             par->NumExtParam = 0;
         if (par->IOPattern != MFX_IOPATTERN_IN_SYSTEM_MEMORY)
             par->IOPattern = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
@@ -73,7 +83,7 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
 
         if (par->Protected)
             return MFX_ERR_INVALID_VIDEO_PARAM;
-        if (par->NumExtParam)
+        if (CheckExtParam(par->ExtParam, par->NumExtParam) != MFX_ERR_NONE)
             return MFX_ERR_INVALID_VIDEO_PARAM;
 
         if (par->IOPattern != MFX_IOPATTERN_IN_SYSTEM_MEMORY)
@@ -486,6 +496,34 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
         return MFX_ERR_NONE;
 }
 
+// only the CPU runtime's own extension buffers are accepted
+mfxStatus CpuEncode::CheckExtParam(mfxExtBuffer **ppExtParam, mfxU16 count) {
+    if (!count)
+        return MFX_ERR_NONE;
+
+    RET_IF_FALSE(ppExtParam, MFX_ERR_NULL_PTR);
+
+    for (mfxU16 i = 0; i < count; i++) {
+        RET_IF_FALSE(ppExtParam[i], MFX_ERR_NULL_PTR);
+
+        switch (ppExtParam[i]->BufferId) {
+            case MFX_EXTBUFF_CPU_ENCODE_OUTPUT: {
+                RET_IF_FALSE(ppExtParam[i]->BufferSz == sizeof(mfxExtCpuEncodeOutput),
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                mfxExtCpuEncodeOutput *output =
+                    reinterpret_cast<mfxExtCpuEncodeOutput *>(ppExtParam[i]);
+                RET_IF_FALSE(output->Mode <= MFX_CPU_ENCODE_OUTPUT_REFERENCE,
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                break;
+            }
+            default:
+                return MFX_ERR_INVALID_VIDEO_PARAM;
+        }
+    }
+
+    return MFX_ERR_NONE;
+}
+
 mfxStatus CpuEncode::InitEncode(mfxVideoParam *par) {
     m_param = *par;
     par     = &m_param;
@@ -587,10 +625,31 @@ mfxStatus CpuEncode::InitEncode(mfxVideoParam *par) {
     m_avEncContext->thread_count = 0;
 #endif
 
+    SetOutputMode(par);
+
+    // the buffers are read, the app's array is not kept
+    m_param.ExtParam    = nullptr;
+    m_param.NumExtParam = 0;
+
     int err = 0;
     err     = avcodec_open2(m_avEncContext, m_avEncCodec, NULL);
     RET_IF_FALSE(err == 0, MFX_ERR_INVALID_VIDEO_PARAM);
 
+    // a forced I frame changes forced-idr for that frame only, keep the value to restore
+    if (av_opt_get_int(m_avEncContext->priv_data,
+                       "forced-idr",
+                       AV_OPT_SEARCH_CHILDREN,
+                       &m_forcedIdr) < 0)
+        m_forcedIdr = 0;
+
+    // frame threads allocate packets while the app is between calls, when no bitstream is
+    // known, so they always copy
+    if (m_outputMode == MFX_CPU_ENCODE_OUTPUT_DIRECT &&
+        (m_avEncContext->active_thread_type & FF_THREAD_FRAME)) {
+        m_avEncContext->get_encode_buffer = avcodec_default_get_encode_buffer;
+        m_outputMode                      = MFX_CPU_ENCODE_OUTPUT_COPY;
+    }
+
     if (!m_param.mfx.BufferSizeInKB) {
         // TODO(estimate better based on RateControlMethod)
         m_param.mfx.BufferSizeInKB = DEF_BUFFER_SIZE_MULT * m_param.mfx.TargetKbps;
@@ -1130,27 +1189,89 @@ mfxStatus CpuEncode::GetAV1Params(mfxVideoParam *par) {
     return MFX_ERR_NONE;
 }
 
-mfxStatus CpuEncode::EncodeFrame(mfxFrameSurface1 *surface, mfxEncodeCtrl *ctrl, mfxBitstream *bs) {
-    RET_IF_FALSE(m_avEncContext, MFX_ERR_NOT_INITIALIZED);
-    int err;
+// only frame type and, for AVC, QP are supported
+mfxStatus CpuEncode::CheckEncodeCtrl(mfxEncodeCtrl *ctrl) {
+    if (!ctrl)
+        return MFX_ERR_NONE;
 
-    // check mfxEncodeCtrl
-    // none of these features are implemented so function returns invalid param
-    if (ctrl) {
-        if (ctrl->MfxNalUnitType)
-            return MFX_ERR_INVALID_VIDEO_PARAM;
-        if (ctrl->SkipFrame)
-            return MFX_ERR_INVALID_VIDEO_PARAM;
-        if (ctrl->QP)
-            return MFX_ERR_INVALID_VIDEO_PARAM;
-        if (ctrl->FrameType)
+    if (ctrl->MfxNalUnitType)
+        return MFX_ERR_INVALID_VIDEO_PARAM;
+    if (ctrl->SkipFrame)
+        return MFX_ERR_INVALID_VIDEO_PARAM;
+    if (ctrl->NumExtParam)
+        return MFX_ERR_INVALID_VIDEO_PARAM;
+    if (ctrl->NumPayload)
+        return MFX_ERR_INVALID_VIDEO_PARAM;
+
+    if (ctrl->FrameType) {
+        // reference and second field flags are up to the encoder
+        if (!(ctrl->FrameType &
+              (MFX_FRAMETYPE_I | MFX_FRAMETYPE_P | MFX_FRAMETYPE_B | MFX_FRAMETYPE_IDR)))
             return MFX_ERR_INVALID_VIDEO_PARAM;
-        if (ctrl->NumExtParam)
+    }
+
+    if (ctrl->QP) {
+        // the SVT-HEVC and SVT-AV1 wrappers pass no QP per picture, JPEG has none
+        if (m_param.mfx.CodecId != MFX_CODEC_AVC)
             return MFX_ERR_INVALID_VIDEO_PARAM;
-        if (ctrl->NumPayload)
+        if (ctrl->QP > 51)
             return MFX_ERR_INVALID_VIDEO_PARAM;
     }
 
+    return MFX_ERR_NONE;
+}
+
+// applies mfxEncodeCtrl to the frame about to be sent, the frame is reused so every field is
+// set each time
+void CpuEncode::SetFrameControl(mfxEncodeCtrl *ctrl, AVFrame *av_frame) {
+    mfxU16 frameType = ctrl ? ctrl->FrameType : MFX_FRAMETYPE_UNKNOWN;
+
+    if (frameType & (MFX_FRAMETYPE_I | MFX_FRAMETYPE_IDR)) {
+        // x264 and SVT-HEVC make a forced I frame an IDR only with forced-idr set
+        av_opt_set_int(m_avEncContext->priv_data,
+                       "forced-idr",
+                       (frameType & MFX_FRAMETYPE_IDR) ? 1 : 0,
+                       AV_OPT_SEARCH_CHILDREN);
+        av_frame->pict_type = AV_PICTURE_TYPE_I;
+        av_frame->key_frame = (frameType & MFX_FRAMETYPE_IDR) ? 1 : 0;
+    }
+    else if (frameType & MFX_FRAMETYPE_P) {
+        av_frame->pict_type = AV_PICTURE_TYPE_P;
+        av_frame->key_frame = 0;
+    }
+    else if (frameType & MFX_FRAMETYPE_B) {
+        av_frame->pict_type = AV_PICTURE_TYPE_B;
+        av_frame->key_frame = 0;
+    }
+    else {
+        av_frame->pict_type = AV_PICTURE_TYPE_NONE;
+        av_frame->key_frame = 0;
+    }
+
+    // libx264 codes a frame with quality set at that QP (the bootstrap patches FFmpeg for
+    // this), the QP of mfxEncodeCtrl only applies in CQP mode
+    if (m_param.mfx.CodecId == MFX_CODEC_AVC) {
+        av_frame->quality =
+            (ctrl && ctrl->QP && m_param.mfx.RateControlMethod == MFX_RATECONTROL_CQP)
+                ? ctrl->QP * FF_QP2LAMBDA
+                : 0;
+    }
+}
+
+mfxStatus CpuEncode::EncodeFrame(mfxFrameSurface1 *surface, mfxEncodeCtrl *ctrl, mfxBitstream *bs) {
+    RET_IF_FALSE(m_avEncContext, MFX_ERR_NOT_INITIALIZED);
+    int err;
+
+    RET_ERROR(CheckEncodeCtrl(ctrl));
+
+    // a lent packet replaces the bitstream data, so nothing may be pending in it
+    if (m_outputMode == MFX_CPU_ENCODE_OUTPUT_REFERENCE)
+        RET_IF_FALSE(bs->DataLength == 0, MFX_ERR_UNDEFINED_BEHAVIOR);
+
+    // GetEncodeBuffer() writes directly into bs if the packet is made during this call,
+    // it is only called from within send/receive
+    m_outputBs = bs;
+
     // encode one frame
     if (surface) {
         AVFrame *av_frame =
@@ -1162,11 +1283,21 @@ mfxStatus CpuEncode::EncodeFrame(mfxFrameSurface1 *surface, mfxEncodeCtrl *ctrl,
             av_frame->quality = m_avEncContext->global_quality;
         }
 
+        SetFrameControl(ctrl, av_frame);
+        bool forcedI = (av_frame->pict_type == AV_PICTURE_TYPE_I);
+
         if (surface->Data.TimeStamp)
             av_frame->pts = surface->Data.TimeStamp;
 
         err = avcodec_send_frame(m_avEncContext, av_frame);
         m_input_locker.Unlock();
+
+        // the encoder reads forced-idr while the frame is sent, later frames get the default
+        if (forcedI)
+            av_opt_set_int(m_avEncContext->priv_data,
+                           "forced-idr",
+                           m_forcedIdr,
+                           AV_OPT_SEARCH_CHILDREN);
         RET_IF_FALSE(err >= 0, MFX_ERR_ABORTED);
     }
     else {
@@ -1178,7 +1309,8 @@ mfxStatus CpuEncode::EncodeFrame(mfxFrameSurface1 *surface, mfxEncodeCtrl *ctrl,
     // get encoded packet, if available
     mfxU32 nBytesOut = 0, nBytesAvail = 0;
 
-    err = avcodec_receive_packet(m_avEncContext, m_avEncPacket);
+    err        = avcodec_receive_packet(m_avEncContext, m_avEncPacket);
+    m_outputBs = nullptr;
     if (err == AVERROR(EAGAIN)) {
         // need more data - nothing to do
         RET_ERROR(MFX_ERR_MORE_DATA);
@@ -1194,16 +1326,29 @@ mfxStatus CpuEncode::EncodeFrame(mfxFrameSurface1 *surface, mfxEncodeCtrl *ctrl,
         if (!m_bFrameEncoded)
             m_bFrameEncoded = true;
 
-        // copy encoded data to output buffer
-        nBytesOut   = m_avEncPacket->size;
-        nBytesAvail = bs->MaxLength - (bs->DataLength + bs->DataOffset);
+        if (m_outputMode == MFX_CPU_ENCODE_OUTPUT_REFERENCE) {
+            mfxStatus sts = LendPacket(bs);
+            if (sts != MFX_ERR_NONE) {
+                av_packet_unref(m_avEncPacket);
+                return sts;
+            }
+        }
+        else {
+            // copy encoded data to output buffer
+            nBytesOut   = m_avEncPacket->size;
+            nBytesAvail = bs->MaxLength - (bs->DataLength + bs->DataOffset);
+
+            if (nBytesOut > nBytesAvail) {
+                //error if encoded bytes out is larger than provided output buffer size
+                return MFX_ERR_NOT_ENOUGH_BUFFER;
+            }
 
-        if (nBytesOut > nBytesAvail) {
-            //error if encoded bytes out is larger than provided output buffer size
-            return MFX_ERR_NOT_ENOUGH_BUFFER;
+            // in direct mode the encoder already wrote the packet in place
+            mfxU8 *dst = bs->Data + bs->DataOffset + bs->DataLength;
+            if (m_avEncPacket->data != dst)
+                memcpy_s(dst, nBytesAvail, m_avEncPacket->data, nBytesOut);
+            bs->DataLength += nBytesOut;
         }
-        memcpy_s(bs->Data + bs->DataOffset, nBytesAvail, m_avEncPacket->data, nBytesOut);
-        bs->DataLength += nBytesOut;
         // TO DO - convert to 90khz timestamps (read m_avEncPacket->pts, ->dts)
         // Note dts may start at < 0, should +=1 each frame
         bs->TimeStamp       = m_avEncPacket->pts;
@@ -1232,6 +1377,90 @@ mfxStatus CpuEncode::EncodeFrame(mfxFrameSurface1 *surface, mfxEncodeCtrl *ctrl,
     return MFX_ERR_NONE;
 }
 
+void CpuEncode::SetOutputMode(mfxVideoParam *par) {
+    m_outputMode = MFX_CPU_ENCODE_OUTPUT_COPY;
+
+    mfxExtCpuEncodeOutput *output = reinterpret_cast<mfxExtCpuEncodeOutput *>(
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_ENCODE_OUTPUT));
+    if (!output)
+        return;
+
+    if (output->Mode == MFX_CPU_ENCODE_OUTPUT_REFERENCE) {
+        m_outputMode = MFX_CPU_ENCODE_OUTPUT_REFERENCE;
+    }
+    else if (output->Mode == MFX_CPU_ENCODE_OUTPUT_DIRECT &&
+             (m_avEncCodec->capabilities & AV_CODEC_CAP_DR1)) {
+        // encoders without DR1 allocate packets internally, the copy stays
+        m_avEncContext->opaque            = this;
+        m_avEncContext->get_encode_buffer = GetEncodeBuffer;
+        m_outputMode                      = MFX_CPU_ENCODE_OUTPUT_DIRECT;
+    }
+}
+
+static void NoFreeBuffer(void *opaque, uint8_t *data) {}
+
+// places the packet at the end of the app's bitstream if it fits with the padding the
+// encoder may write, otherwise the packet is allocated and copied as usual
+int CpuEncode::GetEncodeBuffer(AVCodecContext *ctx, AVPacket *pkt, int flags) {
+    CpuEncode *encoder = reinterpret_cast<CpuEncode *>(ctx->opaque);
+    mfxBitstream *bs   = encoder->m_outputBs;
+
+    if (!bs || !bs->Data || bs->DataOffset + bs->DataLength > bs->MaxLength)
+        return avcodec_default_get_encode_buffer(ctx, pkt, flags);
+
+    mfxU32 avail = bs->MaxLength - (bs->DataOffset + bs->DataLength);
+    if ((int64_t)pkt->size + AV_INPUT_BUFFER_PADDING_SIZE > avail)
+        return avcodec_default_get_encode_buffer(ctx, pkt, flags);
+
+    mfxU8 *dst = bs->Data + bs->DataOffset + bs->DataLength;
+    pkt->buf   = av_buffer_create(dst,
+                                  pkt->size + AV_INPUT_BUFFER_PADDING_SIZE,
+                                  NoFreeBuffer,
+                                  nullptr,
+                                  0);
+    if (!pkt->buf)
+        return AVERROR(ENOMEM);
+    pkt->data = pkt->buf->data;
+
+    return 0;
+}
+
+// hands the packet's buffer to the app until ReleaseBitstream()
+mfxStatus CpuEncode::LendPacket(mfxBitstream *bs) {
+    if (!m_avEncPacket->buf) {
+        // not refcounted, should not happen with send/receive
+        RET_IF_FALSE(av_packet_make_refcounted(m_avEncPacket) == 0, MFX_ERR_MEMORY_ALLOC);
+    }
+
+    std::lock_guard<std::mutex> lock(m_lentMutex);
+    m_lentPackets[m_avEncPacket->data] = m_avEncPacket->buf;
+    m_avEncPacket->buf                 = nullptr;
+
+    bs->Data       = m_avEncPacket->data;
+    bs->DataOffset = 0;
+    bs->DataLength = (mfxU32)m_avEncPacket->size;
+    bs->MaxLength  = (mfxU32)m_avEncPacket->size;
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CpuEncode::ReleaseBitstream(mfxBitstream *bs) {
+    std::lock_guard<std::mutex> lock(m_lentMutex);
+
+    auto lent = m_lentPackets.find(bs->Data);
+    RET_IF_FALSE(lent != m_lentPackets.end(), MFX_ERR_UNDEFINED_BEHAVIOR);
+
+    av_buffer_unref(&lent->second);
+    m_lentPackets.erase(lent);
+
+    bs->Data       = nullptr;
+    bs->DataOffset = 0;
+    bs->DataLength = 0;
+    bs->MaxLength  = 0;
+
+    return MFX_ERR_NONE;
+}
+
 mfxStatus CpuEncode::EncodeQueryIOSurf(mfxVideoParam *par, mfxFrameAllocRequest *request) {
     // may be null for internal use
     if (par)
@@ -1336,9 +1565,21 @@ mfxStatus CpuEncode::GetEncodeSurface(mfxFrameSurface1 **surface) {
 }
 
 mfxStatus CpuEncode::GetVideoParam(mfxVideoParam *par) {
+    // the app's extension buffers are filled in, not replaced
+    mfxExtBuffer **extParam = par->ExtParam;
+    mfxU16 numExtParam      = par->NumExtParam;
+
     *par = m_param;
     //*par = { 0 };
 
+    par->ExtParam    = extParam;
+    par->NumExtParam = numExtParam;
+
+    mfxExtCpuEncodeOutput *output = reinterpret_cast<mfxExtCpuEncodeOutput *>(
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_ENCODE_OUTPUT));
+    if (output)
+        output->Mode = m_outputMode;
+
     par->IOPattern  = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
     par->AsyncDepth = 1;
 
@@ -7,7 +7,9 @@
 #ifndef CPU_SRC_CPU_ENCODE_H_
 #define CPU_SRC_CPU_ENCODE_H_
 
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
 #include "src/cpu_common.h"
@@ -23,11 +25,13 @@ public:
 
     static mfxStatus EncodeQuery(mfxVideoParam *in, mfxVideoParam *out);
     static mfxStatus EncodeQueryIOSurf(mfxVideoParam *par, mfxFrameAllocRequest *request);
+    static mfxStatus CheckExtParam(mfxExtBuffer **ppExtParam, mfxU16 count);
 
     mfxStatus InitEncode(mfxVideoParam *par);
     mfxStatus EncodeFrame(mfxFrameSurface1 *surface, mfxEncodeCtrl *ctrl, mfxBitstream *bs);
     mfxStatus GetVideoParam(mfxVideoParam *par);
     mfxStatus GetEncodeSurface(mfxFrameSurface1 **surface);
+    mfxStatus ReleaseBitstream(mfxBitstream *bs);
     mfxStatus IsSameVideoParam(mfxVideoParam *newPar, mfxVideoParam *oldPar);
 
 private:
@@ -43,6 +47,11 @@ private:
     mfxStatus GetJPEGParams(mfxVideoParam *par);
 
     AVFrame *CreateAVFrame(mfxFrameSurface1 *surface);
+    mfxStatus CheckEncodeCtrl(mfxEncodeCtrl *ctrl);
+    void SetFrameControl(mfxEncodeCtrl *ctrl, AVFrame *av_frame);
+    void SetOutputMode(mfxVideoParam *par);
+    static int GetEncodeBuffer(AVCodecContext *ctx, AVPacket *pkt, int flags);
+    mfxStatus LendPacket(mfxBitstream *bs);
 
     const AVCodec *m_avEncCodec;
     AVCodecContext *m_avEncContext;
@@ -56,6 +65,17 @@ private:
 
     std::unique_ptr<CpuFramePool> m_encSurfaces;
 
+    // encoder's forced-idr option, restored after a frame forced by mfxEncodeCtrl
+    int64_t m_forcedIdr;
+
+    // output mode, m_outputBs is where GetEncodeBuffer() puts packets during EncodeFrame()
+    mfxU16 m_outputMode;
+    mfxBitstream *m_outputBs;
+
+    // packets handed out by reference, by data pointer, until the app releases them
+    std::map<mfxU8 *, AVBufferRef *> m_lentPackets;
+    std::mutex m_lentMutex;
+
     /* copy not allowed */
     CpuEncode(const CpuEncode &);
     CpuEncode &operator=(const CpuEncode &);
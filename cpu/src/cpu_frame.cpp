@@ -169,5 +169,105 @@ mfxStatus CpuFrame::QueryInterface(mfxFrameSurface1 *surface, mfxGUID guid, mfxH
         return MFX_ERR_NONE;
     }
 
+    if (guid == (mfxGUID)MFX_GUID_CPU_FRAME_ANALYTICS)
+        return cpu_frame->GetAnalytics(interface);
+
     return MFX_ERR_NOT_IMPLEMENTED;
 }
+
+// analytics arrays start on this boundary and their length is a multiple of it
+#define CPU_ANALYTICS_ALIGN 64
+
+static size_t AlignAnalytics(size_t size) {
+    return (size + CPU_ANALYTICS_ALIGN - 1) & ~(size_t)(CPU_ANALYTICS_ALIGN - 1);
+}
+
+// QP map cell size when the side data has no blocks, only the frame QP
+#define CPU_ANALYTICS_QP_BLOCK 16
+
+// converts the motion vector and encoding parameter side data libavcodec attached to the
+// frame into mfxCpuFrameAnalytics, each call rebuilds it
+mfxStatus CpuFrame::GetAnalytics(mfxHDL *interface) {
+    const AVFrameSideData *mvData =
+        av_frame_get_side_data(m_avframe, AV_FRAME_DATA_MOTION_VECTORS);
+    const AVFrameSideData *qpData =
+        av_frame_get_side_data(m_avframe, AV_FRAME_DATA_VIDEO_ENC_PARAMS);
+    AVVideoEncParams *encParams =
+        qpData ? reinterpret_cast<AVVideoEncParams *>(qpData->data) : nullptr;
+
+    mfxU32 numMVs  = mvData ? (mfxU32)(mvData->size / sizeof(AVMotionVector)) : 0;
+    size_t mvSlots = AlignAnalytics(numMVs);
+
+    // the smallest block sets the cell size, H.264 macroblocks give a 16x16 grid
+    int blockSize = encParams ? CPU_ANALYTICS_QP_BLOCK : 0;
+    for (unsigned int i = 0; encParams && i < encParams->nb_blocks; i++) {
+        const AVVideoBlockParams *block = av_video_enc_params_block(encParams, i);
+        int size                        = std::max(std::min(block->w, block->h), 1);
+        if (!i || size < blockSize)
+            blockSize = size;
+    }
+    int qpWidth    = blockSize ? (m_avframe->width + blockSize - 1) / blockSize : 0;
+    int qpHeight   = blockSize ? (m_avframe->height + blockSize - 1) / blockSize : 0;
+    size_t qpPitch = AlignAnalytics(qpWidth);
+
+    // four 16 bit and three 8 bit arrays, then the QP rows, zeroed so padding reads as 0
+    size_t mvBytes = mvSlots * (4 * sizeof(mfxI16) + 3 * sizeof(mfxU8));
+    m_analyticsData.assign(mvBytes + qpPitch * qpHeight + CPU_ANALYTICS_ALIGN, 0);
+
+    uintptr_t base = reinterpret_cast<uintptr_t>(m_analyticsData.data());
+    mfxU8 *p       = reinterpret_cast<mfxU8 *>(AlignAnalytics(base));
+
+    m_analytics                  = {};
+    m_analytics.NumMotionVectors = numMVs;
+    m_analytics.BlockX           = reinterpret_cast<mfxI16 *>(p);
+    m_analytics.BlockY           = m_analytics.BlockX + mvSlots;
+    m_analytics.MotionX          = m_analytics.BlockY + mvSlots;
+    m_analytics.MotionY          = m_analytics.MotionX + mvSlots;
+    m_analytics.BlockW           = reinterpret_cast<mfxU8 *>(m_analytics.MotionY + mvSlots);
+    m_analytics.BlockH           = m_analytics.BlockW + mvSlots;
+    m_analytics.Reference        = reinterpret_cast<mfxI8 *>(m_analytics.BlockH + mvSlots);
+
+    const AVMotionVector *mvs =
+        mvData ? reinterpret_cast<const AVMotionVector *>(mvData->data) : nullptr;
+    for (mfxU32 i = 0; i < numMVs; i++) {
+        const AVMotionVector &mv = mvs[i];
+        int scale                = mv.motion_scale ? mv.motion_scale : 4;
+
+        m_analytics.BlockX[i]    = (mfxI16)mv.dst_x;
+        m_analytics.BlockY[i]    = (mfxI16)mv.dst_y;
+        m_analytics.MotionX[i]   = (mfxI16)(mv.motion_x * 4 / scale);
+        m_analytics.MotionY[i]   = (mfxI16)(mv.motion_y * 4 / scale);
+        m_analytics.BlockW[i]    = mv.w;
+        m_analytics.BlockH[i]    = mv.h;
+        m_analytics.Reference[i] = (mv.source < 0) ? -1 : 1;
+    }
+
+    if (encParams) {
+        m_analytics.QPBlockSize = (mfxU16)blockSize;
+        m_analytics.QPWidth     = (mfxU16)qpWidth;
+        m_analytics.QPHeight    = (mfxU16)qpHeight;
+        m_analytics.QPPitch     = (mfxU32)qpPitch;
+        m_analytics.QP          = p + mvBytes;
+
+        for (int y = 0; y < qpHeight; y++)
+            memset(m_analytics.QP + y * qpPitch, av_clip_uint8(encParams->qp), qpWidth);
+
+        // blocks carry a delta to the frame QP
+        for (unsigned int i = 0; i < encParams->nb_blocks; i++) {
+            const AVVideoBlockParams *block = av_video_enc_params_block(encParams, i);
+            mfxU8 qp = (mfxU8)av_clip_uint8(encParams->qp + block->delta_qp);
+
+            int x0 = std::max(block->src_x, 0) / blockSize;
+            int y0 = std::max(block->src_y, 0) / blockSize;
+            int x1 = std::min((block->src_x + block->w + blockSize - 1) / blockSize, qpWidth);
+            int y1 = std::min((block->src_y + block->h + blockSize - 1) / blockSize, qpHeight);
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++)
+                    m_analytics.QP[y * qpPitch + x] = qp;
+            }
+        }
+    }
+
+    *interface = (mfxHDL)&m_analytics;
+    return MFX_ERR_NONE;
+}
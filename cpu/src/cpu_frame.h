@@ -58,7 +58,9 @@ public:
             : m_refCount(0),
               m_mappedFlags(0),
               m_interface(),
-              m_parentPoolInterface(parentPoolInterface) {
+              m_parentPoolInterface(parentPoolInterface),
+              m_analytics(),
+              m_analyticsData() {
         m_avframe = av_frame_alloc();
 
         *(mfxFrameSurface1 *)this   = {};
@@ -137,6 +139,17 @@ public:
                 Info.BitDepthChroma = 8;
                 Info.ChromaFormat   = MFX_CHROMAFORMAT_YUV422;
                 break;
+            case AV_PIX_FMT_NV12:
+                Info.BitDepthLuma   = 8;
+                Info.BitDepthChroma = 8;
+                Info.ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+                break;
+            case AV_PIX_FMT_P010LE:
+                Info.BitDepthLuma   = 10;
+                Info.BitDepthChroma = 10;
+                Info.ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+                Info.Shift          = 1;
+                break;
             case AV_PIX_FMT_BGRA:
                 Info.BitDepthLuma   = 8;
                 Info.BitDepthChroma = 8;
@@ -165,6 +178,14 @@ public:
             Data.R = avframe->data[0] + 2;
             Data.A = avframe->data[0] + 3;
         }
+        else if (Info.FourCC == MFX_FOURCC_NV12 || Info.FourCC == MFX_FOURCC_P010) {
+            // V is interleaved with U, offset by one sample
+            mfxU32 sampleSize = (Info.FourCC == MFX_FOURCC_P010) ? 2 : 1;
+            Data.Y            = avframe->data[0];
+            Data.U            = avframe->data[1];
+            Data.V            = avframe->data[1] ? avframe->data[1] + sampleSize : nullptr;
+            Data.A            = nullptr;
+        }
         else {
             Data.Y = avframe->data[0];
             Data.U = avframe->data[1];
@@ -188,6 +209,12 @@ private:
     mfxFrameSurfaceInterface m_interface;
     CpuFramePoolInterface *m_parentPoolInterface;
 
+    // MFX_GUID_CPU_FRAME_ANALYTICS, the arrays point into m_analyticsData
+    mfxCpuFrameAnalytics m_analytics;
+    std::vector<mfxU8> m_analyticsData;
+
+    mfxStatus GetAnalytics(mfxHDL *interface);
+
     static mfxStatus AddRef(mfxFrameSurface1 *surface);
     static mfxStatus Release(mfxFrameSurface1 *surface);
     static mfxStatus GetRefCounter(mfxFrameSurface1 *surface, mfxU32 *counter);
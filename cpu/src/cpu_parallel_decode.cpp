@@ -0,0 +1,457 @@
+/*############################################################################
+  # Copyright (C) 2021 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "src/cpu_parallel_decode.h"
+#include <algorithm>
+#include <utility>
+
+CpuParallelDecode::~CpuParallelDecode() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_jobReady.notify_all();
+
+    // a worker finishes the packet it has before it stops
+    for (std::thread &thread : m_threads)
+        thread.join();
+
+    m_queue.clear();
+    m_jobs.clear();
+
+    for (AVCodecContext *ctx : m_contexts) {
+        avcodec_close(ctx);
+        avcodec_free_context(&ctx);
+    }
+}
+
+mfxStatus CpuParallelDecode::Init(const AVCodecContext *main, int numContexts, int maxFrames) {
+    m_codecId   = main->codec_id;
+    m_maxFrames = (size_t)std::max(maxFrames, 1);
+
+    for (int i = 0; i < numContexts; i++) {
+        AVCodecContext *ctx = avcodec_alloc_context3(main->codec);
+        RET_IF_FALSE(ctx, MFX_ERR_MEMORY_ALLOC);
+        m_contexts.push_back(ctx);
+
+        // parallelism comes from the contexts
+        ctx->thread_count     = 1;
+        ctx->lowres           = main->lowres;
+        ctx->export_side_data = main->export_side_data;
+        RET_IF_FALSE(avcodec_open2(ctx, main->codec, nullptr) == 0,
+                     MFX_ERR_INVALID_VIDEO_PARAM);
+    }
+
+    for (AVCodecContext *ctx : m_contexts)
+        m_threads.emplace_back(&CpuParallelDecode::WorkerThread, this, ctx);
+
+    return MFX_ERR_NONE;
+}
+
+// position after the next 00 00 01 start code at or after pos, size if there is none
+static int FindStartCode(const uint8_t *data, int size, int pos) {
+    for (; pos + 2 < size; pos++) {
+        if (data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 1)
+            return pos + 3;
+    }
+    return size;
+}
+
+// reads the leading fields of a NAL unit, emulation prevention bytes are removed
+// reading past the end returns zero bits and sets Overrun()
+class NalReader {
+public:
+    NalReader(const uint8_t *data, int size) : m_rbsp(), m_bitPos(0) {
+        // parameter set ids are within the first bytes
+        const size_t maxBytes = 128;
+        int zeros             = 0;
+        for (int i = 0; i < size && m_rbsp.size() < maxBytes; i++) {
+            if (zeros >= 2 && data[i] == 3) {
+                zeros = 0;
+                continue;
+            }
+            zeros = data[i] ? 0 : zeros + 1;
+            m_rbsp.push_back(data[i]);
+        }
+    }
+
+    uint32_t ReadBits(int n) {
+        uint32_t value = 0;
+        for (; n > 0; n--, m_bitPos++) {
+            value <<= 1;
+            if (m_bitPos < m_rbsp.size() * 8)
+                value |= (m_rbsp[m_bitPos / 8] >> (7 - m_bitPos % 8)) & 1;
+        }
+        return value;
+    }
+
+    // exp-Golomb ue(v)
+    uint32_t ReadUE() {
+        int leadingZeros = 0;
+        while (!ReadBits(1)) {
+            if (++leadingZeros > 31 || Overrun())
+                return UINT32_MAX;
+        }
+        return (uint32_t)((1ull << leadingZeros) - 1) + ReadBits(leadingZeros);
+    }
+
+    bool Overrun() {
+        return m_bitPos > m_rbsp.size() * 8;
+    }
+
+private:
+    std::vector<uint8_t> m_rbsp;
+    size_t m_bitPos;
+};
+
+// cache key of a parameter set, NAL type above the id, so sets sort in the order they
+// depend on each other, VPS before SPS before PPS
+// false if the id cannot be read
+static bool GetParamSetKey(bool isHEVC, int type, const uint8_t *nal, int size, uint32_t *key) {
+    NalReader reader(nal, size);
+    uint32_t id    = 0;
+    uint32_t maxId = 0;
+
+    if (isHEVC) {
+        reader.ReadBits(16); // NAL unit header
+        if (type == 32) { // VPS
+            id    = reader.ReadBits(4);
+            maxId = 15;
+        }
+        else if (type == 33) { // SPS, the id follows profile_tier_level()
+            reader.ReadBits(4); // sps_video_parameter_set_id
+            int maxSubLayersMinus1 = (int)reader.ReadBits(3);
+            reader.ReadBits(1); // sps_temporal_id_nesting_flag
+            reader.ReadBits(32); // general profile, tier, flags and level, 96 bits
+            reader.ReadBits(32);
+            reader.ReadBits(32);
+
+            bool subLayerProfile[8] = {};
+            bool subLayerLevel[8]   = {};
+            for (int i = 0; i < maxSubLayersMinus1; i++) {
+                subLayerProfile[i] = (reader.ReadBits(1) != 0);
+                subLayerLevel[i]   = (reader.ReadBits(1) != 0);
+            }
+            if (maxSubLayersMinus1 > 0)
+                reader.ReadBits(2 * (8 - maxSubLayersMinus1)); // reserved_zero_2bits
+            for (int i = 0; i < maxSubLayersMinus1; i++) {
+                if (subLayerProfile[i]) {
+                    reader.ReadBits(32); // sub-layer profile, tier and flags, 88 bits
+                    reader.ReadBits(32);
+                    reader.ReadBits(24);
+                }
+                if (subLayerLevel[i])
+                    reader.ReadBits(8);
+            }
+
+            id    = reader.ReadUE();
+            maxId = 15;
+        }
+        else { // PPS
+            id    = reader.ReadUE();
+            maxId = 63;
+        }
+    }
+    else {
+        reader.ReadBits(8); // NAL unit header
+        if (type == 7) { // SPS
+            reader.ReadBits(24); // profile_idc, constraint flags, level_idc
+            id    = reader.ReadUE();
+            maxId = 31;
+        }
+        else { // PPS
+            id    = reader.ReadUE();
+            maxId = 255;
+        }
+    }
+
+    if (reader.Overrun() || id > maxId)
+        return false;
+
+    *key = ((uint32_t)type << 16) | id;
+    return true;
+}
+
+// true if the first slice of the access unit is IDR, which needs nothing decoded before it
+// parameter sets in the access unit update the ones kept for later segments, carried gets
+// their keys
+bool CpuParallelDecode::IsSegmentStart(const AVPacket *pkt, std::vector<uint32_t> *carried) {
+    static const uint8_t startCode[] = { 0, 0, 1 };
+    bool isHEVC                      = (m_codecId == AV_CODEC_ID_HEVC);
+    bool foundSlice                  = false;
+    bool isIDR                       = false;
+
+    int pos = FindStartCode(pkt->data, pkt->size, 0);
+    while (pos < pkt->size) {
+        int next = FindStartCode(pkt->data, pkt->size, pos);
+        int end  = (next < pkt->size) ? next - 3 : pkt->size;
+        int type = isHEVC ? (pkt->data[pos] >> 1) & 0x3F : pkt->data[pos] & 0x1F;
+
+        bool isParamSet = isHEVC ? (type >= 32 && type <= 34) : (type == 7 || type == 8);
+        bool isSlice    = isHEVC ? (type <= 31) : (type >= 1 && type <= 5);
+
+        uint32_t key = 0;
+        if (isParamSet && GetParamSetKey(isHEVC, type, pkt->data + pos, end - pos, &key)) {
+            std::vector<uint8_t> &nal = m_paramSets[key];
+            nal.assign(startCode, startCode + sizeof(startCode));
+            nal.insert(nal.end(), pkt->data + pos, pkt->data + end);
+            carried->push_back(key);
+        }
+        if (isSlice && !foundSlice) {
+            foundSlice = true;
+            isIDR      = isHEVC ? (type == 19 || type == 20) : (type == 5);
+        }
+
+        pos = next;
+    }
+
+    return isIDR;
+}
+
+// a segment's decoder has not seen the stream headers unless the segment carries them
+// a set is parsed against the sets of lower types, these are repeated in front of it even
+// when the segment carries them itself
+int CpuParallelDecode::AddParamSets(AVPacket *pkt, const std::vector<uint32_t> &carried) {
+    uint32_t maxMissingType = 0;
+    bool missing            = false;
+    for (auto &paramSet : m_paramSets) {
+        if (std::find(carried.begin(), carried.end(), paramSet.first) == carried.end()) {
+            maxMissingType = paramSet.first >> 16;
+            missing        = true;
+        }
+    }
+    if (!missing)
+        return 0;
+
+    std::vector<uint8_t> prefix;
+    for (auto &paramSet : m_paramSets) {
+        uint32_t type = paramSet.first >> 16;
+        bool isCarried =
+            std::find(carried.begin(), carried.end(), paramSet.first) != carried.end();
+        if (type < maxMissingType || (type == maxMissingType && !isCarried))
+            prefix.insert(prefix.end(), paramSet.second.begin(), paramSet.second.end());
+    }
+
+    AVPacket *out = av_packet_alloc();
+    if (!out)
+        return AVERROR(ENOMEM);
+
+    int ret = av_new_packet(out, (int)prefix.size() + pkt->size);
+    if (ret == 0)
+        ret = av_packet_copy_props(out, pkt);
+    if (ret == 0) {
+        memcpy(out->data, prefix.data(), prefix.size());
+        memcpy(out->data + prefix.size(), pkt->data, pkt->size);
+        av_packet_unref(pkt);
+        av_packet_move_ref(pkt, out);
+    }
+
+    av_packet_free(&out);
+    return ret;
+}
+
+void CpuParallelDecode::CloseSegment() {
+    if (!m_jobs.empty())
+        m_jobs.back()->closed = true;
+}
+
+void CpuParallelDecode::WorkerThread(AVCodecContext *ctx) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;) {
+        m_jobReady.wait(lock, [this] {
+            return m_stop || !m_queue.empty();
+        });
+        if (m_stop)
+            return;
+
+        Job *job = m_queue.front();
+        m_queue.pop_front();
+        job->dispatched = true;
+
+        DecodeJob(ctx, job, lock);
+
+        job->done = true;
+        m_jobDone.notify_all();
+    }
+}
+
+// called with the lock held, it is released while decoding
+void CpuParallelDecode::DecodeJob(AVCodecContext *ctx,
+                                  Job *job,
+                                  std::unique_lock<std::mutex> &lock) {
+    for (;;) {
+        // the reorder window limits new packets, the final drain goes ahead anyway
+        m_jobReady.wait(lock, [this, job] {
+            return m_stop || job->aborted ||
+                   (!job->packets.empty() && job->frames.size() < m_maxFrames) ||
+                   (job->packets.empty() && job->closed);
+        });
+        if (m_stop || job->aborted)
+            break;
+
+        // a null packet drains the decoder at the end of the segment
+        AVPacket *pkt = nullptr;
+        if (!job->packets.empty()) {
+            Packet &packet        = job->packets.front();
+            pkt                   = packet.pkt;
+            ctx->skip_frame       = packet.skipFrame;
+            ctx->skip_loop_filter = packet.skipLoopFilter;
+            ctx->skip_idct        = packet.skipIdct;
+            job->packets.pop_front();
+        }
+        bool drain = !pkt;
+        lock.unlock();
+
+        // a packet that fails to decode is dropped, the segment goes on
+        avcodec_send_packet(ctx, pkt);
+        av_packet_free(&pkt);
+
+        AVFrame *frame = av_frame_alloc();
+        while (frame && avcodec_receive_frame(ctx, frame) == 0) {
+            lock.lock();
+            job->frames.push_back(frame);
+            job->codedWidth  = ctx->coded_width;
+            job->codedHeight = ctx->coded_height;
+            job->profile     = ctx->profile;
+            job->level       = ctx->level;
+            lock.unlock();
+            m_jobDone.notify_all();
+
+            frame = av_frame_alloc();
+        }
+        av_frame_free(&frame);
+
+        lock.lock();
+        if (drain)
+            break;
+    }
+
+    // ready for the next segment
+    lock.unlock();
+    avcodec_flush_buffers(ctx);
+    lock.lock();
+}
+
+int CpuParallelDecode::SendPacket(const AVPacket *pkt, const AVCodecContext *ctx) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!pkt) {
+        CloseSegment();
+        m_draining = true;
+        m_jobReady.notify_all();
+        return 0;
+    }
+    if (m_draining)
+        return AVERROR_EOF;
+
+    AVPacket *packet = av_packet_alloc();
+    if (!packet)
+        return AVERROR(ENOMEM);
+
+    int ret = av_packet_ref(packet, pkt);
+    if (ret < 0) {
+        av_packet_free(&packet);
+        return ret;
+    }
+
+    bool intraOnly = (m_codecId == AV_CODEC_ID_MJPEG);
+    std::vector<uint32_t> carried;
+    bool newSegment = intraOnly || IsSegmentStart(packet, &carried) || m_jobs.empty() ||
+                      m_jobs.back()->closed;
+
+    if (newSegment) {
+        CloseSegment();
+
+        if (!intraOnly) {
+            ret = AddParamSets(packet, carried);
+            if (ret < 0) {
+                av_packet_free(&packet);
+                return ret;
+            }
+        }
+
+        std::unique_ptr<Job> job(new Job());
+        m_queue.push_back(job.get());
+        m_jobs.push_back(std::move(job));
+    }
+
+    Packet queued         = {};
+    queued.pkt            = packet;
+    queued.skipFrame      = ctx->skip_frame;
+    queued.skipLoopFilter = ctx->skip_loop_filter;
+    queued.skipIdct       = ctx->skip_idct;
+    m_jobs.back()->packets.push_back(queued);
+    if (intraOnly)
+        CloseSegment();
+
+    m_jobReady.notify_all();
+    return 0;
+}
+
+int CpuParallelDecode::ReceiveFrame(AVFrame *frame, AVCodecContext *ctx) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;) {
+        if (m_jobs.empty())
+            return m_draining ? AVERROR_EOF : AVERROR(EAGAIN);
+
+        Job *job = m_jobs.front().get();
+        if (!job->frames.empty()) {
+            AVFrame *decoded = job->frames.front();
+            job->frames.pop_front();
+
+            av_frame_unref(frame);
+            av_frame_move_ref(frame, decoded);
+            av_frame_free(&decoded);
+
+            ctx->width        = frame->width;
+            ctx->height       = frame->height;
+            ctx->coded_width  = job->codedWidth;
+            ctx->coded_height = job->codedHeight;
+            ctx->pix_fmt      = (AVPixelFormat)frame->format;
+            ctx->profile      = job->profile;
+            ctx->level        = job->level;
+
+            // room in the window
+            m_jobReady.notify_all();
+            return 0;
+        }
+
+        if (job->done) {
+            m_jobs.pop_front();
+            continue;
+        }
+
+        // more input while a context is free, only the last segment can still be open
+        size_t closedJobs = m_jobs.size() - (m_jobs.back()->closed ? 0 : 1);
+        if (!m_draining && closedJobs < m_contexts.size())
+            return AVERROR(EAGAIN);
+
+        m_jobDone.wait(lock);
+    }
+}
+
+void CpuParallelDecode::Flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_queue.clear();
+    for (std::unique_ptr<Job> &job : m_jobs)
+        job->aborted = true;
+    m_jobReady.notify_all();
+
+    // segments already picked up by a worker have to stop first
+    m_jobDone.wait(lock, [this] {
+        for (std::unique_ptr<Job> &job : m_jobs) {
+            if (job->dispatched && !job->done)
+                return false;
+        }
+        return true;
+    });
+
+    m_jobs.clear();
+    m_draining = false;
+}
@@ -0,0 +1,135 @@
+/*############################################################################
+  # Copyright (C) 2021 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef CPU_SRC_CPU_PARALLEL_DECODE_H_
+#define CPU_SRC_CPU_PARALLEL_DECODE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "src/cpu_common.h"
+
+// Splits a stream into independently decodable segments and decodes them on several
+// single threaded decoder contexts, one worker thread each. Frames are returned in
+// segment order, so in presentation order.
+//  - mjpeg: every packet is a segment
+//  - AVC/HEVC (Annex B): a segment starts at each IDR access unit, the last parameter
+//    set seen for each type and id is put in front of segments that do not carry it
+// Each worker decodes at most maxFrames ahead of the app, which bounds the reorder
+// window to contexts * maxFrames frames.
+// SendPacket()/ReceiveFrame() follow avcodec_send_packet()/avcodec_receive_frame(),
+// a null packet drains.
+class CpuParallelDecode {
+public:
+    CpuParallelDecode()
+            : m_codecId(AV_CODEC_ID_NONE),
+              m_maxFrames(1),
+              m_contexts(),
+              m_threads(),
+              m_jobs(),
+              m_queue(),
+              m_paramSets(),
+              m_mutex(),
+              m_jobReady(),
+              m_jobDone(),
+              m_draining(false),
+              m_stop(false) {}
+    ~CpuParallelDecode();
+
+    // the contexts take the codec and the settings fixed at open (lowres, exported side data)
+    // from main
+    mfxStatus Init(const AVCodecContext *main, int numContexts, int maxFrames);
+
+    int GetNumContexts() {
+        return (int)m_contexts.size();
+    }
+
+    // frames held back at most, decoded but not yet returned
+    int GetMaxLatency() {
+        return (int)(m_contexts.size() * m_maxFrames) - 1;
+    }
+
+    // takes a reference to the packet data, non refcounted data is copied
+    // the packet is decoded with the skip settings ctx has now, as the main context would
+    int SendPacket(const AVPacket *pkt, const AVCodecContext *ctx);
+
+    // ctx gets the dimensions, coded dimensions, format, profile and level of the
+    // returned frame
+    int ReceiveFrame(AVFrame *frame, AVCodecContext *ctx);
+
+    // drop queued packets and undelivered frames, ends draining
+    void Flush();
+
+private:
+    struct Packet {
+        AVPacket *pkt;
+        AVDiscard skipFrame;
+        AVDiscard skipLoopFilter;
+        AVDiscard skipIdct;
+    };
+
+    struct Job {
+        Job()
+                : packets(),
+                  frames(),
+                  codedWidth(0),
+                  codedHeight(0),
+                  profile(0),
+                  level(0),
+                  closed(false),
+                  aborted(false),
+                  dispatched(false),
+                  done(false) {}
+        ~Job() {
+            for (Packet &packet : packets)
+                av_packet_free(&packet.pkt);
+            for (AVFrame *frame : frames)
+                av_frame_free(&frame);
+        }
+
+        std::deque<Packet> packets; // waiting to be decoded
+        std::deque<AVFrame *> frames; // decoded, waiting to be returned
+        int codedWidth;
+        int codedHeight;
+        int profile;
+        int level;
+        bool closed; // no more packets
+        bool aborted; // flushed, decoding stops
+        bool dispatched;
+        bool done;
+    };
+
+    bool IsSegmentStart(const AVPacket *pkt, std::vector<uint32_t> *carried);
+    int AddParamSets(AVPacket *pkt, const std::vector<uint32_t> &carried);
+    void CloseSegment();
+    void WorkerThread(AVCodecContext *ctx);
+    void DecodeJob(AVCodecContext *ctx, Job *job, std::unique_lock<std::mutex> &lock);
+
+    AVCodecID m_codecId;
+    size_t m_maxFrames;
+    std::vector<AVCodecContext *> m_contexts;
+    std::vector<std::thread> m_threads;
+
+    std::deque<std::unique_ptr<Job>> m_jobs; // segment order, until delivered
+    std::deque<Job *> m_queue; // not yet picked up by a worker
+    // start code prefixed VPS/SPS/PPS by NAL type and id, see GetParamSetKey()
+    std::map<uint32_t, std::vector<uint8_t>> m_paramSets;
+    std::mutex m_mutex;
+    std::condition_variable m_jobReady;
+    std::condition_variable m_jobDone;
+    bool m_draining;
+    bool m_stop;
+
+    /* copy not allowed */
+    CpuParallelDecode(const CpuParallelDecode &);
+    CpuParallelDecode &operator=(const CpuParallelDecode &);
+};
+
+#endif // CPU_SRC_CPU_PARALLEL_DECODE_H_
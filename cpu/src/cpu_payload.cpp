@@ -0,0 +1,235 @@
+/*############################################################################
+  # Copyright (C) 2021 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "src/cpu_payload.h"
+
+void CpuPayloadRing::Init(mfxU32 capacity, mfxU32 maxSize) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    m_entries.resize(capacity);
+    m_data.resize((size_t)capacity * maxSize);
+    m_maxSize = maxSize;
+    m_head    = 0;
+    m_count   = 0;
+}
+
+void CpuPayloadRing::Push(mfxU64 timeStamp, mfxU16 type, const mfxU8 *data, mfxU32 size) {
+    if (m_entries.empty() || size > m_maxSize)
+        return;
+
+    // full, overwrite the oldest
+    if (m_count == m_entries.size()) {
+        m_head = (m_head + 1) % m_entries.size();
+        m_count--;
+    }
+
+    mfxU32 index = (mfxU32)((m_head + m_count) % m_entries.size());
+
+    m_entries[index].timeStamp = timeStamp;
+    m_entries[index].type      = type;
+    m_entries[index].size      = size;
+    memcpy_s(GetSlot(index), m_maxSize, data, size);
+    m_count++;
+}
+
+static mfxU8 *WriteBE16(mfxU8 *p, mfxU32 value) {
+    p[0] = (mfxU8)(value >> 8);
+    p[1] = (mfxU8)value;
+    return p + 2;
+}
+
+static mfxU8 *WriteBE32(mfxU8 *p, mfxU32 value) {
+    p = WriteBE16(p, value >> 16);
+    return WriteBE16(p, value & 0xFFFF);
+}
+
+// libavutil keeps the cc_data() triplets only, put back the ATSC A/53 user_data_registered
+// header (T.35 country and provider code, GA94, cc_count) and marker bits around them
+static mfxU32 GetA53UserData(const mfxU8 *cc, mfxU32 size, mfxU8 *out, mfxU32 outSize) {
+    mfxU32 ccCount = size / 3;
+    if (ccCount > 31) // cc_count is 5 bits
+        ccCount = 31;
+    if (11 + ccCount * 3 > outSize)
+        return 0;
+
+    static const mfxU8 header[] = { 0xB5, 0x00, 0x31, 'G', 'A', '9', '4', 0x03 };
+    mfxU8 *p                    = out;
+    memcpy(p, header, sizeof(header));
+    p += sizeof(header);
+    *p++ = (mfxU8)(0x40 | ccCount); // process_cc_data_flag
+    *p++ = 0xFF; // em_data
+    memcpy(p, cc, ccCount * 3);
+    p += ccCount * 3;
+    *p++ = 0xFF; // marker_bits
+
+    return (mfxU32)(p - out);
+}
+
+// libavutil packs each time code as BCD with a count in front, unpack it to the public struct
+static mfxU32 GetTimecodes(const uint32_t *tc, size_t size, mfxCpuTimecode *out) {
+    if (size < sizeof(uint32_t))
+        return 0;
+
+    mfxU32 count = tc[0];
+    if (count > 3)
+        count = 3;
+    if (count > size / sizeof(uint32_t) - 1)
+        count = (mfxU32)(size / sizeof(uint32_t) - 1);
+
+    for (mfxU32 i = 0; i < count; i++) {
+        uint32_t smpte   = tc[i + 1];
+        out[i]           = {};
+        out[i].Hours     = (mfxU8)(((smpte >> 4) & 0x3) * 10 + (smpte & 0xF));
+        out[i].Minutes   = (mfxU8)(((smpte >> 12) & 0x7) * 10 + ((smpte >> 8) & 0xF));
+        out[i].Seconds   = (mfxU8)(((smpte >> 20) & 0x7) * 10 + ((smpte >> 16) & 0xF));
+        out[i].Frames    = (mfxU8)(((smpte >> 28) & 0x3) * 10 + ((smpte >> 24) & 0xF));
+        out[i].DropFrame = (mfxU8)((smpte >> 30) & 0x1);
+    }
+
+    return count;
+}
+
+// av1 film grain goes out as the public struct, there is no SEI syntax for it
+static void GetAV1FilmGrain(const AVFilmGrainParams *fgp, mfxCpuAV1FilmGrain *out) {
+    const AVFilmGrainAOMParams &aom = fgp->codec.aom;
+
+    *out                       = {};
+    out->GrainSeed             = (mfxU16)fgp->seed;
+    out->NumYPoints            = (mfxU8)aom.num_y_points;
+    out->ChromaScalingFromLuma = (mfxU8)aom.chroma_scaling_from_luma;
+    out->NumCbPoints           = (mfxU8)aom.num_uv_points[0];
+    out->NumCrPoints           = (mfxU8)aom.num_uv_points[1];
+    out->ScalingShift          = (mfxU8)aom.scaling_shift;
+    out->ArCoeffLag            = (mfxU8)aom.ar_coeff_lag;
+    out->ArCoeffShift          = (mfxU8)aom.ar_coeff_shift;
+    out->GrainScaleShift       = (mfxU8)aom.grain_scale_shift;
+    out->CbMult                = (mfxI16)aom.uv_mult[0];
+    out->CbLumaMult            = (mfxI16)aom.uv_mult_luma[0];
+    out->CbOffset              = (mfxI16)aom.uv_offset[0];
+    out->CrMult                = (mfxI16)aom.uv_mult[1];
+    out->CrLumaMult            = (mfxI16)aom.uv_mult_luma[1];
+    out->CrOffset              = (mfxI16)aom.uv_offset[1];
+    out->OverlapFlag           = (mfxU8)aom.overlap_flag;
+    out->ClipToRestrictedRange = (mfxU8)aom.limit_output_range;
+
+    memcpy(out->PointY, aom.y_points, sizeof(out->PointY));
+    memcpy(out->PointCb, aom.uv_points[0], sizeof(out->PointCb));
+    memcpy(out->PointCr, aom.uv_points[1], sizeof(out->PointCr));
+    memcpy(out->ArCoeffsY, aom.ar_coeffs_y, sizeof(out->ArCoeffsY));
+    memcpy(out->ArCoeffsCb, aom.ar_coeffs_uv[0], sizeof(out->ArCoeffsCb));
+    memcpy(out->ArCoeffsCr, aom.ar_coeffs_uv[1], sizeof(out->ArCoeffsCr));
+}
+
+// captions and hdr metadata are exported without their SEI framing, write them back in SEI
+// payload syntax so apps see the same bytes for every codec, time codes have no codec
+// independent syntax and go out as public structs
+void CpuPayloadRing::PushFrame(const AVFrame *frame, mfxU64 timeStamp) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (m_entries.empty())
+        return;
+
+    for (int i = 0; i < frame->nb_side_data; i++) {
+        const AVFrameSideData *sd = frame->side_data[i];
+
+        switch (sd->type) {
+            case AV_FRAME_DATA_A53_CC: {
+                mfxU8 buf[11 + 31 * 3];
+                mfxU32 size = GetA53UserData(sd->data, (mfxU32)sd->size, buf, sizeof(buf));
+                if (size)
+                    Push(timeStamp, CPU_PAYLOAD_USER_DATA_REGISTERED, buf, size);
+                break;
+            }
+            case AV_FRAME_DATA_SEI_UNREGISTERED:
+                Push(timeStamp, CPU_PAYLOAD_USER_DATA_UNREGISTERED, sd->data, (mfxU32)sd->size);
+                break;
+            case AV_FRAME_DATA_S12M_TIMECODE: {
+                mfxCpuTimecode tc[3];
+                mfxU32 count =
+                    GetTimecodes(reinterpret_cast<const uint32_t *>(sd->data), sd->size, tc);
+                if (count)
+                    Push(timeStamp,
+                         MFX_CPU_PAYLOAD_TIMECODE,
+                         reinterpret_cast<const mfxU8 *>(tc),
+                         count * sizeof(mfxCpuTimecode));
+                break;
+            }
+            case AV_FRAME_DATA_MASTERING_DISPLAY_METADATA: {
+                const AVMasteringDisplayMetadata *md =
+                    reinterpret_cast<const AVMasteringDisplayMetadata *>(sd->data);
+                // SEI order is green, blue, red, libavutil stores red, green, blue
+                static const int order[3] = { 1, 2, 0 };
+                mfxU8 buf[24];
+                mfxU8 *p = buf;
+                for (int c = 0; c < 3; c++) {
+                    const AVRational *xy = md->display_primaries[order[c]];
+                    p = WriteBE16(p, (mfxU32)av_rescale(xy[0].num, 50000, xy[0].den));
+                    p = WriteBE16(p, (mfxU32)av_rescale(xy[1].num, 50000, xy[1].den));
+                }
+                p = WriteBE16(p, (mfxU32)av_rescale(md->white_point[0].num,
+                                                    50000,
+                                                    md->white_point[0].den));
+                p = WriteBE16(p, (mfxU32)av_rescale(md->white_point[1].num,
+                                                    50000,
+                                                    md->white_point[1].den));
+                p = WriteBE32(p, (mfxU32)av_rescale(md->max_luminance.num,
+                                                    10000,
+                                                    md->max_luminance.den));
+                p = WriteBE32(p, (mfxU32)av_rescale(md->min_luminance.num,
+                                                    10000,
+                                                    md->min_luminance.den));
+                Push(timeStamp, CPU_PAYLOAD_MASTERING_DISPLAY_COLOUR, buf, (mfxU32)(p - buf));
+                break;
+            }
+            case AV_FRAME_DATA_CONTENT_LIGHT_LEVEL: {
+                const AVContentLightMetadata *cll =
+                    reinterpret_cast<const AVContentLightMetadata *>(sd->data);
+                mfxU8 buf[4];
+                WriteBE16(WriteBE16(buf, cll->MaxCLL), cll->MaxFALL);
+                Push(timeStamp, CPU_PAYLOAD_CONTENT_LIGHT_LEVEL_INFO, buf, sizeof(buf));
+                break;
+            }
+            case AV_FRAME_DATA_FILM_GRAIN_PARAMS: {
+                const AVFilmGrainParams *fgp =
+                    reinterpret_cast<const AVFilmGrainParams *>(sd->data);
+                if (fgp->type != AV_FILM_GRAIN_PARAMS_AV1)
+                    break;
+                mfxCpuAV1FilmGrain grain;
+                GetAV1FilmGrain(fgp, &grain);
+                Push(timeStamp,
+                     MFX_CPU_PAYLOAD_AV1_FILM_GRAIN,
+                     reinterpret_cast<const mfxU8 *>(&grain),
+                     sizeof(grain));
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+mfxStatus CpuPayloadRing::Pop(mfxU64 *timeStamp, mfxPayload *payload) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (!m_count) {
+        payload->NumBit = 0;
+        return MFX_ERR_NONE;
+    }
+
+    const Entry &entry = m_entries[m_head];
+    RET_IF_FALSE(entry.size <= payload->BufSize, MFX_ERR_NOT_ENOUGH_BUFFER);
+
+    memcpy_s(payload->Data, payload->BufSize, GetSlot(m_head), entry.size);
+    payload->NumBit    = entry.size * 8;
+    payload->Type      = entry.type;
+    payload->CtrlFlags = 0;
+    *timeStamp         = entry.timeStamp;
+
+    m_head = (m_head + 1) % m_entries.size();
+    m_count--;
+
+    return MFX_ERR_NONE;
+}
@@ -0,0 +1,65 @@
+/*############################################################################
+  # Copyright (C) 2021 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef CPU_SRC_CPU_PAYLOAD_H_
+#define CPU_SRC_CPU_PAYLOAD_H_
+
+#include <mutex>
+#include <vector>
+#include "src/cpu_common.h"
+
+// SEI payloadType values used for mfxPayload::Type, for all codecs
+#define CPU_PAYLOAD_USER_DATA_REGISTERED      4
+#define CPU_PAYLOAD_USER_DATA_UNREGISTERED    5
+#define CPU_PAYLOAD_MASTERING_DISPLAY_COLOUR  137
+#define CPU_PAYLOAD_CONTENT_LIGHT_LEVEL_INFO  144
+
+// Bounded FIFO of metadata payloads in output order, for MFXVideoDECODE_GetPayload().
+// Storage is allocated once in Init(); when full the oldest payload is dropped.
+class CpuPayloadRing {
+public:
+    CpuPayloadRing()
+            : m_entries(),
+              m_data(),
+              m_maxSize(0),
+              m_head(0),
+              m_count(0),
+              m_mutex() {}
+
+    // also drops any payloads still queued
+    void Init(mfxU32 capacity, mfxU32 maxSize);
+
+    // copy side data of interest from a decoded frame
+    void PushFrame(const AVFrame *frame, mfxU64 timeStamp);
+
+    // NumBit = 0 if empty, MFX_ERR_NOT_ENOUGH_BUFFER leaves the payload in the ring
+    mfxStatus Pop(mfxU64 *timeStamp, mfxPayload *payload);
+
+private:
+    struct Entry {
+        mfxU64 timeStamp;
+        mfxU16 type;
+        mfxU32 size;
+    };
+
+    void Push(mfxU64 timeStamp, mfxU16 type, const mfxU8 *data, mfxU32 size);
+    mfxU8 *GetSlot(mfxU32 index) {
+        return m_data.data() + (size_t)index * m_maxSize;
+    }
+
+    std::vector<Entry> m_entries;
+    std::vector<mfxU8> m_data;
+    mfxU32 m_maxSize;
+    mfxU32 m_head;
+    mfxU32 m_count;
+    std::mutex m_mutex;
+
+    /* copy not allowed */
+    CpuPayloadRing(const CpuPayloadRing &);
+    CpuPayloadRing &operator=(const CpuPayloadRing &);
+};
+
+#endif // CPU_SRC_CPU_PAYLOAD_H_
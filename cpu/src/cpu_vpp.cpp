@@ -9,6 +9,7 @@
 #include <string>
 #include <utility>
 #include <vector>
+#include "src/cpu_convert.h"
 #include "src/cpu_workstream.h"
 
 // vpp in/out type
@@ -20,16 +21,20 @@ CpuVPP::CpuVPP()
           m_buffersink_ctx(nullptr),
           m_input_locker(),
           m_avVppFrameOut(nullptr),
+          m_avVppFrameDepth(nullptr),
           m_vppInFormat(MFX_FOURCC_I420),
           m_vppInWidth(0),
           m_vppInHeight(0),
           m_vppOutFormat(MFX_FOURCC_I420),
           m_vppOutWidth(0),
           m_vppOutHeight(0),
+          m_vppGraphInFormat(MFX_FOURCC_I420),
+          m_depthMethod(MFX_CPU_DEPTH_CONVERSION_DEFAULT),
           m_vppFunc(0),
           m_param(),
           m_vppSurfacesIn(),
           m_vppSurfacesOut(),
+          m_memory(),
           m_session(nullptr) {
     memset(m_vpp_filter_desc, 0, sizeof(m_vpp_filter_desc));
 }
@@ -60,7 +65,7 @@ bool CpuVPP::InitFilters(void) {
              "video_size=%ux%u:pix_fmt=%d:time_base=%u/%u", //:pixel_aspect=1/1",
              (unsigned int)m_param.vpp.In.Width,
              (unsigned int)m_param.vpp.In.Height,
-             (int)MFXFourCC2AVPixelFormat(m_param.vpp.In.FourCC),
+             (int)MFXFourCC2AVPixelFormat(m_vppGraphInFormat),
              (unsigned int)m_param.vpp.In.FrameRateExtN,
              (unsigned int)m_param.vpp.In.FrameRateExtD);
 
@@ -181,12 +186,9 @@ bool CpuVPP::InitFilters(void) {
         }
 
         char pixel_format[50] = { 0 };
-        if (csc_dst_fmt == AV_PIX_FMT_YUV420P)
-            snprintf(pixel_format, sizeof(pixel_format), "format=pix_fmts=yuv420p");
-        else if (csc_dst_fmt == AV_PIX_FMT_YUV420P10LE)
-            snprintf(pixel_format, sizeof(pixel_format), "format=pix_fmts=yuv420p10le");
-        else if (csc_dst_fmt == AV_PIX_FMT_BGRA)
-            snprintf(pixel_format, sizeof(pixel_format), "format=pix_fmts=bgra");
+        const char *csc_dst_name = av_get_pix_fmt_name(csc_dst_fmt);
+        if (csc_dst_name)
+            snprintf(pixel_format, sizeof(pixel_format), "format=pix_fmts=%s", csc_dst_name);
 
         if (m_vppFunc == VPL_VPP_CSC) // there's no filter assigned
             snprintf(m_vpp_filter_desc, sizeof(m_vpp_filter_desc), "%s", pixel_format);
@@ -259,7 +261,7 @@ mfxStatus CpuVPP::ValidateVPPParams(mfxVideoParam *par, bool canCorrect) {
         if (par->Protected)
             par->Protected = 0;
 
-        if (par->NumExtParam)
+        if (par->NumExtParam && CheckExtParam(par->ExtParam, par->NumExtParam) != MFX_ERR_NONE)
             par->NumExtParam = 0;
 
         if (!par->vpp.Out.Width)
@@ -342,7 +344,7 @@ mfxStatus CpuVPP::ValidateVPPParams(mfxVideoParam *par, bool canCorrect) {
         if (par->Protected)
             return MFX_ERR_INVALID_VIDEO_PARAM;
 
-        if (par->NumExtParam)
+        if (CheckExtParam(par->ExtParam, par->NumExtParam) != MFX_ERR_NONE)
             return MFX_ERR_INVALID_VIDEO_PARAM;
 
         if (!par->vpp.Out.Width)
@@ -392,7 +394,7 @@ mfxStatus CpuVPP::ValidateVPPParams(mfxVideoParam *par, bool canCorrect) {
     if (par->Protected)
         return MFX_ERR_INVALID_VIDEO_PARAM;
 
-    if (par->NumExtParam)
+    if (CheckExtParam(par->ExtParam, par->NumExtParam) != MFX_ERR_NONE)
         return MFX_ERR_INVALID_VIDEO_PARAM;
 
     if (par->mfx.NumThread)
@@ -413,6 +415,14 @@ mfxStatus CpuVPP::InitVPP(mfxVideoParam *par) {
     mfxStatus valSts = ValidateVPPParams(par, false);
     RET_ERROR(valSts);
 
+    // pooled in/out surfaces plus one frame of each held by the filter graph
+    mfxFrameAllocRequest VPPRequest[2] = {};
+    VPPQueryIOSurf(nullptr, VPPRequest);
+    mfxU64 required =
+        GetFrameSizeBytes(&par->vpp.In) * (VPPRequest[VPP_IN].NumFrameSuggested + 1) +
+        GetFrameSizeBytes(&par->vpp.Out) * (VPPRequest[VPP_OUT].NumFrameSuggested + 1);
+    RET_ERROR(m_memory.Reserve(par, required));
+
     m_param = *par;
 
     m_param.vpp.In.CropW =
@@ -425,7 +435,19 @@ mfxStatus CpuVPP::InitVPP(mfxVideoParam *par) {
                                 ? m_param.vpp.Out.Height
                                 : m_param.vpp.Out.CropH;
 
-    if (m_param.vpp.In.FourCC != m_param.vpp.Out.FourCC) {
+    // 10 -> 8 bit reduction runs ahead of the filter graph, which then sees 8-bit input
+    m_vppGraphInFormat = m_param.vpp.In.FourCC;
+    if (IsDepthConversionSupported(m_param.vpp.In.FourCC, m_param.vpp.Out.FourCC)) {
+        mfxExtCpuVPPDepthConversion *depthConv = reinterpret_cast<mfxExtCpuVPPDepthConversion *>(
+            GetExtBuffer(m_param.ExtParam,
+                         m_param.NumExtParam,
+                         MFX_EXTBUFF_CPU_VPP_DEPTH_CONVERSION));
+        m_depthMethod      = depthConv ? depthConv->Method : MFX_CPU_DEPTH_CONVERSION_DEFAULT;
+        m_vppGraphInFormat = m_param.vpp.Out.FourCC;
+        m_vppFunc |= VPL_VPP_DEPTH;
+    }
+
+    if (m_vppGraphInFormat != m_param.vpp.Out.FourCC) {
         m_vppFunc |= VPL_VPP_CSC;
     }
 
@@ -446,13 +468,22 @@ mfxStatus CpuVPP::InitVPP(mfxVideoParam *par) {
         m_vppFunc |= VPL_VPP_SCALE;
     }
 
-    if (InitFilters() == false)
-        return MFX_ERR_NOT_INITIALIZED;
+    // depth reduction alone writes straight into the output surface, no graph needed
+    if (m_vppFunc != VPL_VPP_DEPTH) {
+        if (InitFilters() == false)
+            return MFX_ERR_NOT_INITIALIZED;
+    }
 
     m_avVppFrameOut = av_frame_alloc();
     if (!m_avVppFrameOut)
         return MFX_ERR_NOT_INITIALIZED;
 
+    if (m_vppFunc & VPL_VPP_DEPTH) {
+        m_avVppFrameDepth = av_frame_alloc();
+        if (!m_avVppFrameDepth)
+            return MFX_ERR_NOT_INITIALIZED;
+    }
+
     m_vppInFormat = m_param.vpp.In.FourCC;
     m_vppInWidth  = m_param.vpp.In.Width;
     m_vppInHeight = m_param.vpp.In.Height;
@@ -469,6 +500,10 @@ CpuVPP::~CpuVPP() {
         av_frame_free(&m_avVppFrameOut);
     }
 
+    if (m_avVppFrameDepth) {
+        av_frame_free(&m_avVppFrameDepth);
+    }
+
     if (m_vpp_graph) {
         avfilter_graph_free(&m_vpp_graph);
         m_vpp_graph = nullptr;
@@ -478,6 +513,9 @@ CpuVPP::~CpuVPP() {
 mfxStatus CpuVPP::ProcessFrame(mfxFrameSurface1 *surface_in,
                                mfxFrameSurface1 *surface_out,
                                mfxExtVppAuxData *aux) {
+    if (m_vppFunc == VPL_VPP_DEPTH)
+        return ProcessDepthOnly(surface_in, surface_out);
+
     bool bWA_alignment = false;
 
     // Try get AVFrame from surface_out
@@ -507,6 +545,13 @@ mfxStatus CpuVPP::ProcessFrame(mfxFrameSurface1 *surface_in,
             m_input_locker.GetAVFrame(surface_in, MFX_MAP_READ, m_session->GetFrameAllocator());
         RET_IF_FALSE(av_frame, MFX_ERR_ABORTED);
 
+        if (m_vppFunc & VPL_VPP_DEPTH) {
+            mfxStatus sts = ReduceInputDepth(av_frame);
+            m_input_locker.Unlock();
+            RET_ERROR(sts);
+            av_frame = m_avVppFrameDepth;
+        }
+
         int ret =
             av_buffersrc_add_frame_flags(m_buffersrc_ctx, av_frame, AV_BUFFERSRC_FLAG_KEEP_REF);
         m_input_locker.Unlock();
@@ -545,6 +590,60 @@ mfxStatus CpuVPP::ProcessFrame(mfxFrameSurface1 *surface_in,
     return MFX_ERR_NONE;
 }
 
+// reduce 10-bit input into m_avVppFrameDepth, which then goes to the filter graph
+mfxStatus CpuVPP::ReduceInputDepth(AVFrame *av_frame) {
+    RET_IF_FALSE(av_frame->width <= (int)m_vppInWidth && av_frame->height <= (int)m_vppInHeight,
+                 MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+
+    // graph may still reference the previous frame (e.g. crop output), get a fresh buffer then
+    if (!m_avVppFrameDepth->buf[0] || !av_frame_is_writable(m_avVppFrameDepth)) {
+        av_frame_unref(m_avVppFrameDepth);
+        m_avVppFrameDepth->format = MFXFourCC2AVPixelFormat(m_vppGraphInFormat);
+        m_avVppFrameDepth->width  = m_vppInWidth;
+        m_avVppFrameDepth->height = m_vppInHeight;
+        RET_IF_FALSE(av_frame_get_buffer(m_avVppFrameDepth, 0) == 0, MFX_ERR_MEMORY_ALLOC);
+    }
+
+    m_avVppFrameDepth->width  = av_frame->width;
+    m_avVppFrameDepth->height = av_frame->height;
+    m_avVppFrameDepth->pts    = av_frame->pts;
+
+    return ConvertFrameTo8Bit(av_frame, m_avVppFrameDepth, m_depthMethod);
+}
+
+// depth reduction is the only operation, write straight into the output surface
+mfxStatus CpuVPP::ProcessDepthOnly(mfxFrameSurface1 *surface_in, mfxFrameSurface1 *surface_out) {
+    // nothing is buffered, so there is nothing to drain
+    if (!surface_in)
+        return MFX_ERR_MORE_DATA;
+
+    CpuFrame *dst_frame = CpuFrame::TryCast(surface_out);
+    if (dst_frame && !dst_frame->GetAVFrame()->buf[0])
+        RET_ERROR(dst_frame->Allocate(m_vppOutFormat, m_vppOutWidth, m_vppOutHeight));
+
+    FrameLock output_locker;
+    AVFrame *dst_avframe =
+        output_locker.GetAVFrame(surface_out, MFX_MAP_WRITE, m_session->GetFrameAllocator());
+    RET_IF_FALSE(dst_avframe, MFX_ERR_ABORTED);
+
+    AVFrame *src_avframe =
+        m_input_locker.GetAVFrame(surface_in, MFX_MAP_READ, m_session->GetFrameAllocator());
+    RET_IF_FALSE(src_avframe, MFX_ERR_ABORTED);
+
+    mfxStatus sts = ConvertFrameTo8Bit(src_avframe, dst_avframe, m_depthMethod);
+    m_input_locker.Unlock();
+    RET_ERROR(sts);
+
+    if (dst_frame)
+        dst_frame->Update();
+
+    if (surface_in->Data.TimeStamp) {
+        surface_out->Data.TimeStamp = surface_in->Data.TimeStamp;
+        surface_out->Data.DataFlag  = MFX_FRAMEDATA_ORIGINAL_TIMESTAMP;
+    }
+    return MFX_ERR_NONE;
+}
+
 mfxStatus CpuVPP::VPPQuery(mfxVideoParam *in, mfxVideoParam *out) {
     mfxStatus sts = MFX_ERR_NONE;
 
@@ -659,6 +758,8 @@ mfxStatus CpuVPP::CheckFrameInfo(mfxFrameInfo *info) {
         case MFX_FOURCC_BGRA:
         case MFX_FOURCC_I420:
         case MFX_FOURCC_I010:
+        case MFX_FOURCC_NV12:
+        case MFX_FOURCC_P010:
             break;
         default:
             return MFX_ERR_INVALID_VIDEO_PARAM;
@@ -689,6 +790,38 @@ mfxStatus CpuVPP::CheckFrameInfo(mfxFrameInfo *info) {
     return MFX_ERR_NONE;
 }
 
+// only extension buffers handled by this runtime are accepted
+mfxStatus CpuVPP::CheckExtParam(mfxExtBuffer **ppExtParam, mfxU16 count) {
+    if (!count)
+        return MFX_ERR_NONE;
+
+    RET_IF_FALSE(ppExtParam, MFX_ERR_NULL_PTR);
+
+    for (mfxU16 i = 0; i < count; i++) {
+        RET_IF_FALSE(ppExtParam[i], MFX_ERR_NULL_PTR);
+
+        switch (ppExtParam[i]->BufferId) {
+            case MFX_EXTBUFF_CPU_VPP_DEPTH_CONVERSION: {
+                RET_IF_FALSE(ppExtParam[i]->BufferSz == sizeof(mfxExtCpuVPPDepthConversion),
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                mfxExtCpuVPPDepthConversion *depthConv =
+                    reinterpret_cast<mfxExtCpuVPPDepthConversion *>(ppExtParam[i]);
+                RET_IF_FALSE(depthConv->Method <= MFX_CPU_DEPTH_CONVERSION_TRUNCATE,
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                break;
+            }
+            case MFX_EXTBUFF_CPU_MEMORY_BUDGET:
+                RET_IF_FALSE(ppExtParam[i]->BufferSz == sizeof(mfxExtCpuMemoryBudget),
+                             MFX_ERR_INVALID_VIDEO_PARAM);
+                break;
+            default:
+                return MFX_ERR_INVALID_VIDEO_PARAM;
+        }
+    }
+
+    return MFX_ERR_NONE;
+}
+
 mfxStatus CpuVPP::GetVideoParam(mfxVideoParam *par) {
     *par = m_param;
 
@@ -817,6 +950,18 @@ bool CpuVPP::NeedWAForAlignment(mfxFrameInfo *fi, int *linesize) {
             return true;
         }
     }
+    else if (fi->FourCC == MFX_FOURCC_NV12) {
+        // check the UV pitch size of output surface and output avframe
+        if (fi->Width != linesize[1]) {
+            return true;
+        }
+    }
+    else if (fi->FourCC == MFX_FOURCC_P010) {
+        // check the UV pitch size of output surface and output avframe
+        if (fi->Width * 2 != linesize[1]) {
+            return true;
+        }
+    }
     else { // bgra
         // check the bgra pitch size of output surface and output avframe
         if (fi->Width * 4 != linesize[0]) {
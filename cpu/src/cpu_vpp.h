@@ -19,7 +19,8 @@ typedef enum {
     VPL_VPP_CROP      = 4,
     VPL_VPP_COMPOSITE = 8,
     VPL_VPP_SHARP     = 16,
-    VPL_VPP_BLUR      = 32
+    VPL_VPP_BLUR      = 32,
+    VPL_VPP_DEPTH     = 64
 } eVPPfunction;
 
 typedef struct {
@@ -78,6 +79,7 @@ private:
     AVFilterContext *m_buffersink_ctx;
     FrameLock m_input_locker;
     AVFrame *m_avVppFrameOut;
+    AVFrame *m_avVppFrameDepth; // 8-bit copy of 10-bit input, feeds the filter graph
 
     mfxU32 m_vppInFormat;
     mfxU32 m_vppInWidth;
@@ -87,12 +89,18 @@ private:
     mfxU32 m_vppOutWidth;
     mfxU32 m_vppOutHeight;
 
+    mfxU32 m_vppGraphInFormat;
+    mfxU16 m_depthMethod;
+
     mfxU32 m_vppFunc;
     mfxVideoParam m_param;
     std::unique_ptr<CpuFramePool> m_vppSurfacesIn;
     std::unique_ptr<CpuFramePool> m_vppSurfacesOut;
+    CpuMemoryReservation m_memory;
 
     bool InitFilters(void);
+    mfxStatus ReduceInputDepth(AVFrame *av_frame);
+    mfxStatus ProcessDepthOnly(mfxFrameSurface1 *surface_in, mfxFrameSurface1 *surface_out);
     void CloseFilterPads(AVFilterInOut *src_out, AVFilterInOut *sink_in);
     static mfxStatus CheckIOPattern_AndSetIOMemTypes(mfxU16 IOPattern,
                                                      mfxU16 *pInMemType,
@@ -121,7 +129,7 @@ private:
     mfxStatus GetFilterParam(mfxVideoParam *par, mfxU32 filterName, mfxExtBuffer **ppHint);
     void GetDoNotUseFilterList(mfxVideoParam *par, mfxU32 **ppList, mfxU32 *pLen);
     bool CheckFilterList(mfxU32 *pList, mfxU32 count, bool bDoUseTable);
-    mfxStatus CheckExtParam(mfxExtBuffer **ppExtParam, mfxU16 count);
+    static mfxStatus CheckExtParam(mfxExtBuffer **ppExtParam, mfxU16 count);
     bool NeedWAForAlignment(mfxFrameInfo *fi, int *linesize);
 
     CpuWorkstream *m_session;
@@ -5,13 +5,17 @@
   ############################################################################*/
 
 #include "src/cpu_workstream.h"
+#include "src/cpu_batch_pool.h"
 #include "src/cpu_common.h"
 
 CpuWorkstream::CpuWorkstream() : m_allocator({}) {
     av_log_set_level(AV_LOG_QUIET);
+    CpuBatchPool::AddSession();
 }
 
-CpuWorkstream::~CpuWorkstream() {}
+CpuWorkstream::~CpuWorkstream() {
+    CpuBatchPool::ReleaseSession();
+}
 
 mfxStatus CpuWorkstream::Sync(mfxSyncPoint &syncp, mfxU32 wait) {
     return MFX_ERR_NONE;
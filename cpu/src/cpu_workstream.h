@@ -9,6 +9,7 @@
 
 #include <map>
 #include <memory>
+#include <vector>
 #include "src/cpu_common.h"
 #include "src/cpu_decode.h"
 #include "src/cpu_decodevpp.h"
@@ -48,6 +49,11 @@ public:
         return m_decvpp.get();
     }
 
+    // stream bytes taken by decode lazy init while the headers are incomplete
+    std::vector<mfxU8> &GetDecodeInitData() {
+        return m_decodeInitData;
+    }
+
     mfxStatus Sync(mfxSyncPoint &syncp, mfxU32 wait);
 
     mfxStatus SetFrameAllocator(mfxFrameAllocator *allocator) {
@@ -80,6 +86,7 @@ private:
     std::unique_ptr<CpuEncode> m_encode;
     std::unique_ptr<CpuVPP> m_vpp;
     std::unique_ptr<CpuDecodeVPP> m_decvpp;
+    std::vector<mfxU8> m_decodeInitData;
 
     mfxFrameAllocator m_allocator;
     std::map<mfxHandleType, mfxHDL> m_handles;
@@ -85,6 +85,11 @@ AVFrame *FrameLock::GetAVFrame(mfxFrameSurface1 *surface,
             if (surface->Info.FourCC == MFX_FOURCC_RGB4) {
                 avframe->data[0] = surface->Data.B;
             }
+            else if (surface->Info.FourCC == MFX_FOURCC_NV12 ||
+                     surface->Info.FourCC == MFX_FOURCC_P010) {
+                avframe->data[0] = surface->Data.Y;
+                avframe->data[1] = surface->Data.UV;
+            }
             else {
                 avframe->data[0] = surface->Data.Y;
                 avframe->data[1] = surface->Data.U;
@@ -111,6 +116,12 @@ AVFrame *FrameLock::GetAVFrame(mfxFrameSurface1 *surface,
     if (info->FourCC == MFX_FOURCC_RGB4) {
         m_avframe->data[0] = m_data->B;
     }
+    else if (info->FourCC == MFX_FOURCC_NV12 || info->FourCC == MFX_FOURCC_P010) {
+        m_avframe->data[0] = m_data->Y;
+        m_avframe->data[1] = m_data->UV;
+        m_avframe->data[2] = nullptr;
+        m_avframe->data[3] = nullptr;
+    }
     else {
         m_avframe->data[0] = m_data->Y;
         m_avframe->data[1] = m_data->U;
@@ -125,6 +136,7 @@ AVFrame *FrameLock::GetAVFrame(mfxFrameSurface1 *surface,
             m_avframe->linesize[2] = m_data->Pitch / 2;
             break;
         case MFX_FOURCC_NV12:
+        case MFX_FOURCC_P010:
             m_avframe->linesize[1] = m_data->Pitch;
             break;
         case MFX_FOURCC_YUY2:
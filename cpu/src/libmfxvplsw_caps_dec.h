@@ -16,8 +16,8 @@ const mfxU32 decColorFmt_c00_p00_m00[] = {
 const DecMemDesc decMemDesc_c00_p00[] = {
     {
         MFX_RESOURCE_SYSTEM_SURFACE,
-        { 64, 4096, 8 },
-        { 64, 4096, 8 },
+        { 64, 16384, 8 },
+        { 64, 8704, 8 },
         {},
         2,
         (mfxU32 *)decColorFmt_c00_p00_m00,
@@ -40,8 +40,8 @@ const mfxU32 decColorFmt_c01_p00_m00[] = {
 const DecMemDesc decMemDesc_c01_p00[] = {
     {
         MFX_RESOURCE_SYSTEM_SURFACE,
-        { 64, 4096, 8 },
-        { 64, 4096, 8 },
+        { 64, 8192, 8 },
+        { 64, 4320, 8 },
         {},
         1,
         (mfxU32 *)decColorFmt_c01_p00_m00,
@@ -64,8 +64,8 @@ const mfxU32 decColorFmt_c02_p00_m00[] = {
 const DecMemDesc decMemDesc_c02_p00[] = {
     {
         MFX_RESOURCE_SYSTEM_SURFACE,
-        { 64, 4096, 8 },
-        { 64, 4096, 8 },
+        { 64, 8192, 8 },
+        { 64, 4320, 8 },
         {},
         1,
         (mfxU32 *)decColorFmt_c02_p00_m00,
@@ -79,8 +79,8 @@ const mfxU32 decColorFmt_c02_p01_m00[] = {
 const DecMemDesc decMemDesc_c02_p01[] = {
     {
         MFX_RESOURCE_SYSTEM_SURFACE,
-        { 64, 4096, 8 },
-        { 64, 4096, 8 },
+        { 64, 8192, 8 },
+        { 64, 4320, 8 },
         {},
         1,
         (mfxU32 *)decColorFmt_c02_p01_m00,
@@ -109,8 +109,8 @@ const mfxU32 decColorFmt_c03_p00_m00[] = {
 const DecMemDesc decMemDesc_c03_p00[] = {
     {
         MFX_RESOURCE_SYSTEM_SURFACE,
-        { 64, 4096, 8 },
-        { 64, 4096, 8 },
+        { 64, 16384, 8 },
+        { 64, 16384, 8 },
         {},
         1,
         (mfxU32 *)decColorFmt_c03_p00_m00,
@@ -130,21 +130,21 @@ const DecCodec decCodec[] = {
     {
         MFX_CODEC_AV1,
         {},
-        MFX_LEVEL_AV1_53,
+        MFX_LEVEL_AV1_63,
         1,
         (DecProfile *)decProfile_c00,
     },
     {
         MFX_CODEC_AVC,
         {},
-        MFX_LEVEL_AVC_52,
+        MFX_LEVEL_AVC_62,
         1,
         (DecProfile *)decProfile_c01,
     },
     {
         MFX_CODEC_HEVC,
         {},
-        MFX_LEVEL_HEVC_51,
+        MFX_LEVEL_HEVC_62,
         2,
         (DecProfile *)decProfile_c02,
     },
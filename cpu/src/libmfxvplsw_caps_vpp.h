@@ -47,8 +47,8 @@ const VPPFormat vppFormatIn_f00_m00[] = {
 const VPPMemDesc vppMemDesc_f00[] = {
     {
         MFX_RESOURCE_SYSTEM_SURFACE,
-        { 64, 4096, 8 },
-        { 64, 4096, 8 },
+        { 64, 16384, 8 },
+        { 64, 16384, 8 },
         {},
         3,
         (VPPFormat *)vppFormatIn_f00_m00,
@@ -91,8 +91,8 @@ const VPPFormat vppFormatIn_f01_m00[] = {
 const VPPMemDesc vppMemDesc_f01[] = {
     {
         MFX_RESOURCE_SYSTEM_SURFACE,
-        { 64, 4096, 8 },
-        { 64, 4096, 8 },
+        { 64, 16384, 8 },
+        { 64, 16384, 8 },
         {},
         3,
         (VPPFormat *)vppFormatIn_f01_m00,
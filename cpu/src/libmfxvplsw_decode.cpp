@@ -4,10 +4,33 @@
   # SPDX-License-Identifier: MIT
   ############################################################################*/
 
+#include "./cpu_batch_pool.h"
+#include "./cpu_bitstream_buffer.h"
+#include "./cpu_bitstream_reader.h"
 #include "./cpu_workstream.h"
 #include "vpl/mfxvideo.h"
 
-// NOTES - for now, just do init, decode the first frame, get params, close codec
+#if defined(_WIN32) || defined(_WIN64)
+    #include <io.h>
+#else
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+#endif
+
+// appends the readable bytes of bs, a ring in two parts if it wraps
+static void CopyBitstreamData(const mfxBitstream *bs, std::vector<mfxU8> *data) {
+    mfxU32 first = bs->DataLength;
+    if (bs->DataFlag & MFX_CPU_BITSTREAM_RING)
+        first = std::min(first, bs->MaxLength - bs->DataOffset);
+
+    const mfxU8 *start = bs->Data + bs->DataOffset;
+    data->insert(data->end(), start, start + first);
+    data->insert(data->end(), bs->Data, bs->Data + (bs->DataLength - first));
+}
+
+// NOTES - parse the sequence headers only, no decoder is opened and no frame decoded
 //
 // Differences vs. MSDK 1.0 spec
 // - codec init does not happen here, just header parsing
@@ -24,6 +47,20 @@ mfxStatus MFXVideoDECODE_DecodeHeader(mfxSession session, mfxBitstream *bs, mfxV
 
     CpuWorkstream *ws = reinterpret_cast<CpuWorkstream *>(session);
 
+    // the probe needs a wrapped ring in one piece, bs is not modified either way
+    std::vector<mfxU8> linear;
+    mfxBitstream flat = {};
+    if (bs->DataFlag & MFX_CPU_BITSTREAM_RING) {
+        RET_IF_FALSE(bs->DataOffset < bs->MaxLength && bs->DataLength <= bs->MaxLength,
+                     MFX_ERR_UNDEFINED_BEHAVIOR);
+        CopyBitstreamData(bs, &linear);
+        flat.Data       = linear.data();
+        flat.DataLength = (mfxU32)linear.size();
+        flat.MaxLength  = flat.DataLength;
+        flat.CodecId    = bs->CodecId;
+        bs              = &flat;
+    }
+
     std::unique_ptr<CpuDecode> decoder(new CpuDecode(ws));
     RET_IF_FALSE(decoder, MFX_ERR_MEMORY_ALLOC);
     RET_ERROR(decoder->InitDecode(par, bs));
@@ -97,6 +134,9 @@ mfxStatus MFXVideoDECODE_Close(mfxSession session) {
 
     CpuWorkstream *ws = reinterpret_cast<CpuWorkstream *>(session);
 
+    // also drops the data of a lazy init still waiting for headers
+    std::vector<mfxU8>().swap(ws->GetDecodeInitData());
+
     if (ws->GetDecoder() != nullptr)
         ws->SetDecoder(nullptr);
     else
@@ -105,7 +145,56 @@ mfxStatus MFXVideoDECODE_Close(mfxSession session) {
     return MFX_ERR_NONE;
 }
 
-// NOTES -
+// lazy init. Complete frames carry their headers, streamed input is taken from bs and
+// kept until the headers are complete, so small reads need not be held by the app.
+// The kept data is decoded before any new input.
+static mfxStatus InitDecodeFromStream(mfxSession session, mfxBitstream *bs) {
+    CpuWorkstream *ws   = reinterpret_cast<CpuWorkstream *>(session);
+    mfxVideoParam param = { 0 };
+    param.mfx.CodecId   = bs->CodecId;
+
+    bool isRing = (bs->DataFlag & MFX_CPU_BITSTREAM_RING) != 0;
+    if ((bs->DataFlag & MFX_BITSTREAM_COMPLETE_FRAME) && !isRing) {
+        RET_ERROR(MFXVideoDECODE_DecodeHeader(session, bs, &param));
+        return MFXVideoDECODE_Init(session, &param);
+    }
+    if (isRing) {
+        RET_IF_FALSE(bs->DataOffset < bs->MaxLength && bs->DataLength <= bs->MaxLength,
+                     MFX_ERR_UNDEFINED_BEHAVIOR);
+    }
+
+    std::vector<mfxU8> &data = ws->GetDecodeInitData();
+    CopyBitstreamData(bs, &data);
+    bs->DataOffset += bs->DataLength;
+    bs->DataLength = 0;
+    if (isRing)
+        bs->DataOffset %= bs->MaxLength;
+
+    // nothing before the first parameter set can be decoded
+    mfxU32 start = CpuDecode::FindHeaderStart(bs->CodecId, data.data(), (mfxU32)data.size());
+    data.erase(data.begin(), data.begin() + start);
+    if (data.size() > DECODE_INIT_MAX_DATA) {
+        std::vector<mfxU8>().swap(data);
+        return MFX_ERR_NOT_ENOUGH_BUFFER;
+    }
+
+    mfxBitstream header = {};
+    header.Data         = data.data();
+    header.DataLength   = (mfxU32)data.size();
+    header.MaxLength    = header.DataLength;
+    header.CodecId      = bs->CodecId;
+    RET_ERROR(MFXVideoDECODE_DecodeHeader(session, &header, &param));
+    RET_ERROR(MFXVideoDECODE_Init(session, &param));
+
+    ws->GetDecoder()->SetPendingInput(data);
+    std::vector<mfxU8>().swap(data);
+    return MFX_ERR_NONE;
+}
+
+// NOTES - with MFX_BITSTREAM_COMPLETE_FRAME, frames in buffers from MFXBitstream_GetBuffer()
+//   are decoded without a copy. In the app's own buffer AV_INPUT_BUFFER_PADDING_SIZE (64)
+//   zero bytes after the data (within MaxLength) do the same for AVC and HEVC, as long as
+//   the decoder runs without frame threads.
 //
 // Differences vs. MSDK 1.0 spec
 // -
@@ -124,11 +213,8 @@ mfxStatus MFXVideoDECODE_DecodeFrameAsync(mfxSession session,
         // Only 2.0 API permits lazy init - requires internal memory management
         RET_IF_FALSE(surface_work == 0, MFX_ERR_NOT_INITIALIZED);
 
-        mfxVideoParam param = { 0 };
         RET_IF_FALSE(bs, MFX_ERR_NULL_PTR);
-        param.mfx.CodecId = bs->CodecId;
-        RET_ERROR(MFXVideoDECODE_DecodeHeader(session, bs, &param));
-        RET_ERROR(MFXVideoDECODE_Init(session, &param));
+        RET_ERROR(InitDecodeFromStream(session, bs));
         decoder = ws->GetDecoder();
     }
 
@@ -148,8 +234,8 @@ mfxStatus MFXVideoDECODE_DecodeFrameAsync(mfxSession session,
     }
 
     // application will not know to release surface (e.g. if we
-    //   need more data) so need to release it here
-    if (bInternalMem && sts != MFX_ERR_NONE) {
+    //   need more data, or no frame is returned) so need to release it here
+    if (bInternalMem && (sts != MFX_ERR_NONE || !*surface_out)) {
         surface_work->FrameInterface->Release(surface_work);
     }
 
@@ -179,25 +265,189 @@ mfxStatus MFXVideoDECODE_Reset(mfxSession session, mfxVideoParam *par) {
     CpuDecode *decoder = ws->GetDecoder();
     RET_IF_FALSE(decoder, MFX_ERR_NOT_INITIALIZED);
 
+    // flush only, the rest of par is ignored
+    mfxExtCpuDecodeFlush *flush = reinterpret_cast<mfxExtCpuDecodeFlush *>(
+        GetExtBuffer(par->ExtParam, par->NumExtParam, MFX_EXTBUFF_CPU_DECODE_FLUSH));
+    if (flush) {
+        RET_ERROR(CpuDecode::CheckExtParam(par->ExtParam, par->NumExtParam));
+        return decoder->FlushDecode(flush->Mode == MFX_CPU_DECODE_FLUSH_SKIP_TO_RAP);
+    }
+
     RET_ERROR(decoder->CheckVideoParamDecoders(par));
     mfxVideoParam oldParam = { 0 };
     decoder->GetVideoParam(&oldParam);
     RET_ERROR(decoder->IsSameVideoParam(par, &oldParam));
 
+    if (decoder->CanResetInPlace(par))
+        return decoder->ResetDecode(par);
+
     RET_ERROR(MFXVideoDECODE_Close(session));
     return MFXVideoDECODE_Init(session, par);
 }
 
-// stubs
 mfxStatus MFXVideoDECODE_GetDecodeStat(mfxSession session, mfxDecodeStat *stat) {
     VPL_TRACE_FUNC;
-    return MFX_ERR_NOT_IMPLEMENTED;
+    RET_IF_FALSE(session, MFX_ERR_INVALID_HANDLE);
+    RET_IF_FALSE(stat, MFX_ERR_NULL_PTR);
+
+    CpuWorkstream *ws  = reinterpret_cast<CpuWorkstream *>(session);
+    CpuDecode *decoder = ws->GetDecoder();
+    RET_IF_FALSE(decoder, MFX_ERR_NOT_INITIALIZED);
+
+    return decoder->GetDecodeStat(stat);
 }
+
 mfxStatus MFXVideoDECODE_SetSkipMode(mfxSession session, mfxSkipMode mode) {
     VPL_TRACE_FUNC;
-    return MFX_ERR_NOT_IMPLEMENTED;
+    RET_IF_FALSE(session, MFX_ERR_INVALID_HANDLE);
+
+    CpuWorkstream *ws  = reinterpret_cast<CpuWorkstream *>(session);
+    CpuDecode *decoder = ws->GetDecoder();
+    RET_IF_FALSE(decoder, MFX_ERR_NOT_INITIALIZED);
+
+    return decoder->SetSkipMode(mode);
 }
+
 mfxStatus MFXVideoDECODE_GetPayload(mfxSession session, mfxU64 *ts, mfxPayload *payload) {
     VPL_TRACE_FUNC;
-    return MFX_ERR_NOT_IMPLEMENTED;
+    RET_IF_FALSE(session, MFX_ERR_INVALID_HANDLE);
+    RET_IF_FALSE(ts && payload, MFX_ERR_NULL_PTR);
+    RET_IF_FALSE(payload->Data || !payload->BufSize, MFX_ERR_NULL_PTR);
+
+    CpuWorkstream *ws  = reinterpret_cast<CpuWorkstream *>(session);
+    CpuDecode *decoder = ws->GetDecoder();
+    RET_IF_FALSE(decoder, MFX_ERR_NOT_INITIALIZED);
+
+    return decoder->GetPayload(ts, payload);
+}
+
+// NOTES - CPU runtime extension, see mfxcpu.h
+//   the streams are independent, so each item is one task on the shared pool
+mfxStatus MFXVideoDECODE_DecodeFrameBatch(mfxCpuDecodeBatchItem *items, mfxU32 count) {
+    VPL_TRACE_FUNC;
+    RET_IF_FALSE(items || !count, MFX_ERR_NULL_PTR);
+
+    // a session is not thread safe
+    std::vector<mfxSession> sessions(count);
+    for (mfxU32 i = 0; i < count; i++)
+        sessions[i] = items[i].Session;
+    std::sort(sessions.begin(), sessions.end());
+    RET_IF_FALSE(std::adjacent_find(sessions.begin(), sessions.end()) == sessions.end(),
+                 MFX_ERR_UNDEFINED_BEHAVIOR);
+
+    CpuBatchPool::GetInstance().Run(count, [items](mfxU32 i) {
+        mfxSyncPoint syncp  = nullptr;
+        items[i].SurfaceOut = nullptr;
+        items[i].Status     = MFXVideoDECODE_DecodeFrameAsync(items[i].Session,
+                                                          items[i].Bitstream,
+                                                          nullptr,
+                                                          &items[i].SurfaceOut,
+                                                          &syncp);
+    });
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus MFXBitstream_FillRing(mfxBitstream *bs, int fd, mfxU32 *bytesRead) {
+    VPL_TRACE_FUNC;
+    RET_IF_FALSE(bs && bytesRead, MFX_ERR_NULL_PTR);
+    RET_IF_FALSE(bs->Data, MFX_ERR_NULL_PTR);
+    RET_IF_FALSE(bs->DataFlag & MFX_CPU_BITSTREAM_RING, MFX_ERR_UNSUPPORTED);
+    RET_IF_FALSE(bs->DataOffset < bs->MaxLength && bs->DataLength <= bs->MaxLength,
+                 MFX_ERR_UNDEFINED_BEHAVIOR);
+
+    *bytesRead = 0;
+
+    // free space starts after the data, the part past the end continues at Data[0]
+    mfxU32 space = bs->MaxLength - bs->DataLength;
+    RET_IF_FALSE(space, MFX_ERR_NOT_ENOUGH_BUFFER);
+
+    mfxU32 writePos = (bs->DataOffset + bs->DataLength) % bs->MaxLength;
+    mfxU32 first    = std::min(space, bs->MaxLength - writePos);
+    mfxU32 second   = space - first;
+
+#if defined(_WIN32) || defined(_WIN64)
+    // no vectored read, the wrapped part only if the first one was filled
+    int ret = _read(fd, bs->Data + writePos, first);
+    RET_IF_FALSE(ret >= 0, MFX_ERR_UNKNOWN);
+    mfxU32 total = (mfxU32)ret;
+    if (total == first && second) {
+        ret = _read(fd, bs->Data, second);
+        RET_IF_FALSE(ret >= 0, MFX_ERR_UNKNOWN);
+        total += (mfxU32)ret;
+    }
+#else
+    struct iovec iov[2];
+    iov[0].iov_base = bs->Data + writePos;
+    iov[0].iov_len  = first;
+    iov[1].iov_base = bs->Data;
+    iov[1].iov_len  = second;
+
+    // start position for the read ahead, pipes and sockets have none
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+
+    ssize_t ret;
+    do {
+        ret = readv(fd, iov, second ? 2 : 1);
+    } while (ret < 0 && errno == EINTR);
+    RET_IF_FALSE(ret >= 0, MFX_ERR_UNKNOWN);
+    mfxU32 total = (mfxU32)ret;
+
+    // the ring will take about as much again once the decoder has consumed it
+    if (pos >= 0 && total)
+        posix_fadvise(fd, pos + total, space, POSIX_FADV_WILLNEED);
+#endif
+
+    bs->DataLength += total;
+    *bytesRead = total;
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus MFXBitstream_GetBuffer(mfxU32 size, mfxBitstream *bs) {
+    VPL_TRACE_FUNC;
+    RET_IF_FALSE(bs, MFX_ERR_NULL_PTR);
+    return CpuBitstreamBuffers::GetBuffer(size, bs);
+}
+
+mfxStatus MFXBitstream_ReleaseBuffer(mfxBitstream *bs) {
+    VPL_TRACE_FUNC;
+    RET_IF_FALSE(bs, MFX_ERR_NULL_PTR);
+    return CpuBitstreamBuffers::ReleaseBuffer(bs);
+}
+
+mfxStatus MFXBitstreamReader_Open(const char *path,
+                                  mfxU32 codecId,
+                                  mfxCpuBitstreamReader *reader,
+                                  mfxU32 *numFrames) {
+    VPL_TRACE_FUNC;
+    RET_IF_FALSE(path && reader, MFX_ERR_NULL_PTR);
+
+    std::unique_ptr<CpuBitstreamReader> fileReader(new CpuBitstreamReader);
+    mfxStatus sts = fileReader->Open(path, codecId);
+    RET_IF_FALSE(sts == MFX_ERR_NONE, sts);
+
+    if (numFrames)
+        *numFrames = fileReader->GetNumFrames();
+    *reader = reinterpret_cast<mfxCpuBitstreamReader>(fileReader.release());
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus MFXBitstreamReader_GetFrame(mfxCpuBitstreamReader reader, mfxBitstream *bs) {
+    RET_IF_FALSE(reader, MFX_ERR_INVALID_HANDLE);
+    return reinterpret_cast<CpuBitstreamReader *>(reader)->GetFrame(bs);
+}
+
+mfxStatus MFXBitstreamReader_Rewind(mfxCpuBitstreamReader reader) {
+    RET_IF_FALSE(reader, MFX_ERR_INVALID_HANDLE);
+    reinterpret_cast<CpuBitstreamReader *>(reader)->Rewind();
+    return MFX_ERR_NONE;
+}
+
+mfxStatus MFXBitstreamReader_Close(mfxCpuBitstreamReader reader) {
+    VPL_TRACE_FUNC;
+    RET_IF_FALSE(reader, MFX_ERR_INVALID_HANDLE);
+    delete reinterpret_cast<CpuBitstreamReader *>(reader);
+    return MFX_ERR_NONE;
 }
@@ -79,6 +79,19 @@ mfxStatus MFXVideoENCODE_EncodeFrameAsync(mfxSession session,
     return sts;
 }
 
+// returns a packet lent in MFX_CPU_ENCODE_OUTPUT_REFERENCE mode
+mfxStatus MFXVideoENCODE_ReleaseBitstream(mfxSession session, mfxBitstream *bs) {
+    VPL_TRACE_FUNC;
+    RET_IF_FALSE(session, MFX_ERR_INVALID_HANDLE);
+    RET_IF_FALSE(bs, MFX_ERR_NULL_PTR);
+
+    CpuWorkstream *ws  = reinterpret_cast<CpuWorkstream *>(session);
+    CpuEncode *encoder = ws->GetEncoder();
+    RET_IF_FALSE(encoder, MFX_ERR_NOT_INITIALIZED);
+
+    return encoder->ReleaseBitstream(bs);
+}
+
 // stubs
 mfxStatus MFXVideoENCODE_Reset(mfxSession session, mfxVideoParam *par) {
     VPL_TRACE_FUNC;
@@ -142,6 +142,8 @@ static const mfxImplDescription *cpuImplDescArray[NUM_CPU_IMPLS] = {
 };
 
 // should match libvplsw.def (unless any are not actually implemented, of course)
+// the CPU extensions exported there are not API functions the dispatcher could look up,
+// so they are not listed
 static const mfxChar *cpuImplFuncsNames[] = {
     "MFXInit",
     "MFXClose",
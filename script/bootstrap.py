@@ -487,6 +487,20 @@ def bootstrap(clean, use_gpl, build_mode, proj_dir, arch, validation):
                             'am',
                             patch.path,
                             xenv=GIT_ENV)
+            if use_gpl:
+                if os.path.isfile("x264-frame-qp-patched"):
+                    print("x264 frame QP patch already applied")
+                else:
+                    # libx264 takes AVFrame.quality as the QP of that frame, the
+                    # runtime sets it from mfxEncodeCtrl.QP
+                    replace(
+                        os.path.join('libavcodec', 'libx264.c'),
+                        '        reconfig_encoder(ctx, frame);',
+                        '        if (frame->quality > 0)\n'
+                        '            x4->pic.i_qpplus1 = '
+                        'frame->quality / FF_QP2LAMBDA + 1;\n'
+                        '        reconfig_encoder(ctx, frame);')
+                    cmd('touch', 'x264-frame-qp-patched')
 
             configure_opts = []
             configure_opts.extend(
@@ -33,7 +33,7 @@ static const TestPropVal TestPropIntTab[] = {
     { MFX_VARIANT_TYPE_U16, "mfxImplDescription.mfxDeviceDescription.device.MediaAdapterType",                      MFX_MEDIA_UNKNOWN, MFX_MEDIA_INTEGRATED },
 
     { MFX_VARIANT_TYPE_U32, "mfxImplDescription.mfxDecoderDescription.decoder.CodecID",                             MFX_CODEC_AVC, MFX_CODEC_VC1 },
-    { MFX_VARIANT_TYPE_U16, "mfxImplDescription.mfxDecoderDescription.decoder.MaxcodecLevel",                       MFX_LEVEL_AVC_52, MFX_LEVEL_AVC_62 },
+    { MFX_VARIANT_TYPE_U16, "mfxImplDescription.mfxDecoderDescription.decoder.MaxcodecLevel",                       MFX_LEVEL_AVC_62, MFX_LEVEL_AVC_52 },
     { MFX_VARIANT_TYPE_U32, "mfxImplDescription.mfxDecoderDescription.decoder.decprofile.Profile",                  MFX_PROFILE_AVC_HIGH, MFX_PROFILE_AVC_HIGH_422 },
     { MFX_VARIANT_TYPE_U32, "mfxImplDescription.mfxDecoderDescription.decoder.decprofile.decmemdesc.MemHandleType", MFX_RESOURCE_SYSTEM_SURFACE, MFX_RESOURCE_DX12_RESOURCE },
     { MFX_VARIANT_TYPE_U32, "mfxImplDescription.mfxDecoderDescription.decoder.decprofile.decmemdesc.ColorFormats",  MFX_FOURCC_I420, MFX_FOURCC_NV12 },
@@ -63,7 +63,7 @@ struct TestPropPtr {
 
 static const mfxRange32U cpuRangeValid         = { 64, 4096, 8 };
 static const mfxRange32U cpuRangeInvalidMin    = { 32, 4096, 8 };
-static const mfxRange32U cpuRangeInvalidMax    = { 64, 9000, 8 };
+static const mfxRange32U cpuRangeInvalidMax    = { 64, 32768, 8 };
 static const mfxRange32U cpuRangeInvalidStep   = { 64, 4096, 4 };
 
 static const TestPropPtr TestPropPtrTab[] = {
@@ -4,8 +4,16 @@
   # SPDX-License-Identifier: MIT
   ############################################################################*/
 
+#if defined(_WIN32) || defined(_WIN64)
+    #include <windows.h>
+#else
+    #include <dlfcn.h>
+#endif
+
 #include <gtest/gtest.h>
 #include <tuple>
+#include "api/test_bitstreams.h"
+#include "vpl/mfxcpu.h"
 #include "vpl/mfxvideo.h"
 
 // MFXInit tests
@@ -145,6 +153,90 @@ TEST(QueryVersion, NullSessionReturnsInvalidHandle) {
     ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
 }
 
+// the runtime loaded and unloaded on its own, as the dispatcher does it
+// already loaded when the test links against it, then unloading only drops a reference
+#if defined(_WIN32) || defined(_WIN64)
+typedef HMODULE RuntimeLibrary;
+
+static RuntimeLibrary LoadRuntime() {
+    return LoadLibraryA((sizeof(void *) == 8) ? "libvplswref64.dll" : "libvplswref32.dll");
+}
+
+static void *GetRuntimeFunc(RuntimeLibrary lib, const char *name) {
+    return reinterpret_cast<void *>(GetProcAddress(lib, name));
+}
+
+static bool UnloadRuntime(RuntimeLibrary lib) {
+    return FreeLibrary(lib) != 0;
+}
+#else
+typedef void *RuntimeLibrary;
+
+static RuntimeLibrary LoadRuntime() {
+    return dlopen((sizeof(void *) == 8) ? "libvplswref64.so.1" : "libvplswref32.so.1",
+                  RTLD_NOW | RTLD_LOCAL);
+}
+
+static void *GetRuntimeFunc(RuntimeLibrary lib, const char *name) {
+    return dlsym(lib, name);
+}
+
+static bool UnloadRuntime(RuntimeLibrary lib) {
+    return dlclose(lib) == 0;
+}
+#endif
+
+typedef mfxStatus(MFX_CDECL *MFXInitFunc)(mfxIMPL, mfxVersion *, mfxSession *);
+typedef mfxStatus(MFX_CDECL *MFXCloseFunc)(mfxSession);
+typedef mfxStatus(MFX_CDECL *DecodeFrameBatchFunc)(mfxCpuDecodeBatchItem *, mfxU32);
+
+// the batch threads are stopped by MFXClose, unloading must not wait for them
+TEST(Close, RuntimeUnloadsAfterBatch) {
+    RuntimeLibrary lib = LoadRuntime();
+    ASSERT_NE(lib, nullptr);
+
+    MFXInitFunc initSession = reinterpret_cast<MFXInitFunc>(GetRuntimeFunc(lib, "MFXInit"));
+    MFXCloseFunc closeSession =
+        reinterpret_cast<MFXCloseFunc>(GetRuntimeFunc(lib, "MFXClose"));
+    DecodeFrameBatchFunc decodeBatch = reinterpret_cast<DecodeFrameBatchFunc>(
+        GetRuntimeFunc(lib, "MFXVideoDECODE_DecodeFrameBatch"));
+    ASSERT_NE(initSession, nullptr);
+    ASSERT_NE(closeSession, nullptr);
+    ASSERT_NE(decodeBatch, nullptr);
+
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = initSession(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // the decoder is initialized from the first frame
+    mfxU32 frameLength =
+        test_bitstream_32x32_mjpeg::getpos(1) - test_bitstream_32x32_mjpeg::getpos(0);
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.CodecId      = MFX_CODEC_JPEG;
+    mfxBS.DataFlag     = MFX_BITSTREAM_COMPLETE_FRAME;
+    mfxBS.Data         = test_bitstream_32x32_mjpeg::getdata();
+    mfxBS.DataLength   = frameLength;
+    mfxBS.MaxLength    = frameLength;
+
+    mfxCpuDecodeBatchItem item = {};
+    item.Session               = session;
+    item.Bitstream             = &mfxBS;
+
+    sts = decodeBatch(&item, 1);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(item.Status, MFX_ERR_NONE);
+    ASSERT_NE(item.SurfaceOut, nullptr);
+
+    sts = item.SurfaceOut->FrameInterface->Release(item.SurfaceOut);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = closeSession(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    ASSERT_TRUE(UnloadRuntime(lib));
+}
+
 // if linking directly against the runtime, we can
 //   test functions which the dispatcher does not
 //   expose directly to the application
@@ -0,0 +1,270 @@
+/*############################################################################
+  # Copyright (C) 2021 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include <gtest/gtest.h>
+#include "api/test_bitstreams.h"
+#include "vpl/mfxcpu.h"
+#include "vpl/mfxvideo.h"
+
+/* GetDecodeStat overview
+   Retrieves the decoder's running counters.
+
+   SetSkipMode overview
+   Steps the amount of decoding work skipped up or down.
+
+MFX_ERR_NONE The function completed successfully.
+MFX_WRN_VALUE_NOT_CHANGED The skip level is already at its limit.
+
+*/
+
+TEST(DecodeGetDecodeStat, UninitializedReturnsNotInitialized) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxDecodeStat stat = {};
+    sts                = MFXVideoDECODE_GetDecodeStat(session, &stat);
+    ASSERT_EQ(sts, MFX_ERR_NOT_INITIALIZED);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeGetDecodeStat, NullSessionReturnsInvalidHandle) {
+    mfxStatus sts = MFXVideoDECODE_GetDecodeStat(0, nullptr);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
+}
+
+TEST(DecodeGetDecodeStat, NullStatReturnsErrNull) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_GetDecodeStat(session, nullptr);
+    ASSERT_EQ(sts, MFX_ERR_NULL_PTR);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeGetDecodeStat, DecodedFrameIsCounted) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
+    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxDecodeStat stat = {};
+    sts                = MFXVideoDECODE_GetDecodeStat(session, &stat);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(stat.NumFrame, 0);
+
+    mfxU32 frameLength =
+        test_bitstream_32x32_mjpeg::getpos(1) - test_bitstream_32x32_mjpeg::getpos(0);
+
+    mfxBS.DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
+    mfxBS.Data       = test_bitstream_32x32_mjpeg::getdata();
+    mfxBS.DataLength = frameLength;
+    mfxBS.DataOffset = 0;
+
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+    sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(pmfxOutSurface, nullptr);
+
+    sts = pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_GetDecodeStat(session, &stat);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(stat.NumFrame, 1);
+    ASSERT_EQ(stat.NumError, 0);
+
+    // timing and byte counters come through GetVideoParam
+    mfxExtCpuDecodeStat decStat = {};
+    decStat.Header.BufferId     = MFX_EXTBUFF_CPU_DECODE_STAT;
+    decStat.Header.BufferSz     = sizeof(decStat);
+
+    mfxExtBuffer *extBufs[] = { &decStat.Header };
+    mfxVideoParam testparam = { 0 };
+    testparam.ExtParam      = extBufs;
+    testparam.NumExtParam   = 1;
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &testparam);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(decStat.NumFrame, 1);
+    ASSERT_EQ(decStat.NumCorrupted, 0);
+    ASSERT_EQ(decStat.NumDropped, 0);
+    ASSERT_EQ(decStat.BytesConsumed, frameLength);
+    ASSERT_EQ(decStat.ParserCalls, 0); // complete frames bypass the parser
+    ASSERT_GE(decStat.DecodeTimeUs, decStat.MaxDecodeTimeUs);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeGetDecodeStat, MaxDecodeTimeCountsCallsWithoutFrame) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
+    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // half a frame, the parser keeps it and no frame comes out
+    mfxBS.DataLength = (test_bitstream_32x32_mjpeg::getpos(1) -
+                        test_bitstream_32x32_mjpeg::getpos(0)) /
+                       2;
+    mfxBS.DataOffset = 0;
+
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+    sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+
+    mfxExtCpuDecodeStat decStat = {};
+    decStat.Header.BufferId     = MFX_EXTBUFF_CPU_DECODE_STAT;
+    decStat.Header.BufferSz     = sizeof(decStat);
+
+    mfxExtBuffer *extBufs[] = { &decStat.Header };
+    mfxVideoParam testparam = { 0 };
+    testparam.ExtParam      = extBufs;
+    testparam.NumExtParam   = 1;
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &testparam);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(decStat.NumFrame, 0);
+    ASSERT_EQ(decStat.NumError, 0);
+    ASSERT_EQ(decStat.MaxDecodeTimeUs, decStat.DecodeTimeUs);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeGetDecodeStat, ErrorRecoveryInvalidModeRejected) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
+    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCpuDecodeErrorRecovery recovery = {};
+    recovery.Header.BufferId              = MFX_EXTBUFF_CPU_DECODE_ERROR_RECOVERY;
+    recovery.Header.BufferSz              = sizeof(recovery);
+    recovery.Mode                         = MFX_CPU_DECODE_ERROR_SKIP_TO_RAP + 1;
+
+    mfxExtBuffer *extBufs[]  = { &recovery.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_VIDEO_PARAM);
+
+    recovery.Mode = MFX_CPU_DECODE_ERROR_SKIP_TO_RAP;
+    sts           = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+static mfxStatus InitHEVCDecode(mfxSession session) {
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxDecParams.mfx.FrameInfo.FourCC       = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.CropW        = 128;
+    mfxDecParams.mfx.FrameInfo.CropH        = 96;
+    mfxDecParams.mfx.FrameInfo.Width        = 128;
+    mfxDecParams.mfx.FrameInfo.Height       = 96;
+
+    return MFXVideoDECODE_Init(session, &mfxDecParams);
+}
+
+TEST(DecodeSetSkipMode, UninitializedReturnsNotInitialized) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_NOSKIP);
+    ASSERT_EQ(sts, MFX_ERR_NOT_INITIALIZED);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeSetSkipMode, LevelsStepUpAndDown) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = InitHEVCDecode(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_LESS);
+    ASSERT_EQ(sts, MFX_WRN_VALUE_NOT_CHANGED);
+
+    sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_MORE);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_LESS);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // keep asking for more until the key frame only level is reached
+    int steps = 0;
+    while (MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_MORE) == MFX_ERR_NONE)
+        steps++;
+    ASSERT_GT(steps, 1);
+
+    sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_NOSKIP);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_NOSKIP);
+    ASSERT_EQ(sts, MFX_WRN_VALUE_NOT_CHANGED);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
@@ -5,6 +5,7 @@
   ############################################################################*/
 
 #include <gtest/gtest.h>
+#include "vpl/mfxcpu.h"
 #include "vpl/mfxjpeg.h"
 #include "vpl/mfxvideo.h"
 
@@ -118,6 +119,250 @@ TEST(DecodeGetVideoParam, InitializedDecodeReturnsParams) {
     EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
+TEST(DecodeGetVideoParam, FrameThreadingReportsLatency) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxDecParams.mfx.FrameInfo.FourCC       = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.CropW        = 128;
+    mfxDecParams.mfx.FrameInfo.CropH        = 96;
+    mfxDecParams.mfx.FrameInfo.Width        = 128;
+    mfxDecParams.mfx.FrameInfo.Height       = 96;
+
+    mfxExtCpuDecodeThreading threading = {};
+    threading.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz          = sizeof(threading);
+    threading.Mode                     = MFX_CPU_DECODE_THREADING_FRAME;
+    threading.NumThreads               = 4;
+
+    mfxExtBuffer *extBufs[]  = { &threading.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    threading                 = {};
+    threading.Header.BufferId = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz = sizeof(threading);
+
+    mfxVideoParam testparam = { 0 };
+    testparam.ExtParam      = extBufs;
+    testparam.NumExtParam   = 1;
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &testparam);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(threading.Mode, MFX_CPU_DECODE_THREADING_FRAME);
+    ASSERT_EQ(threading.NumThreads, 4);
+    ASSERT_EQ(threading.LatencyFrames, 3);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeGetVideoParam, SliceThreadingReportsNoLatency) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxDecParams.mfx.FrameInfo.FourCC       = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.CropW        = 128;
+    mfxDecParams.mfx.FrameInfo.CropH        = 96;
+    mfxDecParams.mfx.FrameInfo.Width        = 128;
+    mfxDecParams.mfx.FrameInfo.Height       = 96;
+
+    mfxExtCpuDecodeThreading threading = {};
+    threading.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz          = sizeof(threading);
+    threading.Mode                     = MFX_CPU_DECODE_THREADING_SLICE;
+    threading.NumThreads               = 4;
+
+    mfxExtBuffer *extBufs[]  = { &threading.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    threading                 = {};
+    threading.Header.BufferId = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz = sizeof(threading);
+
+    mfxVideoParam testparam = { 0 };
+    testparam.ExtParam      = extBufs;
+    testparam.NumExtParam   = 1;
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &testparam);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(threading.Mode, MFX_CPU_DECODE_THREADING_SLICE);
+    ASSERT_EQ(threading.NumThreads, 4);
+    ASSERT_EQ(threading.LatencyFrames, 0);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeGetVideoParam, DecodedOrderDisablesFrameThreading) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxDecParams.mfx.FrameInfo.FourCC       = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.CropW        = 128;
+    mfxDecParams.mfx.FrameInfo.CropH        = 96;
+    mfxDecParams.mfx.FrameInfo.Width        = 128;
+    mfxDecParams.mfx.FrameInfo.Height       = 96;
+    mfxDecParams.mfx.DecodedOrder           = 1;
+
+    // low delay wins over the requested frame threading
+    mfxExtCpuDecodeThreading threading = {};
+    threading.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz          = sizeof(threading);
+    threading.Mode                     = MFX_CPU_DECODE_THREADING_FRAME;
+    threading.NumThreads               = 4;
+
+    mfxExtBuffer *extBufs[]  = { &threading.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam testparam = { 0 };
+    testparam.ExtParam      = extBufs;
+    testparam.NumExtParam   = 1;
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &testparam);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(testparam.mfx.DecodedOrder, 1);
+    ASSERT_EQ(threading.Mode & MFX_CPU_DECODE_THREADING_FRAME, 0);
+    ASSERT_EQ(threading.LatencyFrames, 0);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+static void InitAV1Params(mfxVideoParam *par) {
+    par->mfx.CodecId = MFX_CODEC_AV1;
+    par->IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    par->mfx.FrameInfo.FourCC       = MFX_FOURCC_I420;
+    par->mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+    par->mfx.FrameInfo.CropW        = 128;
+    par->mfx.FrameInfo.CropH        = 96;
+    par->mfx.FrameInfo.Width        = 128;
+    par->mfx.FrameInfo.Height       = 96;
+}
+
+TEST(DecodeGetVideoParam, AV1FrameDelayReportsLatency) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    InitAV1Params(&mfxDecParams);
+
+    mfxExtCpuDecodeAV1 av1 = {};
+    av1.Header.BufferId    = MFX_EXTBUFF_CPU_DECODE_AV1;
+    av1.Header.BufferSz    = sizeof(av1);
+    av1.TileThreads        = 2;
+    av1.MaxFrameDelay      = 3;
+    av1.FilmGrain          = MFX_CPU_DECODE_AV1_FILM_GRAIN_EXPORT;
+
+    mfxExtBuffer *extBufs[]  = { &av1.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCpuDecodeThreading threading = {};
+    threading.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz          = sizeof(threading);
+
+    mfxExtBuffer *outBufs[] = { &threading.Header };
+    mfxVideoParam testparam = { 0 };
+    testparam.ExtParam      = outBufs;
+    testparam.NumExtParam   = 1;
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &testparam);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(threading.LatencyFrames, 2);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeGetVideoParam, AV1DecodedOrderHasNoFrameDelay) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    InitAV1Params(&mfxDecParams);
+    mfxDecParams.mfx.DecodedOrder = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCpuDecodeThreading threading = {};
+    threading.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz          = sizeof(threading);
+
+    mfxExtBuffer *outBufs[] = { &threading.Header };
+    mfxVideoParam testparam = { 0 };
+    testparam.ExtParam      = outBufs;
+    testparam.NumExtParam   = 1;
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &testparam);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(threading.LatencyFrames, 0);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeGetVideoParam, AV1InvalidFilmGrainModeRejected) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    InitAV1Params(&mfxDecParams);
+
+    mfxExtCpuDecodeAV1 av1 = {};
+    av1.Header.BufferId    = MFX_EXTBUFF_CPU_DECODE_AV1;
+    av1.Header.BufferSz    = sizeof(av1);
+    av1.FilmGrain          = MFX_CPU_DECODE_AV1_FILM_GRAIN_EXPORT + 1;
+
+    mfxExtBuffer *extBufs[]  = { &av1.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_VIDEO_PARAM);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
 TEST(DecodeGetVideoParam, DecodeUninitializedReturnsNotInitialized) {
     mfxVersion ver = {};
     mfxSession session;
@@ -5,6 +5,8 @@
   ############################################################################*/
 
 #include <gtest/gtest.h>
+#include "api/test_bitstreams.h"
+#include "vpl/mfxcpu.h"
 #include "vpl/mfxjpeg.h"
 #include "vpl/mfxvideo.h"
 
@@ -560,6 +562,139 @@ TEST(DecodeInit, HighAsyncDepthInReturnsInvalidVideoParam) {
     EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
+TEST(DecodeInit, UHD8KInReturnsErrNone) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxDecParams.mfx.FrameInfo.FourCC       = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.CropW        = 7680;
+    mfxDecParams.mfx.FrameInfo.CropH        = 4320;
+    mfxDecParams.mfx.FrameInfo.Width        = 7680;
+    mfxDecParams.mfx.FrameInfo.Height       = 4320;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeInit, OverMaxResolutionInReturnsInvalidVideoParam) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_AVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxDecParams.mfx.FrameInfo.FourCC       = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.CropW        = 8192;
+    mfxDecParams.mfx.FrameInfo.CropH        = 8192;
+    mfxDecParams.mfx.FrameInfo.Width        = 8192;
+    mfxDecParams.mfx.FrameInfo.Height       = 8192;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_VIDEO_PARAM);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeInit, OverMemoryBudgetInReturnsErrMemoryAlloc) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxDecParams.mfx.FrameInfo.FourCC       = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.CropW        = 7680;
+    mfxDecParams.mfx.FrameInfo.CropH        = 4320;
+    mfxDecParams.mfx.FrameInfo.Width        = 7680;
+    mfxDecParams.mfx.FrameInfo.Height       = 4320;
+
+    // one 8K I420 frame alone is ~47 MiB
+    mfxExtCpuMemoryBudget budget = {};
+    budget.Header.BufferId       = MFX_EXTBUFF_CPU_MEMORY_BUDGET;
+    budget.Header.BufferSz       = sizeof(budget);
+    budget.MaxMemoryMB           = 64;
+
+    mfxExtBuffer *extBufs[]  = { &budget.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_MEMORY_ALLOC);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeInit, MemoryBudgetIsSharedBySessions) {
+    mfxVersion ver = {};
+    mfxSession sessions[2];
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &sessions[0]);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &sessions[1]);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxDecParams.mfx.FrameInfo.FourCC       = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.CropW        = 1920;
+    mfxDecParams.mfx.FrameInfo.CropH        = 1088;
+    mfxDecParams.mfx.FrameInfo.Width        = 1920;
+    mfxDecParams.mfx.FrameInfo.Height       = 1088;
+
+    mfxExtCpuMemoryBudget budget = {};
+    budget.Header.BufferId       = MFX_EXTBUFF_CPU_MEMORY_BUDGET;
+    budget.Header.BufferSz       = sizeof(budget);
+
+    mfxExtBuffer *extBufs[]  = { &budget.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    // smallest budget one decoder fits in, two of them do not
+    for (budget.MaxMemoryMB = 2; budget.MaxMemoryMB < 1024; budget.MaxMemoryMB++) {
+        sts = MFXVideoDECODE_Init(sessions[0], &mfxDecParams);
+        if (sts == MFX_ERR_NONE)
+            break;
+        ASSERT_EQ(sts, MFX_ERR_MEMORY_ALLOC);
+    }
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_Init(sessions[1], &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_MEMORY_ALLOC);
+
+    // Close gives the memory back
+    sts = MFXVideoDECODE_Close(sessions[0]);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    sts = MFXVideoDECODE_Init(sessions[1], &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(sessions[0]);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    sts = MFXClose(sessions[1]);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
 TEST(DecodeInit, MismatchedChromaFormatInReturnsErrInvalidVideoParam) {
     mfxVersion ver = {};
     mfxSession session;
@@ -1302,6 +1437,187 @@ TEST(DecodeReset, ValidParamsInReturnsErrNone) {
     EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
+TEST(DecodeReset, SameStreamRestartsWithSurfacesKept) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxFrameSurface1 *firstSurface = nullptr;
+    mfxSyncPoint syncp             = {};
+    while (!firstSurface) {
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &firstSurface, &syncp);
+        ASSERT_TRUE(sts == MFX_ERR_NONE || sts == MFX_ERR_MORE_DATA);
+        if (sts == MFX_ERR_MORE_DATA)
+            ASSERT_NE(mfxBS.DataLength, 0);
+    }
+    ASSERT_EQ(firstSurface->Data.FrameOrder, 0);
+
+    // seek back to the start of the stream
+    sts = MFXVideoDECODE_Reset(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxDecodeStat stat = {};
+    sts                = MFXVideoDECODE_GetDecodeStat(session, &stat);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(stat.NumFrame, 0);
+
+    mfxBS.DataOffset = 0;
+    mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+
+    mfxFrameSurface1 *secondSurface = nullptr;
+    while (!secondSurface) {
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &secondSurface, &syncp);
+        ASSERT_TRUE(sts == MFX_ERR_NONE || sts == MFX_ERR_MORE_DATA);
+        if (sts == MFX_ERR_MORE_DATA)
+            ASSERT_NE(mfxBS.DataLength, 0);
+    }
+    ASSERT_EQ(secondSurface->Data.FrameOrder, 0);
+
+    // the surface from before Reset still belongs to the decoder's pool
+    sts = firstSurface->FrameInterface->Release(firstSurface);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    sts = secondSurface->FrameInterface->Release(secondSurface);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeReset, DroppedThreadingBufferReinitializes) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCpuDecodeThreading threading = {};
+    threading.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz          = sizeof(threading);
+    threading.Mode                     = MFX_CPU_DECODE_THREADING_SLICE;
+    threading.NumThreads               = 4;
+
+    mfxExtBuffer *extBufs[]  = { &threading.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // the threading buffer is gone, the decoder must not keep slice threads
+    mfxDecParams.ExtParam    = nullptr;
+    mfxDecParams.NumExtParam = 0;
+
+    sts = MFXVideoDECODE_Reset(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    threading                 = {};
+    threading.Header.BufferId = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz = sizeof(threading);
+
+    mfxVideoParam testparam = { 0 };
+    testparam.ExtParam      = extBufs;
+    testparam.NumExtParam   = 1;
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &testparam);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(threading.Mode, MFX_CPU_DECODE_THREADING_SLICE);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeReset, FlushSkipToKeyFrameRestartsAtKeyFrame) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+    while (!pmfxOutSurface) {
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+        ASSERT_TRUE(sts == MFX_ERR_NONE || sts == MFX_ERR_MORE_DATA);
+    }
+    sts = pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // only the flush buffer is needed, the other parameters are ignored
+    mfxExtCpuDecodeFlush flush = {};
+    flush.Header.BufferId      = MFX_EXTBUFF_CPU_DECODE_FLUSH;
+    flush.Header.BufferSz      = sizeof(flush);
+    flush.Mode                 = MFX_CPU_DECODE_FLUSH_SKIP_TO_RAP + 1;
+
+    mfxExtBuffer *extBufs[]  = { &flush.Header };
+    mfxVideoParam flushParam = { 0 };
+    flushParam.ExtParam      = extBufs;
+    flushParam.NumExtParam   = 1;
+
+    sts = MFXVideoDECODE_Reset(session, &flushParam);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_VIDEO_PARAM);
+
+    flush.Mode = MFX_CPU_DECODE_FLUSH_SKIP_TO_RAP;
+    sts        = MFXVideoDECODE_Reset(session, &flushParam);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // seek to the start, which is a key frame
+    mfxBS.DataOffset = 0;
+    mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+
+    pmfxOutSurface = nullptr;
+    while (!pmfxOutSurface) {
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+        ASSERT_TRUE(sts == MFX_ERR_NONE || sts == MFX_ERR_MORE_DATA);
+        if (sts == MFX_ERR_MORE_DATA)
+            ASSERT_NE(mfxBS.DataLength, 0);
+    }
+
+    // a flush keeps counting frames, unlike Reset
+    ASSERT_EQ(pmfxOutSurface->Data.FrameOrder, 1);
+    sts = pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
 TEST(DecodeReset, InvalidParamsInReturnsInvalidVideoParam) {
     mfxVersion ver = {};
     mfxSession session;
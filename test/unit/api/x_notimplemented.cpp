@@ -105,20 +105,6 @@ TEST(GetEncodeStat, AlwaysReturnsNotImplemented) {
     EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
-TEST(GetDecodeStat, AlwaysReturnsNotImplemented) {
-    mfxVersion ver = {};
-    mfxSession session;
-    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
-
-    sts = MFXVideoDECODE_GetDecodeStat(session, nullptr);
-    ASSERT_EQ(sts, MFX_ERR_NOT_IMPLEMENTED);
-
-    //free internal resources
-    sts = MFXClose(session);
-    EXPECT_EQ(sts, MFX_ERR_NONE);
-}
-
 TEST(GetVPPStat, AlwaysReturnsNotImplemented) {
     mfxVersion ver = {};
     mfxSession session;
@@ -132,32 +118,3 @@ TEST(GetVPPStat, AlwaysReturnsNotImplemented) {
     sts = MFXClose(session);
     EXPECT_EQ(sts, MFX_ERR_NONE);
 }
-
-TEST(DecodeSetSkipMode, AlwaysReturnsNotImplemented) {
-    mfxVersion ver = {};
-    mfxSession session;
-    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
-
-    mfxSkipMode M = MFX_SKIPMODE_NOSKIP;
-    sts           = MFXVideoDECODE_SetSkipMode(session, M);
-    ASSERT_EQ(sts, MFX_ERR_NOT_IMPLEMENTED);
-
-    //free internal resources
-    sts = MFXClose(session);
-    EXPECT_EQ(sts, MFX_ERR_NONE);
-}
-
-TEST(DecodeGetPayload, AlwaysReturnsNotImplemented) {
-    mfxVersion ver = {};
-    mfxSession session;
-    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
-
-    sts = MFXVideoDECODE_GetPayload(session, nullptr, nullptr);
-    ASSERT_EQ(sts, MFX_ERR_NOT_IMPLEMENTED);
-
-    //free internal resources
-    sts = MFXClose(session);
-    EXPECT_EQ(sts, MFX_ERR_NONE);
-}
\ No newline at end of file
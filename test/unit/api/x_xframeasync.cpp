@@ -5,7 +5,12 @@
   ############################################################################*/
 
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
 #include "api/test_bitstreams.h"
+#include "vpl/mfxcpu.h"
 #include "vpl/mfxjpeg.h"
 #include "vpl/mfxvideo.h"
 
@@ -32,6 +37,157 @@
 
 */
 
+// encodes a texture moving 2 pixels right per frame with x264 in CQP mode, ctrl is passed
+// with frame ctrlFrame (-1 for none), the FrameType of each packet is returned in coding
+// order, which is display order without B frames
+static mfxStatus EncodeAVCStream(mfxU16 qp,
+                                 mfxU32 numFrames,
+                                 mfxI32 ctrlFrame,
+                                 mfxEncodeCtrl *ctrl,
+                                 std::vector<mfxU8> *stream,
+                                 std::vector<mfxU16> *frameTypes) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    if (sts != MFX_ERR_NONE)
+        return sts;
+
+    mfxVideoParam mfxEncParams               = {};
+    mfxEncParams.mfx.CodecId                 = MFX_CODEC_AVC;
+    mfxEncParams.mfx.FrameInfo.FourCC        = MFX_FOURCC_I420;
+    mfxEncParams.mfx.FrameInfo.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
+    mfxEncParams.mfx.FrameInfo.CropW         = 128;
+    mfxEncParams.mfx.FrameInfo.CropH         = 96;
+    mfxEncParams.mfx.FrameInfo.Width         = 128;
+    mfxEncParams.mfx.FrameInfo.Height        = 96;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtN = 30;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtD = 1;
+    mfxEncParams.mfx.RateControlMethod       = MFX_RATECONTROL_CQP;
+    mfxEncParams.mfx.QPI                     = qp;
+    mfxEncParams.mfx.QPP                     = qp;
+    mfxEncParams.mfx.QPB                     = qp;
+    mfxEncParams.mfx.GopPicSize              = 100;
+    mfxEncParams.mfx.GopRefDist              = 1;
+    mfxEncParams.IOPattern                   = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+
+    sts = MFXVideoENCODE_Init(session, &mfxEncParams);
+    if (sts != MFX_ERR_NONE) {
+        MFXClose(session);
+        return sts;
+    }
+
+    mfxU32 lumaSize = 128 * 96;
+    std::vector<mfxU8> frame(lumaSize * 3 / 2, 128);
+
+    mfxFrameSurface1 surface = {};
+    surface.Info             = mfxEncParams.mfx.FrameInfo;
+    surface.Data.Y           = frame.data();
+    surface.Data.U           = surface.Data.Y + lumaSize;
+    surface.Data.V           = surface.Data.U + lumaSize / 4;
+    surface.Data.Pitch       = 128;
+
+    std::vector<mfxU8> buffer(lumaSize * 3);
+    mfxBitstream mfxBS = {};
+    mfxBS.Data         = buffer.data();
+    mfxBS.MaxLength    = (mfxU32)buffer.size();
+
+    mfxU32 n = 0;
+    for (;;) {
+        mfxFrameSurface1 *surf = nullptr;
+        mfxEncodeCtrl *pCtrl   = nullptr;
+        if (n < numFrames) {
+            for (mfxU32 y = 0; y < 96; y++) {
+                for (mfxU32 x = 0; x < 128; x++)
+                    frame[y * 128 + x] = (mfxU8)(((x - 2 * n) * 7) ^ (y * 3));
+            }
+            surf  = &surface;
+            pCtrl = ((mfxI32)n == ctrlFrame) ? ctrl : nullptr;
+            n++;
+        }
+
+        mfxSyncPoint syncp;
+        sts = MFXVideoENCODE_EncodeFrameAsync(session, pCtrl, surf, &mfxBS, &syncp);
+        if (sts == MFX_ERR_MORE_DATA && surf)
+            continue;
+        if (sts != MFX_ERR_NONE)
+            break;
+
+        stream->insert(stream->end(), mfxBS.Data, mfxBS.Data + mfxBS.DataLength);
+        frameTypes->push_back(mfxBS.FrameType);
+        mfxBS.DataLength = 0;
+    }
+
+    MFXClose(session);
+    return (sts == MFX_ERR_MORE_DATA) ? MFX_ERR_NONE : sts;
+}
+
+// decodes an AVC stream with QP export on, the QP of each frame is returned in display
+// order, or -1 if its blocks have different QPs
+static mfxStatus DecodeAVCFrameQP(std::vector<mfxU8> *stream, std::vector<int> *frameQP) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    if (sts != MFX_ERR_NONE)
+        return sts;
+
+    mfxVideoParam mfxDecParams = {};
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_AVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = {};
+    mfxBS.MaxLength = mfxBS.DataLength = (mfxU32)stream->size();
+    mfxBS.Data                         = stream->data();
+
+    mfxExtCpuDecodeAnalytics analytics = {};
+    analytics.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_ANALYTICS;
+    analytics.Header.BufferSz          = sizeof(analytics);
+    analytics.QP                       = MFX_CODINGOPTION_ON;
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+
+    mfxExtBuffer *extBufs[]  = { &analytics.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    if (sts == MFX_ERR_NONE)
+        sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+
+    while (sts == MFX_ERR_NONE) {
+        mfxBitstream *bs                 = mfxBS.DataLength ? &mfxBS : nullptr;
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxSyncPoint syncp               = {};
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &pmfxOutSurface, &syncp);
+        if (sts == MFX_ERR_MORE_DATA && bs) {
+            sts = MFX_ERR_NONE;
+            continue;
+        }
+        if (sts != MFX_ERR_NONE)
+            break;
+
+        mfxGUID guid     = MFX_GUID_CPU_FRAME_ANALYTICS;
+        mfxHDL interface = nullptr;
+        sts = pmfxOutSurface->FrameInterface->QueryInterface(pmfxOutSurface, guid, &interface);
+        if (sts == MFX_ERR_NONE) {
+            mfxCpuFrameAnalytics *frameAnalytics =
+                reinterpret_cast<mfxCpuFrameAnalytics *>(interface);
+            int qp = frameAnalytics->QP ? frameAnalytics->QP[0] : -1;
+            for (mfxU32 y = 0; y < frameAnalytics->QPHeight; y++) {
+                const mfxU8 *row = frameAnalytics->QP + y * frameAnalytics->QPPitch;
+                for (mfxU32 x = 0; x < frameAnalytics->QPWidth; x++) {
+                    if (row[x] != qp)
+                        qp = -1;
+                }
+            }
+            frameQP->push_back(qp);
+        }
+        pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+    }
+
+    MFXClose(session);
+    return (sts == MFX_ERR_MORE_DATA) ? MFX_ERR_NONE : sts;
+}
+
+
 TEST(EncodeFrameAsync, ValidInputsReturnsErrNone) {
     mfxVersion ver = {};
     mfxSession session;
@@ -242,6 +398,108 @@ TEST(EncodeFrameAsync, EncCtrlReturnsErrInvalidVideoParam) {
     delete[] mfxBS.Data;
 }
 
+TEST(EncodeFrameAsync, EncCtrlFrameTypeReturnsKeyFrame) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxEncParams               = {};
+    mfxEncParams.mfx.CodecId                 = MFX_CODEC_JPEG;
+    mfxEncParams.mfx.FrameInfo.FourCC        = MFX_FOURCC_I420;
+    mfxEncParams.mfx.FrameInfo.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
+    mfxEncParams.mfx.FrameInfo.CropW         = 128;
+    mfxEncParams.mfx.FrameInfo.CropH         = 96;
+    mfxEncParams.mfx.FrameInfo.Width         = 128;
+    mfxEncParams.mfx.FrameInfo.Height        = 96;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtN = 30;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtD = 1;
+    mfxEncParams.IOPattern                   = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+
+    sts = MFXVideoENCODE_Init(session, &mfxEncParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxU32 lumaSize = 128 * 96;
+    std::vector<mfxU8> frame(lumaSize * 3 / 2, 0);
+
+    mfxFrameSurface1 surface = {};
+    surface.Info             = mfxEncParams.mfx.FrameInfo;
+    surface.Data.Y           = frame.data();
+    surface.Data.U           = surface.Data.Y + lumaSize;
+    surface.Data.V           = surface.Data.U + lumaSize / 4;
+    surface.Data.Pitch       = 128;
+
+    std::vector<mfxU8> buffer(20000);
+    mfxBitstream mfxBS = {};
+    mfxBS.Data         = buffer.data();
+    mfxBS.MaxLength    = (mfxU32)buffer.size();
+
+    // a reference flag alone does not say which type to code
+    mfxEncodeCtrl ctrl = {};
+    ctrl.FrameType     = MFX_FRAMETYPE_REF;
+
+    mfxSyncPoint syncp;
+    sts = MFXVideoENCODE_EncodeFrameAsync(session, &ctrl, &surface, &mfxBS, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_VIDEO_PARAM);
+
+    ctrl.FrameType = MFX_FRAMETYPE_I | MFX_FRAMETYPE_REF | MFX_FRAMETYPE_IDR;
+    sts            = MFXVideoENCODE_EncodeFrameAsync(session, &ctrl, &surface, &mfxBS, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_GT(mfxBS.DataLength, (mfxU32)0);
+    EXPECT_TRUE(mfxBS.FrameType & MFX_FRAMETYPE_I);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(EncodeFrameAsync, EncCtrlFrameTypeForcesAVCKeyFrame) {
+#ifndef ENABLE_ENCODER_H264
+    GTEST_SKIP();
+#endif
+    // the GOP is longer than the stream, so only the first and the forced frame are I frames
+    std::vector<mfxU8> stream;
+    std::vector<mfxU16> frameTypes;
+    mfxEncodeCtrl ctrl = {};
+    ctrl.FrameType     = MFX_FRAMETYPE_I | MFX_FRAMETYPE_REF | MFX_FRAMETYPE_IDR;
+
+    mfxStatus sts = EncodeAVCStream(30, 12, 6, &ctrl, &stream, &frameTypes);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(frameTypes.size(), (size_t)12);
+
+    EXPECT_TRUE(frameTypes[0] & MFX_FRAMETYPE_I);
+    EXPECT_TRUE(frameTypes[6] & MFX_FRAMETYPE_I);
+    for (size_t i = 1; i < frameTypes.size(); i++) {
+        if (i != 6)
+            EXPECT_FALSE(frameTypes[i] & MFX_FRAMETYPE_I) << "frame " << i;
+    }
+}
+
+TEST(EncodeFrameAsync, EncCtrlQPSetsAVCSliceQP) {
+#ifndef ENABLE_ENCODER_H264
+    GTEST_SKIP();
+#endif
+    // without adaptive quantization in CQP mode every block has the slice QP
+    std::vector<mfxU8> stream;
+    std::vector<mfxU16> frameTypes;
+    mfxEncodeCtrl ctrl = {};
+    ctrl.QP            = 40;
+
+    mfxStatus sts = EncodeAVCStream(30, 8, 4, &ctrl, &stream, &frameTypes);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(frameTypes.size(), (size_t)8);
+    ASSERT_TRUE(frameTypes[4] & MFX_FRAMETYPE_P);
+
+    std::vector<int> frameQP;
+    sts = DecodeAVCFrameQP(&stream, &frameQP);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(frameQP.size(), (size_t)8);
+
+    // the override lasts one frame
+    EXPECT_EQ(frameQP[3], 30);
+    EXPECT_EQ(frameQP[4], 40);
+    EXPECT_EQ(frameQP[5], 30);
+}
+
 TEST(EncodeFrameAsync, InsufficientOutBufferReturnsNotEnoughBuffer) {
     mfxVersion ver = {};
     mfxSession session;
@@ -312,6 +570,77 @@ TEST(EncodeFrameAsync, InsufficientOutBufferReturnsNotEnoughBuffer) {
     delete[] mfxBS.Data;
 }
 
+TEST(EncodeFrameAsync, DirectOutputAppendsBehindData) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCpuEncodeOutput output = {};
+    output.Header.BufferId       = MFX_EXTBUFF_CPU_ENCODE_OUTPUT;
+    output.Header.BufferSz       = sizeof(output);
+    output.Mode                  = MFX_CPU_ENCODE_OUTPUT_DIRECT;
+    mfxExtBuffer *extParam       = &output.Header;
+
+    mfxVideoParam mfxEncParams               = {};
+    mfxEncParams.mfx.CodecId                 = MFX_CODEC_JPEG;
+    mfxEncParams.mfx.FrameInfo.FourCC        = MFX_FOURCC_I420;
+    mfxEncParams.mfx.FrameInfo.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
+    mfxEncParams.mfx.FrameInfo.CropW         = 128;
+    mfxEncParams.mfx.FrameInfo.CropH         = 96;
+    mfxEncParams.mfx.FrameInfo.Width         = 128;
+    mfxEncParams.mfx.FrameInfo.Height        = 96;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtN = 30;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtD = 1;
+    mfxEncParams.IOPattern                   = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+    mfxEncParams.ExtParam                    = &extParam;
+    mfxEncParams.NumExtParam                 = 1;
+
+    sts = MFXVideoENCODE_Init(session, &mfxEncParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // direct if the encoder takes caller buffers, copy otherwise
+    output.Mode = MFX_CPU_ENCODE_OUTPUT_REFERENCE;
+
+    mfxVideoParam par = {};
+    par.ExtParam      = &extParam;
+    par.NumExtParam   = 1;
+    sts               = MFXVideoENCODE_GetVideoParam(session, &par);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(output.Mode, MFX_CPU_ENCODE_OUTPUT_REFERENCE);
+
+    mfxU32 lumaSize = 128 * 96;
+    std::vector<mfxU8> frame(lumaSize * 3 / 2, 0);
+
+    mfxFrameSurface1 surface = {};
+    surface.Info             = mfxEncParams.mfx.FrameInfo;
+    surface.Data.Y           = frame.data();
+    surface.Data.U           = surface.Data.Y + lumaSize;
+    surface.Data.V           = surface.Data.U + lumaSize / 4;
+    surface.Data.Pitch       = 128;
+
+    // the packet goes behind data the app has not consumed yet
+    std::vector<mfxU8> buffer(20000, 0xAA);
+    mfxBitstream mfxBS = {};
+    mfxBS.Data         = buffer.data();
+    mfxBS.MaxLength    = (mfxU32)buffer.size();
+    mfxBS.DataOffset   = 4;
+    mfxBS.DataLength   = 2;
+
+    mfxSyncPoint syncp;
+    sts = MFXVideoENCODE_EncodeFrameAsync(session, nullptr, &surface, &mfxBS, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(mfxBS.Data, buffer.data());
+    ASSERT_GT(mfxBS.DataLength, (mfxU32)4);
+    EXPECT_EQ(buffer[4], 0xAA);
+    EXPECT_EQ(buffer[5], 0xAA);
+    EXPECT_EQ(buffer[6], 0xFF);
+    EXPECT_EQ(buffer[7], 0xD8);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
 TEST(EncodeFrameAsync, NullSessionReturnsInvalidHandle) {
     mfxStatus sts = MFXVideoENCODE_EncodeFrameAsync(0, nullptr, nullptr, nullptr, nullptr);
     ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
@@ -614,7 +943,7 @@ TEST(DecodeFrameAsync, CompleteFrameJPEGReturnsFrame) {
     delete[] decSurfaces;
 }
 
-TEST(DecodeFrameAsync, EoSReturnsFrame) {
+TEST(DecodeFrameAsync, CompleteFrameJPEGInternalAllocReturnsI420Frame) {
     mfxStatus sts = MFX_ERR_NONE;
 
     mfxVersion ver = {};
@@ -632,155 +961,1302 @@ TEST(DecodeFrameAsync, EoSReturnsFrame) {
 
     sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
     ASSERT_EQ(sts, MFX_ERR_NONE);
-
-    mfxU32 nSurfNumDec            = 8;
-    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
-    mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
-    mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
-
-    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
-
-    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
-        decSurfaces[i]            = { 0 };
-        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
-        int buf_offset            = i * surfW * surfH;
-        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
-        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
-        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
-        decSurfaces[i].Data.Pitch = surfW;
-    }
+    ASSERT_EQ(mfxDecParams.mfx.FrameInfo.FourCC, MFX_FOURCC_I420);
 
     sts = MFXVideoDECODE_Init(session, &mfxDecParams);
-    if (sts != MFX_ERR_NONE) {
-        if (decSurfaces)
-            delete[] decSurfaces;
-        ASSERT_EQ(sts, MFX_ERR_NONE);
-    }
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
     mfxFrameSurface1 *pmfxOutSurface = nullptr;
     mfxSyncPoint syncp               = {};
-    int nIndex                       = 0;
 
-    mfxBS.DataFlag = MFX_BITSTREAM_EOS;
-
-    int frame = 2; //use the 3rd frame in the bitstream
-
-    mfxBS.Data = test_bitstream_32x32_mjpeg::getdata() + test_bitstream_32x32_mjpeg::getpos(frame);
+    mfxBS.DataFlag = MFX_BITSTREAM_COMPLETE_FRAME;
+    mfxBS.Data     = test_bitstream_32x32_mjpeg::getdata();
     mfxBS.DataLength =
-        test_bitstream_32x32_mjpeg::getpos(frame + 1) - test_bitstream_32x32_mjpeg::getpos(frame);
+        test_bitstream_32x32_mjpeg::getpos(1) - test_bitstream_32x32_mjpeg::getpos(0);
     mfxBS.DataOffset = 0;
 
-    sts = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          &mfxBS,
-                                          &decSurfaces[nIndex++],
-                                          &pmfxOutSurface,
-                                          &syncp);
-    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+    // internal allocation, decoder output buffer is passed through
+    sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(pmfxOutSurface, nullptr);
 
-    sts = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          nullptr,
-                                          &decSurfaces[nIndex++],
-                                          &pmfxOutSurface,
-                                          &syncp);
+    sts = pmfxOutSurface->FrameInterface->Synchronize(pmfxOutSurface, 1000);
     ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(pmfxOutSurface->Info.FourCC, MFX_FOURCC_I420);
 
-    sts = MFXClose(session);
+    sts = pmfxOutSurface->FrameInterface->Map(pmfxOutSurface, MFX_MAP_READ);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(pmfxOutSurface->Data.Y, nullptr);
+    ASSERT_NE(pmfxOutSurface->Data.U, nullptr);
+    ASSERT_NE(pmfxOutSurface->Data.V, nullptr);
+    sts = pmfxOutSurface->FrameInterface->Unmap(pmfxOutSurface);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    delete[] DECoutbuf;
-    delete[] decSurfaces;
-}
+    sts = pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
-TEST(DecodeFrameAsync, BSTimestampReturnsFrameTimestamp) {
-    mfxStatus sts = MFX_ERR_NONE;
+    sts = MFXClose(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+}
 
+TEST(DecodeFrameAsync, CompleteFrameJPEGPaddedBufferReturnsFrame) {
     mfxVersion ver = {};
     mfxSession session;
-    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxVideoParam mfxDecParams                = { 0 };
-    mfxDecParams.mfx.CodecId                  = MFX_CODEC_JPEG;
-    mfxDecParams.IOPattern                    = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
-    mfxDecParams.mfx.FrameInfo.Width          = 32;
-    mfxDecParams.mfx.FrameInfo.CropW          = 32;
-    mfxDecParams.mfx.FrameInfo.Height         = 32;
-    mfxDecParams.mfx.FrameInfo.CropH          = 32;
-    mfxDecParams.mfx.FrameInfo.FourCC         = MFX_FOURCC_I420;
-    mfxDecParams.mfx.FrameInfo.ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
-    mfxDecParams.mfx.FrameInfo.BitDepthLuma   = 8;
-    mfxDecParams.mfx.FrameInfo.BitDepthChroma = 8;
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
-    mfxBitstream mfxBS = { 0 };
-    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
-    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+    mfxU32 frameLength =
+        test_bitstream_32x32_mjpeg::getpos(1) - test_bitstream_32x32_mjpeg::getpos(0);
 
-    mfxU32 nSurfNumDec            = 1;
-    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
-    mfxU32 surfW                  = 32;
-    mfxU32 surfH                  = 32;
+    // zeroed padding after the frame, as for a buffer the decoder could reference
+    std::vector<mfxU8> buffer(frameLength + 64, 0);
+    memcpy(buffer.data(), test_bitstream_32x32_mjpeg::getdata(), frameLength);
 
-    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.Data         = buffer.data();
+    mfxBS.MaxLength    = (mfxU32)buffer.size();
+    mfxBS.DataLength   = frameLength;
+    mfxBS.DataFlag     = MFX_BITSTREAM_COMPLETE_FRAME;
 
-    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
-        decSurfaces[i]            = { 0 };
-        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
-        int buf_offset            = i * surfW * surfH;
-        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
-        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
-        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
-        decSurfaces[i].Data.Pitch = surfW;
-    }
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
     sts = MFXVideoDECODE_Init(session, &mfxDecParams);
-    if (sts != MFX_ERR_NONE) {
-        if (decSurfaces)
-            delete[] decSurfaces;
-        ASSERT_EQ(sts, MFX_ERR_NONE);
-    }
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
     mfxFrameSurface1 *pmfxOutSurface = nullptr;
     mfxSyncPoint syncp               = {};
+    sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(pmfxOutSurface, nullptr);
+    ASSERT_EQ(mfxBS.DataLength, 0);
 
-    mfxBS.DataFlag = MFX_BITSTREAM_COMPLETE_FRAME;
+    // the app may reuse its buffer as soon as the call returns
+    std::fill(buffer.begin(), buffer.end(), 0xFF);
 
-    mfxBS.Data       = test_bitstream_32x32_mjpeg::getdata();
-    mfxBS.DataLength = test_bitstream_32x32_mjpeg::getpos(1);
-    mfxBS.DataOffset = 0;
-    mfxBS.TimeStamp  = 111111;
+    sts = pmfxOutSurface->FrameInterface->Synchronize(pmfxOutSurface, 1000);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(pmfxOutSurface->Data.Corrupted, 0);
 
-    sts =
-        MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, &decSurfaces[0], &pmfxOutSurface, &syncp);
+    sts = pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
     ASSERT_EQ(sts, MFX_ERR_NONE);
-    ASSERT_EQ(decSurfaces[0].Data.TimeStamp, 111111);
 
     sts = MFXClose(session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
-
-    delete[] DECoutbuf;
-    delete[] decSurfaces;
 }
 
-TEST(DecodeFrameAsync, CompleteFrameHEVCReturnsFrame) {
-    mfxStatus sts = MFX_ERR_NONE;
+// luma sum of each output frame, the HEVC test stream sent one complete frame per call,
+// either from the test data or through one padded buffer the app overwrites after each call
+static mfxStatus SumCompleteFramesHEVC(bool reuseBuffer, std::vector<mfxU32> *sums) {
+    const mfxU32 numPackets = 8;
+    mfxU8 *stream           = test_bitstream_96x64_8bit_hevc::getdata();
+    mfxU32 length           = test_bitstream_96x64_8bit_hevc::getlen();
 
     mfxVersion ver = {};
     mfxSession session;
-    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
-
-    mfxVideoParam mfxDecParams = { 0 };
-    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
-    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    if (sts != MFX_ERR_NONE)
+        return sts;
 
+    std::vector<mfxU8> buffer(length + 64);
     mfxBitstream mfxBS = { 0 };
-    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
-    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+    mfxBS.CodecId      = MFX_CODEC_HEVC;
+    mfxBS.DataFlag     = MFX_BITSTREAM_COMPLETE_FRAME;
+
+    for (mfxU32 pkt = 0; pkt <= numPackets && sts == MFX_ERR_NONE; pkt++) {
+        mfxBitstream *bs = nullptr; // drain after the last frame
+        if (pkt < numPackets) {
+            mfxU32 start = test_bitstream_96x64_8bit_hevc::getpos(pkt);
+            mfxU32 end   = (pkt + 1 < numPackets) ? test_bitstream_96x64_8bit_hevc::getpos(pkt + 1)
+                                                  : length;
+            if (reuseBuffer) {
+                std::fill(buffer.begin(), buffer.end(), 0);
+                memcpy(buffer.data(), stream + start, end - start);
+                mfxBS.Data       = buffer.data();
+                mfxBS.MaxLength  = (mfxU32)buffer.size();
+                mfxBS.DataOffset = 0;
+            }
+            else {
+                mfxBS.Data       = stream;
+                mfxBS.MaxLength  = length;
+                mfxBS.DataOffset = start;
+            }
+            mfxBS.DataLength = end - start;
+            bs               = &mfxBS;
+        }
 
-    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
+        for (;;) {
+            mfxFrameSurface1 *pmfxOutSurface = nullptr;
+            mfxSyncPoint syncp               = {};
+            sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &pmfxOutSurface, &syncp);
+            if (sts == MFX_ERR_MORE_DATA) {
+                sts = bs ? MFX_ERR_NONE : MFX_ERR_MORE_DATA;
+                break;
+            }
+            if (sts != MFX_ERR_NONE)
+                break;
 
-    mfxU32 nSurfNumDec            = 8;
+            sts = pmfxOutSurface->FrameInterface->Synchronize(pmfxOutSurface, 1000);
+            if (sts == MFX_ERR_NONE)
+                sts = pmfxOutSurface->FrameInterface->Map(pmfxOutSurface, MFX_MAP_READ);
+            if (sts != MFX_ERR_NONE)
+                break;
+            mfxU32 sum = 0;
+            for (mfxU16 y = 0; y < pmfxOutSurface->Info.CropH; y++) {
+                mfxU8 *row = pmfxOutSurface->Data.Y + y * pmfxOutSurface->Data.Pitch;
+                for (mfxU16 x = 0; x < pmfxOutSurface->Info.CropW; x++)
+                    sum += row[x];
+            }
+            sums->push_back(sum);
+            pmfxOutSurface->FrameInterface->Unmap(pmfxOutSurface);
+            pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+        }
+
+        // the app may reuse its buffer as soon as the call returns
+        if (reuseBuffer)
+            std::fill(buffer.begin(), buffer.end(), 0xFF);
+    }
+
+    MFXClose(session);
+    return (sts == MFX_ERR_MORE_DATA) ? MFX_ERR_NONE : sts;
+}
+
+TEST(DecodeFrameAsync, CompleteFrameHEVCReusedBufferMatchesCopiedInput) {
+    std::vector<mfxU32> expected;
+    mfxStatus sts = SumCompleteFramesHEVC(false, &expected);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(expected.size(), 8u);
+
+    // references the decoder kept past the call would read the overwritten buffer
+    std::vector<mfxU32> sums;
+    sts = SumCompleteFramesHEVC(true, &sums);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(sums, expected);
+}
+
+TEST(DecodeFrameAsync, ParallelJPEGReturnsFramesInOrder) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
+    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // frame threading for mjpeg decodes on two contexts
+    mfxExtCpuDecodeThreading threading = {};
+    threading.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz          = sizeof(threading);
+    threading.Mode                     = MFX_CPU_DECODE_THREADING_FRAME;
+    threading.NumThreads               = 2;
+
+    mfxExtBuffer *extBufs[]  = { &threading.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    threading                 = {};
+    threading.Header.BufferId = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz = sizeof(threading);
+
+    mfxVideoParam testparam = { 0 };
+    testparam.ExtParam      = extBufs;
+    testparam.NumExtParam   = 1;
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &testparam);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(threading.Mode, MFX_CPU_DECODE_THREADING_FRAME);
+    ASSERT_EQ(threading.NumThreads, 2);
+    ASSERT_EQ(threading.LatencyFrames, 1);
+
+    mfxU64 expectedTimeStamp         = 1;
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+
+    for (mfxU32 i = 0; i <= 4; i++) {
+        mfxBitstream *bs = nullptr; // drain after the last frame
+        if (i < 4) {
+            mfxBS.DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
+            mfxBS.DataOffset = test_bitstream_32x32_mjpeg::getpos(i);
+            mfxBS.DataLength = (i < 3 ? test_bitstream_32x32_mjpeg::getpos(i + 1)
+                                      : test_bitstream_32x32_mjpeg::getlen()) -
+                               mfxBS.DataOffset;
+            mfxBS.TimeStamp  = i + 1;
+            bs               = &mfxBS;
+        }
+
+        for (;;) {
+            pmfxOutSurface = nullptr;
+            sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &pmfxOutSurface, &syncp);
+            if (sts == MFX_ERR_MORE_DATA)
+                break;
+            ASSERT_EQ(sts, MFX_ERR_NONE);
+            ASSERT_NE(pmfxOutSurface, nullptr);
+
+            ASSERT_EQ(pmfxOutSurface->Data.TimeStamp, expectedTimeStamp);
+            ASSERT_EQ(pmfxOutSurface->Data.FrameOrder, expectedTimeStamp - 1);
+            expectedTimeStamp++;
+
+            sts = pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+            ASSERT_EQ(sts, MFX_ERR_NONE);
+
+            if (bs)
+                break;
+        }
+    }
+    ASSERT_EQ(expectedTimeStamp, 5);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeFrameAsync, GOPParallelHEVCReturnsSegmentsInOrder) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCpuDecodeThreading threading = {};
+    threading.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz          = sizeof(threading);
+    threading.Mode                     = MFX_CPU_DECODE_THREADING_GOP;
+    threading.NumThreads               = 2;
+
+    mfxExtBuffer *extBufs[]  = { &threading.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    threading                 = {};
+    threading.Header.BufferId = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz = sizeof(threading);
+
+    mfxVideoParam testparam = { 0 };
+    testparam.ExtParam      = extBufs;
+    testparam.NumExtParam   = 1;
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &testparam);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(threading.Mode, MFX_CPU_DECODE_THREADING_GOP);
+    ASSERT_EQ(threading.NumThreads, 2);
+    ASSERT_GT(threading.LatencyFrames, 0);
+
+    // the stream is one IDR period, sent twice it makes two segments
+    const mfxU32 numPackets = 8;
+    mfxU32 numFrames[2]     = {};
+    mfxU32 lastSegment      = 0;
+
+    for (mfxU32 i = 0; i <= 2 * numPackets; i++) {
+        mfxBitstream *bs = nullptr; // drain after the last frame
+        if (i < 2 * numPackets) {
+            mfxU32 pkt       = i % numPackets;
+            mfxU32 end       = test_bitstream_96x64_8bit_hevc::getlen();
+            if (pkt < numPackets - 1)
+                end = test_bitstream_96x64_8bit_hevc::getpos(pkt + 1);
+            mfxBS.DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
+            mfxBS.DataOffset = test_bitstream_96x64_8bit_hevc::getpos(pkt);
+            mfxBS.DataLength = end - mfxBS.DataOffset;
+            mfxBS.TimeStamp  = i / numPackets + 1;
+            bs               = &mfxBS;
+        }
+
+        for (;;) {
+            mfxFrameSurface1 *pmfxOutSurface = nullptr;
+            mfxSyncPoint syncp               = {};
+            sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &pmfxOutSurface, &syncp);
+            if (sts == MFX_ERR_MORE_DATA)
+                break;
+            ASSERT_EQ(sts, MFX_ERR_NONE);
+            ASSERT_NE(pmfxOutSurface, nullptr);
+
+            // frames of the second segment only after all of the first
+            mfxU32 segment = (mfxU32)pmfxOutSurface->Data.TimeStamp - 1;
+            ASSERT_LT(segment, 2u);
+            ASSERT_GE(segment, lastSegment);
+            lastSegment = segment;
+            numFrames[segment]++;
+
+            sts = pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+            ASSERT_EQ(sts, MFX_ERR_NONE);
+        }
+    }
+    ASSERT_EQ(numFrames[0], numPackets);
+    ASSERT_EQ(numFrames[1], numPackets);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeFrameAsync, GOPParallelHEVCHonorsSkipMode) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCpuDecodeThreading threading = {};
+    threading.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz          = sizeof(threading);
+    threading.Mode                     = MFX_CPU_DECODE_THREADING_GOP;
+    threading.NumThreads               = 2;
+
+    mfxExtBuffer *extBufs[]  = { &threading.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // the top level decodes key frames only, on the worker contexts as well
+    int steps = 0;
+    while (MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_MORE) == MFX_ERR_NONE)
+        steps++;
+    ASSERT_GT(steps, 1);
+
+    // the stream has a single IDR frame
+    mfxU32 numFrames = 0;
+    for (;;) {
+        mfxBitstream *bs                 = mfxBS.DataLength ? &mfxBS : nullptr;
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxSyncPoint syncp               = {};
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &pmfxOutSurface, &syncp);
+        if (sts == MFX_ERR_MORE_DATA && bs)
+            continue;
+        if (sts == MFX_ERR_MORE_DATA)
+            break;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        numFrames++;
+
+        sts = pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+    ASSERT_EQ(numFrames, 1u);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeFrameAsync, GOPParallelHEVCRepeatsMissingParamSets) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // the first IDR access unit starts with VPS and SPS, the PPS follows at this offset
+    const mfxU32 ppsOffset  = 77;
+    const mfxU32 numPackets = 8;
+    mfxU8 *data             = test_bitstream_96x64_8bit_hevc::getdata();
+    mfxU32 length           = test_bitstream_96x64_8bit_hevc::getlen();
+    ASSERT_EQ(data[ppsOffset + 4] >> 1, 34);
+
+    // the stream twice, the second IDR repeats only the PPS
+    std::vector<mfxU8> stream(data, data + length);
+    stream.insert(stream.end(), data + ppsOffset, data + length);
+
+    std::vector<mfxU32> packetPos;
+    for (mfxU32 pkt = 0; pkt < numPackets; pkt++)
+        packetPos.push_back(test_bitstream_96x64_8bit_hevc::getpos(pkt));
+    packetPos.push_back(length);
+    for (mfxU32 pkt = 1; pkt < numPackets; pkt++)
+        packetPos.push_back(length + test_bitstream_96x64_8bit_hevc::getpos(pkt) - ppsOffset);
+    packetPos.push_back((mfxU32)stream.size());
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = (mfxU32)stream.size();
+    mfxBS.Data                         = stream.data();
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCpuDecodeThreading threading = {};
+    threading.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz          = sizeof(threading);
+    threading.Mode                     = MFX_CPU_DECODE_THREADING_GOP;
+    threading.NumThreads               = 2;
+
+    mfxExtBuffer *extBufs[]  = { &threading.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // the second segment goes to the context that has not seen the SPS
+    mfxU32 numFrames = 0;
+    for (mfxU32 i = 0; i < packetPos.size(); i++) {
+        mfxBitstream *bs = nullptr; // drain after the last frame
+        if (i + 1 < packetPos.size()) {
+            mfxBS.DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
+            mfxBS.DataOffset = packetPos[i];
+            mfxBS.DataLength = packetPos[i + 1] - packetPos[i];
+            bs               = &mfxBS;
+        }
+
+        for (;;) {
+            mfxFrameSurface1 *pmfxOutSurface = nullptr;
+            mfxSyncPoint syncp               = {};
+            sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &pmfxOutSurface, &syncp);
+            if (sts == MFX_ERR_MORE_DATA)
+                break;
+            ASSERT_EQ(sts, MFX_ERR_NONE);
+            ASSERT_NE(pmfxOutSurface, nullptr);
+            ASSERT_EQ(pmfxOutSurface->Data.Corrupted, 0);
+            numFrames++;
+
+            sts = pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+            ASSERT_EQ(sts, MFX_ERR_NONE);
+        }
+    }
+    ASSERT_EQ(numFrames, 2 * numPackets);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeFrameAsync, ThumbnailHEVCReturnsScaledKeyFrames) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCpuDecodeThumbnail thumbnail = {};
+    thumbnail.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_THUMBNAIL;
+    thumbnail.Header.BufferSz          = sizeof(thumbnail);
+    thumbnail.Width                    = 48;
+    thumbnail.Height                   = 32;
+
+    mfxExtBuffer *extBufs[]  = { &thumbnail.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // the stream has a single IDR frame
+    mfxU32 numFrames = 0;
+    for (;;) {
+        mfxBitstream *bs = mfxBS.DataLength ? &mfxBS : nullptr;
+
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxSyncPoint syncp               = {};
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &pmfxOutSurface, &syncp);
+        if (sts == MFX_ERR_MORE_DATA && bs)
+            continue;
+        if (sts == MFX_ERR_MORE_DATA)
+            break;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        ASSERT_NE(pmfxOutSurface, nullptr);
+        ASSERT_EQ(pmfxOutSurface->Info.CropW, 48);
+        ASSERT_EQ(pmfxOutSurface->Info.CropH, 32);
+        ASSERT_EQ(pmfxOutSurface->Info.FourCC, MFX_FOURCC_IYUV);
+        numFrames++;
+
+        sts = pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+    ASSERT_EQ(numFrames, 1);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeFrameAsync, ThumbnailIntervalAndCountLimitFrames) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
+    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // every jpeg frame is a key frame, frames are 3000 apart so every other one is taken
+    mfxExtCpuDecodeThumbnail thumbnail = {};
+    thumbnail.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_THUMBNAIL;
+    thumbnail.Header.BufferSz          = sizeof(thumbnail);
+    thumbnail.Width                    = 16;
+    thumbnail.Height                   = 16;
+    thumbnail.Interval                 = 6000;
+    thumbnail.MaxCount                 = 2;
+
+    mfxExtBuffer *extBufs[]  = { &thumbnail.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxU64 expectedTimeStamps[] = { 3000, 9000 };
+    mfxU32 numFrames            = 0;
+
+    for (mfxU32 i = 0; i < 4; i++) {
+        mfxU32 end = test_bitstream_32x32_mjpeg::getlen();
+        if (i < 3)
+            end = test_bitstream_32x32_mjpeg::getpos(i + 1);
+        mfxBS.DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
+        mfxBS.DataOffset = test_bitstream_32x32_mjpeg::getpos(i);
+        mfxBS.DataLength = end - mfxBS.DataOffset;
+        mfxBS.TimeStamp  = (i + 1) * 3000;
+
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxSyncPoint syncp               = {};
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+        if (sts == MFX_ERR_MORE_DATA)
+            continue;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        if (!pmfxOutSurface) {
+            // all thumbnails returned
+            ASSERT_EQ(numFrames, 2);
+            continue;
+        }
+        ASSERT_LT(numFrames, 2);
+        ASSERT_EQ(pmfxOutSurface->Data.TimeStamp, expectedTimeStamps[numFrames]);
+        ASSERT_EQ(pmfxOutSurface->Info.CropW, 16);
+        numFrames++;
+
+        sts = pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+    ASSERT_EQ(numFrames, 2);
+
+    // the count is reached, no output and the input is left alone
+    mfxBS.DataOffset = 0;
+    mfxBS.DataLength = test_bitstream_32x32_mjpeg::getpos(1);
+
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+    sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(pmfxOutSurface, nullptr);
+    ASSERT_EQ(mfxBS.DataOffset, 0);
+    ASSERT_EQ(mfxBS.DataLength, test_bitstream_32x32_mjpeg::getpos(1));
+
+    sts = MFXVideoDECODE_DecodeFrameAsync(session, nullptr, nullptr, &pmfxOutSurface, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeFrameAsync, ThumbnailJPEGDecodesReducedSize) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
+    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // 1/4 size is decoded directly, nothing is left to scale
+    mfxExtCpuDecodeThumbnail thumbnail = {};
+    thumbnail.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_THUMBNAIL;
+    thumbnail.Header.BufferSz          = sizeof(thumbnail);
+    thumbnail.Width                    = 8;
+    thumbnail.Height                   = 8;
+
+    mfxExtBuffer *extBufs[]  = { &thumbnail.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxBS.DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
+    mfxBS.DataOffset = 0;
+    mfxBS.DataLength = test_bitstream_32x32_mjpeg::getpos(1);
+
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+    sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(pmfxOutSurface, nullptr);
+    ASSERT_EQ(pmfxOutSurface->Info.CropW, 8);
+    ASSERT_EQ(pmfxOutSurface->Info.CropH, 8);
+
+    sts = pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // the stream size is still reported
+    mfxVideoParam testparam = { 0 };
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &testparam);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(testparam.mfx.FrameInfo.Width, 32);
+    ASSERT_EQ(testparam.mfx.FrameInfo.Height, 32);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeFrameAsync, EoSReturnsFrame) {
+    mfxStatus sts = MFX_ERR_NONE;
+
+    mfxVersion ver = {};
+    mfxSession session;
+    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
+    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxU32 nSurfNumDec            = 8;
+    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
+    mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
+    mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
+
+    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+
+    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
+        decSurfaces[i]            = { 0 };
+        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
+        int buf_offset            = i * surfW * surfH;
+        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
+        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
+        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
+        decSurfaces[i].Data.Pitch = surfW;
+    }
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    if (sts != MFX_ERR_NONE) {
+        if (decSurfaces)
+            delete[] decSurfaces;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+    int nIndex                       = 0;
+
+    mfxBS.DataFlag = MFX_BITSTREAM_EOS;
+
+    int frame = 2; //use the 3rd frame in the bitstream
+
+    mfxBS.Data = test_bitstream_32x32_mjpeg::getdata() + test_bitstream_32x32_mjpeg::getpos(frame);
+    mfxBS.DataLength =
+        test_bitstream_32x32_mjpeg::getpos(frame + 1) - test_bitstream_32x32_mjpeg::getpos(frame);
+    mfxBS.DataOffset = 0;
+
+    sts = MFXVideoDECODE_DecodeFrameAsync(session,
+                                          &mfxBS,
+                                          &decSurfaces[nIndex++],
+                                          &pmfxOutSurface,
+                                          &syncp);
+    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+
+    sts = MFXVideoDECODE_DecodeFrameAsync(session,
+                                          nullptr,
+                                          &decSurfaces[nIndex++],
+                                          &pmfxOutSurface,
+                                          &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    delete[] DECoutbuf;
+    delete[] decSurfaces;
+}
+
+TEST(DecodeFrameAsync, BSTimestampReturnsFrameTimestamp) {
+    mfxStatus sts = MFX_ERR_NONE;
+
+    mfxVersion ver = {};
+    mfxSession session;
+    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams                = { 0 };
+    mfxDecParams.mfx.CodecId                  = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern                    = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxDecParams.mfx.FrameInfo.Width          = 32;
+    mfxDecParams.mfx.FrameInfo.CropW          = 32;
+    mfxDecParams.mfx.FrameInfo.Height         = 32;
+    mfxDecParams.mfx.FrameInfo.CropH          = 32;
+    mfxDecParams.mfx.FrameInfo.FourCC         = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.BitDepthLuma   = 8;
+    mfxDecParams.mfx.FrameInfo.BitDepthChroma = 8;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
+    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+
+    mfxU32 nSurfNumDec            = 1;
+    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
+    mfxU32 surfW                  = 32;
+    mfxU32 surfH                  = 32;
+
+    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+
+    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
+        decSurfaces[i]            = { 0 };
+        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
+        int buf_offset            = i * surfW * surfH;
+        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
+        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
+        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
+        decSurfaces[i].Data.Pitch = surfW;
+    }
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    if (sts != MFX_ERR_NONE) {
+        if (decSurfaces)
+            delete[] decSurfaces;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+
+    mfxBS.DataFlag = MFX_BITSTREAM_COMPLETE_FRAME;
+
+    mfxBS.Data       = test_bitstream_32x32_mjpeg::getdata();
+    mfxBS.DataLength = test_bitstream_32x32_mjpeg::getpos(1);
+    mfxBS.DataOffset = 0;
+    mfxBS.TimeStamp  = 111111;
+
+    sts =
+        MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, &decSurfaces[0], &pmfxOutSurface, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(decSurfaces[0].Data.TimeStamp, 111111);
+
+    sts = MFXClose(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    delete[] DECoutbuf;
+    delete[] decSurfaces;
+}
+
+TEST(DecodeFrameAsync, CompleteFrameHEVCReturnsFrame) {
+    mfxStatus sts = MFX_ERR_NONE;
+
+    mfxVersion ver = {};
+    mfxSession session;
+    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxU32 nSurfNumDec            = 8;
+    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
+    mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
+    mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
+
+    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+
+    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
+        decSurfaces[i]            = { 0 };
+        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
+        int buf_offset            = i * surfW * surfH;
+        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
+        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
+        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
+        decSurfaces[i].Data.Pitch = surfW;
+    }
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    if (sts != MFX_ERR_NONE) {
+        if (decSurfaces)
+            delete[] decSurfaces;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+    int nIndex                       = 0;
+
+    mfxBS.DataFlag = MFX_BITSTREAM_COMPLETE_FRAME;
+
+    mfxBS.Data       = test_bitstream_96x64_8bit_hevc::getdata();
+    mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getpos(1);
+    mfxBS.DataOffset = 0;
+
+    sts = MFXVideoDECODE_DecodeFrameAsync(session,
+                                          &mfxBS,
+                                          &decSurfaces[nIndex++],
+                                          &pmfxOutSurface,
+                                          &syncp);
+    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+
+    sts = MFXVideoDECODE_DecodeFrameAsync(session,
+                                          nullptr,
+                                          &decSurfaces[nIndex++],
+                                          &pmfxOutSurface,
+                                          &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    delete[] DECoutbuf;
+    delete[] decSurfaces;
+}
+
+TEST(DecodeFrameAsync, InsufficientInBitstreamReturnsMoreData) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxU32 nSurfNumDec            = 8;
+    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
+    mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
+    mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
+
+    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+
+    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
+        decSurfaces[i]            = { 0 };
+        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
+        int buf_offset            = i * surfW * surfH;
+        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
+        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
+        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
+        decSurfaces[i].Data.Pitch = surfW;
+    }
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    if (sts != MFX_ERR_NONE) {
+        if (decSurfaces)
+            delete[] decSurfaces;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+
+    mfxBS.MaxLength = mfxBS.DataLength = 1;
+    mfxSyncPoint syncp;
+    int nIndex                       = 0;
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    sts                              = MFXVideoDECODE_DecodeFrameAsync(session,
+                                          &mfxBS,
+                                          &decSurfaces[nIndex++],
+                                          &pmfxOutSurface,
+                                          &syncp);
+    EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
+
+    sts = MFXClose(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    delete[] DECoutbuf;
+    delete[] decSurfaces;
+}
+
+TEST(DecodeFrameAsync, LazyInitFromSmallReadsReturnsFrame) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxU8 *stream = test_bitstream_96x64_8bit_hevc::getdata();
+    mfxU32 length = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxU32 pos    = 0;
+
+    // each read is passed once, as a network reader without its own buffering would
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+    while (!pmfxOutSurface) {
+        mfxBitstream mfxBS = { 0 };
+        mfxBS.CodecId      = MFX_CODEC_HEVC;
+        mfxBS.Data         = stream + pos;
+        mfxBS.DataLength   = std::min<mfxU32>(length - pos, 64);
+        mfxBS.MaxLength    = mfxBS.DataLength;
+
+        mfxBitstream *bs = (pos < length) ? &mfxBS : nullptr;
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &pmfxOutSurface, &syncp);
+        if (sts == MFX_ERR_MORE_DATA) {
+            ASSERT_NE(bs, nullptr);
+            ASSERT_EQ(mfxBS.DataLength, 0);
+        }
+        else {
+            ASSERT_EQ(sts, MFX_ERR_NONE);
+        }
+        pos += mfxBS.DataOffset;
+    }
+
+    ASSERT_EQ(pmfxOutSurface->Info.CropW, 96);
+    ASSERT_EQ(pmfxOutSurface->Info.CropH, 64);
+    sts = pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+// frames decoded with internal memory, the stream given in one piece
+static int CountDecodedFrames(mfxU8 *data, mfxU32 length) {
+    mfxVersion ver = {};
+    mfxSession session;
+    if (MFXInit(MFX_IMPL_SOFTWARE, &ver, &session) != MFX_ERR_NONE)
+        return -1;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.CodecId      = MFX_CODEC_HEVC;
+    mfxBS.Data         = data;
+    mfxBS.DataLength   = length;
+    mfxBS.MaxLength    = length;
+
+    int frames = 0;
+    mfxStatus sts;
+    do {
+        mfxBitstream *bs                 = mfxBS.DataLength ? &mfxBS : nullptr;
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxSyncPoint syncp               = {};
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &pmfxOutSurface, &syncp);
+        if (sts == MFX_ERR_NONE) {
+            pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+            frames++;
+        }
+        else if (sts == MFX_ERR_MORE_DATA && bs) {
+            sts = MFX_ERR_NONE;
+        }
+    } while (sts == MFX_ERR_NONE);
+
+    MFXClose(session);
+    return frames;
+}
+
+TEST(DecodeFrameAsync, RingBitstreamReturnsAllFrames) {
+    mfxU8 *stream = test_bitstream_96x64_8bit_hevc::getdata();
+    mfxU32 length = test_bitstream_96x64_8bit_hevc::getlen();
+
+    int expected = CountDecodedFrames(stream, length);
+    ASSERT_GT(expected, 0);
+
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // smaller than the stream and not a multiple of the writes, so data wraps mid-frame
+    std::vector<mfxU8> ring(1000);
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.CodecId      = MFX_CODEC_HEVC;
+    mfxBS.DataFlag     = MFX_CPU_BITSTREAM_RING;
+    mfxBS.Data         = ring.data();
+    mfxBS.MaxLength    = (mfxU32)ring.size();
+
+    mfxU32 pos = 0;
+    int frames = 0;
+    for (;;) {
+        // the app appends at the end of the data, wrapping to the start of the ring
+        while (pos < length && mfxBS.DataLength < mfxBS.MaxLength) {
+            mfxU32 writePos = (mfxBS.DataOffset + mfxBS.DataLength) % mfxBS.MaxLength;
+            mfxU32 size     = std::min<mfxU32>(length - pos, 300);
+            size            = std::min(size, mfxBS.MaxLength - mfxBS.DataLength);
+            size            = std::min(size, mfxBS.MaxLength - writePos);
+            memcpy(ring.data() + writePos, stream + pos, size);
+            mfxBS.DataLength += size;
+            pos += size;
+        }
+
+        mfxBitstream *bs                 = (pos < length || mfxBS.DataLength) ? &mfxBS : nullptr;
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxSyncPoint syncp               = {};
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &pmfxOutSurface, &syncp);
+        if (sts == MFX_ERR_MORE_DATA && !bs)
+            break;
+        if (sts == MFX_ERR_MORE_DATA)
+            continue;
+
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        ASSERT_LT(mfxBS.DataOffset, mfxBS.MaxLength);
+        pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+        frames++;
+    }
+    ASSERT_EQ(frames, expected);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeFrameAsync, AnalyticsExportedOnOutputSurfaces) {
+#ifndef ENABLE_ENCODER_H264
+    GTEST_SKIP();
+#endif
+    // x264 turns adaptive quantization off in CQP mode, so every P block keeps the frame QP
+    const mfxU16 qp = 30;
+    std::vector<mfxU8> stream;
+    std::vector<mfxU16> frameTypes;
+    mfxStatus sts = EncodeAVCStream(qp, 8, -1, nullptr, &stream, &frameTypes);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(frameTypes.size(), (size_t)8);
+
+    mfxVersion ver = {};
+    mfxSession session;
+    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_AVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = (mfxU32)stream.size();
+    mfxBS.Data                         = stream.data();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCpuDecodeAnalytics analytics = {};
+    analytics.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_ANALYTICS;
+    analytics.Header.BufferSz          = sizeof(analytics);
+    analytics.MotionVectors            = MFX_CODINGOPTION_ON;
+    analytics.QP                       = 5;
+
+    mfxExtBuffer *extBufs[]  = { &analytics.Header };
+    mfxDecParams.ExtParam    = extBufs;
+    mfxDecParams.NumExtParam = 1;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_VIDEO_PARAM);
+
+    analytics.QP = MFX_CODINGOPTION_ON;
+    sts          = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    size_t frames = 0;
+    do {
+        mfxBitstream *bs                 = mfxBS.DataLength ? &mfxBS : nullptr;
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxSyncPoint syncp               = {};
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &pmfxOutSurface, &syncp);
+        if (sts == MFX_ERR_MORE_DATA && bs) {
+            sts = MFX_ERR_NONE;
+            continue;
+        }
+        if (sts != MFX_ERR_NONE)
+            break;
+        ASSERT_LT(frames, frameTypes.size());
+        bool isP = (frameTypes[frames] & MFX_FRAMETYPE_P) != 0;
+        frames++;
+
+        mfxGUID guid     = MFX_GUID_CPU_FRAME_ANALYTICS;
+        mfxHDL interface = nullptr;
+        sts = pmfxOutSurface->FrameInterface->QueryInterface(pmfxOutSurface, guid, &interface);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+
+        mfxCpuFrameAnalytics *frameAnalytics = reinterpret_cast<mfxCpuFrameAnalytics *>(interface);
+        ASSERT_NE(frameAnalytics, nullptr);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(frameAnalytics->BlockX) % 64, 0);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(frameAnalytics->Reference) % 64, 0);
+
+        // every array is zero from the count up to the next multiple of 64
+        mfxU32 count  = frameAnalytics->NumMotionVectors;
+        mfxU32 padded = (count + 63) & ~63u;
+        for (mfxU32 i = count; i < padded; i++) {
+            ASSERT_EQ(frameAnalytics->BlockX[i], 0);
+            ASSERT_EQ(frameAnalytics->BlockY[i], 0);
+            ASSERT_EQ(frameAnalytics->MotionX[i], 0);
+            ASSERT_EQ(frameAnalytics->MotionY[i], 0);
+            ASSERT_EQ(frameAnalytics->BlockW[i], 0);
+            ASSERT_EQ(frameAnalytics->BlockH[i], 0);
+            ASSERT_EQ(frameAnalytics->Reference[i], 0);
+        }
+
+        ASSERT_NE(frameAnalytics->QP, nullptr);
+        ASSERT_EQ(frameAnalytics->QPBlockSize, 16);
+        ASSERT_EQ(frameAnalytics->QPPitch % 64, 0);
+        ASSERT_GE(frameAnalytics->QPWidth * frameAnalytics->QPBlockSize,
+                  pmfxOutSurface->Info.CropW);
+        ASSERT_GE(frameAnalytics->QPHeight * frameAnalytics->QPBlockSize,
+                  pmfxOutSurface->Info.CropH);
+        for (mfxU32 y = 0; y < frameAnalytics->QPHeight; y++) {
+            const mfxU8 *row = frameAnalytics->QP + y * frameAnalytics->QPPitch;
+            for (mfxU32 x = frameAnalytics->QPWidth; x < frameAnalytics->QPPitch; x++)
+                ASSERT_EQ(row[x], 0);
+            if (isP) {
+                for (mfxU32 x = 0; x < frameAnalytics->QPWidth; x++)
+                    ASSERT_EQ(row[x], qp);
+            }
+        }
+
+        // the texture moves between frames, so P frames have inter blocks
+        if (isP)
+            ASSERT_GT(count, (mfxU32)0);
+
+        sts = pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    } while (sts == MFX_ERR_NONE);
+    ASSERT_EQ(frames, frameTypes.size());
+    ASSERT_TRUE(frameTypes[1] & MFX_FRAMETYPE_P);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeFrameAsync, NullSessionReturnsInvalidHandle) {
+    mfxStatus sts = MFXVideoDECODE_DecodeFrameAsync(0, nullptr, nullptr, nullptr, nullptr);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
+}
+
+TEST(DecodeFrameAsync, NullSurfaceOutReturnsErrNull) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams;
+    memset(&mfxDecParams, 0, sizeof(mfxDecParams));
+    mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxU32 nSurfNumDec            = 8;
+    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
+    mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
+    mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
+
+    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+
+    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
+        decSurfaces[i]            = { 0 };
+        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
+        int buf_offset            = i * surfW * surfH;
+        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
+        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
+        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
+        decSurfaces[i].Data.Pitch = surfW;
+    }
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    if (sts != MFX_ERR_NONE) {
+        if (decSurfaces)
+            delete[] decSurfaces;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+
+    mfxBS.MaxLength = mfxBS.DataLength = 1;
+    int nIndex                         = 0;
+    mfxFrameSurface1 *pmfxOutSurface   = nullptr;
+    sts                                = MFXVideoDECODE_DecodeFrameAsync(session,
+                                          &mfxBS,
+                                          &decSurfaces[nIndex++],
+                                          &pmfxOutSurface,
+                                          nullptr);
+    EXPECT_EQ(sts, MFX_ERR_NULL_PTR);
+
+    sts = MFXClose(session);
+
+    delete[] DECoutbuf;
+    delete[] decSurfaces;
+}
+
+TEST(DecodeFrameAsync, NullSyncpReturnsErrNull) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams;
+    memset(&mfxDecParams, 0, sizeof(mfxDecParams));
+    mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxU32 nSurfNumDec            = 8;
     mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
     mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
     mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
@@ -803,39 +2279,53 @@ TEST(DecodeFrameAsync, CompleteFrameHEVCReturnsFrame) {
             delete[] decSurfaces;
         ASSERT_EQ(sts, MFX_ERR_NONE);
     }
+    else {
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxBS.MaxLength = mfxBS.DataLength = 1;
+        int nIndex                         = 0;
+        sts                                = MFXVideoDECODE_DecodeFrameAsync(session,
+                                              &mfxBS,
+                                              &decSurfaces[nIndex++],
+                                              &pmfxOutSurface,
+                                              nullptr);
+        EXPECT_EQ(sts, MFX_ERR_NULL_PTR);
 
-    mfxFrameSurface1 *pmfxOutSurface = nullptr;
-    mfxSyncPoint syncp               = {};
-    int nIndex                       = 0;
+        sts = MFXClose(session);
 
-    mfxBS.DataFlag = MFX_BITSTREAM_COMPLETE_FRAME;
+        delete[] DECoutbuf;
+        delete[] decSurfaces;
+    }
+}
 
-    mfxBS.Data       = test_bitstream_96x64_8bit_hevc::getdata();
-    mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getpos(1);
-    mfxBS.DataOffset = 0;
+TEST(DecodeFrameAsync, NullSurfaceWorkReturnsErrMoreData) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    sts = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          &mfxBS,
-                                          &decSurfaces[nIndex++],
-                                          &pmfxOutSurface,
-                                          &syncp);
-    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+    mfxVideoParam mfxDecParams;
+    memset(&mfxDecParams, 0, sizeof(mfxDecParams));
+    mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
-    sts = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          nullptr,
-                                          &decSurfaces[nIndex++],
-                                          &pmfxOutSurface,
-                                          &syncp);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
 
-    sts = MFXClose(session);
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    delete[] DECoutbuf;
-    delete[] decSurfaces;
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+
+    mfxSyncPoint syncp;
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+
+    sts = MFXClose(session);
 }
 
-TEST(DecodeFrameAsync, InsufficientInBitstreamReturnsMoreData) {
+TEST(DecodeFrameAsync, DecodeUninitializedReturnsNotInitialized) {
     mfxVersion ver = {};
     mfxSession session;
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
@@ -859,173 +2349,635 @@ TEST(DecodeFrameAsync, InsufficientInBitstreamReturnsMoreData) {
 
     mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
 
-    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
-        decSurfaces[i]            = { 0 };
-        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
-        int buf_offset            = i * surfW * surfH;
-        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
-        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
-        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
-        decSurfaces[i].Data.Pitch = surfW;
+    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
+        decSurfaces[i]            = { 0 };
+        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
+        int buf_offset            = i * surfW * surfH;
+        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
+        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
+        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
+        decSurfaces[i].Data.Pitch = surfW;
+    }
+
+    mfxSyncPoint syncp;
+    int nIndex                       = 0;
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    sts                              = MFXVideoDECODE_DecodeFrameAsync(session,
+                                          &mfxBS,
+                                          &decSurfaces[nIndex++],
+                                          &pmfxOutSurface,
+                                          &syncp);
+    EXPECT_EQ(sts, MFX_ERR_NOT_INITIALIZED);
+
+    sts = MFXClose(session);
+
+    delete[] DECoutbuf;
+    delete[] decSurfaces;
+}
+// if linking directly against the runtime, we can
+//   test functions which the dispatcher does not
+//   expose directly to the application
+#ifdef VPL_UTEST_LINK_RUNTIME
+
+TEST(DecodeFrameBatch, SeveralSessionsReturnFrames) {
+    const mfxU32 numStreams = 3;
+    mfxSession sessions[numStreams];
+    mfxBitstream bitstreams[numStreams];
+    mfxCpuDecodeBatchItem items[numStreams];
+
+    mfxU32 frameLength =
+        test_bitstream_32x32_mjpeg::getpos(1) - test_bitstream_32x32_mjpeg::getpos(0);
+
+    for (mfxU32 i = 0; i < numStreams; i++) {
+        mfxVersion ver = {};
+        mfxStatus sts  = MFXInit(MFX_IMPL_SOFTWARE, &ver, &sessions[i]);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+
+        // decoders are initialized from the first frame
+        bitstreams[i]            = { 0 };
+        bitstreams[i].CodecId    = MFX_CODEC_JPEG;
+        bitstreams[i].DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
+        bitstreams[i].Data       = test_bitstream_32x32_mjpeg::getdata();
+        bitstreams[i].DataLength = frameLength;
+        bitstreams[i].MaxLength  = frameLength;
+
+        items[i]           = {};
+        items[i].Session   = sessions[i];
+        items[i].Bitstream = &bitstreams[i];
+    }
+
+    mfxStatus sts = MFXVideoDECODE_DecodeFrameBatch(items, numStreams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    for (mfxU32 i = 0; i < numStreams; i++) {
+        ASSERT_EQ(items[i].Status, MFX_ERR_NONE);
+        ASSERT_NE(items[i].SurfaceOut, nullptr);
+        ASSERT_EQ(items[i].SurfaceOut->Info.CropW, 32);
+
+        sts = items[i].SurfaceOut->FrameInterface->Release(items[i].SurfaceOut);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+
+        sts = MFXClose(sessions[i]);
+        EXPECT_EQ(sts, MFX_ERR_NONE);
+    }
+}
+
+TEST(DecodeFrameBatch, RepeatedSessionReturnsUndefinedBehavior) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxCpuDecodeBatchItem items[2] = {};
+    items[0].Session               = session;
+    items[1].Session               = session;
+
+    sts = MFXVideoDECODE_DecodeFrameBatch(items, 2);
+    ASSERT_EQ(sts, MFX_ERR_UNDEFINED_BEHAVIOR);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeFrameBatch, NullItemsReturnsErrNull) {
+    mfxStatus sts = MFXVideoDECODE_DecodeFrameBatch(nullptr, 1);
+    ASSERT_EQ(sts, MFX_ERR_NULL_PTR);
+}
+
+TEST(BitstreamFillRing, FileFillsWrappedFreeSpace) {
+    FILE *file = tmpfile();
+    ASSERT_NE(file, nullptr);
+
+    mfxU8 content[200];
+    for (mfxU32 i = 0; i < sizeof(content); i++)
+        content[i] = (mfxU8)i;
+    ASSERT_EQ(fwrite(content, 1, sizeof(content), file), sizeof(content));
+    fflush(file);
+    rewind(file);
+
+    // 20 bytes of data at the end leave free space from 90 that wraps to 0..69
+    mfxU8 ring[100]    = {};
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.DataFlag     = MFX_CPU_BITSTREAM_RING;
+    mfxBS.Data         = ring;
+    mfxBS.MaxLength    = sizeof(ring);
+    mfxBS.DataOffset   = 70;
+    mfxBS.DataLength   = 20;
+
+    mfxU32 bytesRead = 0;
+    mfxStatus sts    = MFXBitstream_FillRing(&mfxBS, fileno(file), &bytesRead);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(bytesRead, 80);
+    ASSERT_EQ(mfxBS.DataLength, 100);
+    ASSERT_EQ(ring[90], 0);
+    ASSERT_EQ(ring[99], 9);
+    ASSERT_EQ(ring[0], 10);
+    ASSERT_EQ(ring[69], 79);
+
+    sts = MFXBitstream_FillRing(&mfxBS, fileno(file), &bytesRead);
+    ASSERT_EQ(sts, MFX_ERR_NOT_ENOUGH_BUFFER);
+
+    // consume everything, the rest of the file fits and then end of file is reported
+    mfxBS.DataOffset = 0;
+    mfxBS.DataLength = 0;
+    sts              = MFXBitstream_FillRing(&mfxBS, fileno(file), &bytesRead);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(bytesRead, 100);
+    ASSERT_EQ(ring[0], 80);
+
+    mfxBS.DataLength = 0;
+    sts              = MFXBitstream_FillRing(&mfxBS, fileno(file), &bytesRead);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(bytesRead, 20);
+
+    mfxBS.DataLength = 0;
+    sts              = MFXBitstream_FillRing(&mfxBS, fileno(file), &bytesRead);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(bytesRead, 0);
+
+    fclose(file);
+}
+
+TEST(BitstreamFillRing, LinearBitstreamReturnsUnsupported) {
+    mfxU8 data[16]     = {};
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.Data         = data;
+    mfxBS.MaxLength    = sizeof(data);
+
+    mfxU32 bytesRead = 0;
+    mfxStatus sts    = MFXBitstream_FillRing(&mfxBS, 0, &bytesRead);
+    ASSERT_EQ(sts, MFX_ERR_UNSUPPORTED);
+}
+
+// decodes frame i of stream from start[i] to start[i + 1] in a runtime buffer with the
+// default threading, each buffer is given back as soon as the frame has been submitted
+static void DecodeFromBitstreamBuffers(mfxU32 codecId,
+                                       const mfxU8 *stream,
+                                       const std::vector<mfxU32> &start,
+                                       mfxU32 *numOutput,
+                                       mfxExtCpuDecodeStat *decStat) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    *numOutput = 0;
+    for (size_t i = 0; i + 1 < start.size(); i++) {
+        mfxU32 frameLength = start[i + 1] - start[i];
+        mfxBitstream mfxBS = { 0 };
+        sts                = MFXBitstream_GetBuffer(frameLength, &mfxBS);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        ASSERT_GE(mfxBS.MaxLength, frameLength);
+
+        // garbage after the frame is fine, it is zeroed on submission
+        memset(mfxBS.Data, 0xFF, mfxBS.MaxLength);
+        memcpy(mfxBS.Data, stream + start[i], frameLength);
+        mfxBS.DataLength = frameLength;
+        mfxBS.DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
+        mfxBS.CodecId    = codecId;
+
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxSyncPoint syncp               = {};
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+        ASSERT_EQ(mfxBS.DataLength, 0);
+
+        mfxStatus releaseSts = MFXBitstream_ReleaseBuffer(&mfxBS);
+        ASSERT_EQ(releaseSts, MFX_ERR_NONE);
+        ASSERT_EQ(mfxBS.Data, nullptr);
+
+        if (sts == MFX_ERR_NONE) {
+            (*numOutput)++;
+            pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+        }
+        else {
+            ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+        }
+    }
+
+    // frames still in the decoder only exist in buffers the app has given back
+    for (;;) {
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxSyncPoint syncp               = {};
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, nullptr, nullptr, &pmfxOutSurface, &syncp);
+        if (sts != MFX_ERR_NONE)
+            break;
+        (*numOutput)++;
+        pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+    }
+    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+
+    mfxExtBuffer *extBufs[] = { &decStat->Header };
+    mfxVideoParam par       = { 0 };
+    par.ExtParam            = extBufs;
+    par.NumExtParam         = 1;
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &par);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(BitstreamBuffer, JPEGFramesAreNotCopied) {
+    std::vector<mfxU32> start;
+    for (mfxU32 i = 0; i < 4; i++)
+        start.push_back(test_bitstream_32x32_mjpeg::getpos(i));
+    start.push_back(test_bitstream_32x32_mjpeg::getlen());
+
+    mfxU32 numOutput            = 0;
+    mfxExtCpuDecodeStat decStat = {};
+    decStat.Header.BufferId     = MFX_EXTBUFF_CPU_DECODE_STAT;
+    decStat.Header.BufferSz     = sizeof(decStat);
+    ASSERT_NO_FATAL_FAILURE(DecodeFromBitstreamBuffers(MFX_CODEC_JPEG,
+                                                       test_bitstream_32x32_mjpeg::getdata(),
+                                                       start,
+                                                       &numOutput,
+                                                       &decStat));
+
+    ASSERT_EQ(numOutput, 4);
+    ASSERT_EQ(decStat.NumCorrupted, 0);
+    ASSERT_EQ(decStat.BytesConsumed, test_bitstream_32x32_mjpeg::getlen());
+    ASSERT_EQ(decStat.BytesCopied, 0);
+}
+
+TEST(BitstreamBuffer, HEVCFramesAreNotCopied) {
+    std::vector<mfxU32> start;
+    for (mfxU32 i = 0; i < 8; i++)
+        start.push_back(test_bitstream_96x64_8bit_hevc::getpos(i));
+    start.push_back(test_bitstream_96x64_8bit_hevc::getlen());
+
+    mfxU32 numOutput            = 0;
+    mfxExtCpuDecodeStat decStat = {};
+    decStat.Header.BufferId     = MFX_EXTBUFF_CPU_DECODE_STAT;
+    decStat.Header.BufferSz     = sizeof(decStat);
+    ASSERT_NO_FATAL_FAILURE(DecodeFromBitstreamBuffers(MFX_CODEC_HEVC,
+                                                       test_bitstream_96x64_8bit_hevc::getdata(),
+                                                       start,
+                                                       &numOutput,
+                                                       &decStat));
+
+    ASSERT_EQ(numOutput, 8);
+    ASSERT_EQ(decStat.NumCorrupted, 0);
+    ASSERT_EQ(decStat.BytesCopied, 0);
+}
+
+TEST(BitstreamBuffer, AppMemoryIsCopiedWithFrameThreads) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // the same frame with padding, but in app memory the decoder cannot keep
+    mfxU32 frameLength = test_bitstream_96x64_8bit_hevc::getpos(1);
+    std::vector<mfxU8> frame(frameLength + 64, 0);
+    memcpy(frame.data(), test_bitstream_96x64_8bit_hevc::getdata(), frameLength);
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.Data         = frame.data();
+    mfxBS.DataLength   = frameLength;
+    mfxBS.MaxLength    = (mfxU32)frame.size();
+    mfxBS.DataFlag     = MFX_BITSTREAM_COMPLETE_FRAME;
+    mfxBS.CodecId      = MFX_CODEC_HEVC;
+
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+    sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+    if (sts == MFX_ERR_NONE)
+        pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+    else
+        ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+
+    mfxExtCpuDecodeThreading threading = {};
+    threading.Header.BufferId          = MFX_EXTBUFF_CPU_DECODE_THREADING;
+    threading.Header.BufferSz          = sizeof(threading);
+    mfxExtCpuDecodeStat decStat        = {};
+    decStat.Header.BufferId            = MFX_EXTBUFF_CPU_DECODE_STAT;
+    decStat.Header.BufferSz            = sizeof(decStat);
+
+    mfxExtBuffer *extBufs[] = { &threading.Header, &decStat.Header };
+    mfxVideoParam par       = { 0 };
+    par.ExtParam            = extBufs;
+    par.NumExtParam         = 2;
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &par);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    if (threading.Mode & MFX_CPU_DECODE_THREADING_FRAME)
+        ASSERT_EQ(decStat.BytesCopied, frameLength);
+    else
+        ASSERT_EQ(decStat.BytesCopied, 0);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(BitstreamBuffer, InvalidBuffersAreRejected) {
+    mfxBitstream mfxBS = { 0 };
+    mfxStatus sts      = MFXBitstream_GetBuffer(0x40000001, &mfxBS);
+    ASSERT_EQ(sts, MFX_ERR_UNSUPPORTED);
+
+    mfxU8 data[16] = {};
+    mfxBS.Data     = data;
+    sts            = MFXBitstream_ReleaseBuffer(&mfxBS);
+    ASSERT_EQ(sts, MFX_ERR_UNDEFINED_BEHAVIOR);
+}
+
+static std::string WriteTempFile(const char *name, const mfxU8 *data, mfxU32 length) {
+    std::string path = testing::TempDir() + name;
+    FILE *file       = fopen(path.c_str(), "wb");
+    if (file) {
+        fwrite(data, 1, length, file);
+        fclose(file);
+    }
+    return path;
+}
+
+TEST(BitstreamReader, AnnexBFramesDecodeInPlace) {
+    mfxU8 *stream    = test_bitstream_96x64_8bit_hevc::getdata();
+    mfxU32 length    = test_bitstream_96x64_8bit_hevc::getlen();
+    std::string path = WriteTempFile("reader_96x64.h265", stream, length);
+
+    mfxCpuBitstreamReader reader = nullptr;
+    mfxU32 numFrames             = 0;
+    mfxStatus sts = MFXBitstreamReader_Open(path.c_str(), MFX_CODEC_HEVC, &reader, &numFrames);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(numFrames, 8);
+
+    mfxVersion ver = {};
+    mfxSession session;
+    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // frames are split where the test stream's packets start
+    mfxU32 frames    = 0;
+    mfxU8 *firstData = nullptr;
+    mfxBitstream mfxBS;
+    while (MFXBitstreamReader_GetFrame(reader, &mfxBS) == MFX_ERR_NONE) {
+        if (!frames)
+            firstData = mfxBS.Data;
+        mfxU32 end = (frames + 1 < numFrames) ? test_bitstream_96x64_8bit_hevc::getpos(frames + 1)
+                                              : length;
+        ASSERT_EQ(mfxBS.DataFlag, MFX_BITSTREAM_COMPLETE_FRAME);
+        ASSERT_EQ(mfxBS.CodecId, MFX_CODEC_HEVC);
+        ASSERT_EQ(mfxBS.DataLength, end - test_bitstream_96x64_8bit_hevc::getpos(frames));
+        frames++;
+
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxSyncPoint syncp               = {};
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+        if (sts == MFX_ERR_NONE)
+            pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+        else
+            ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+        ASSERT_EQ(mfxBS.DataLength, 0);
+    }
+    ASSERT_EQ(frames, numFrames);
+
+    sts = MFXBitstreamReader_Rewind(reader);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    sts = MFXBitstreamReader_GetFrame(reader, &mfxBS);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(mfxBS.Data, firstData);
+    ASSERT_EQ(mfxBS.DataLength, test_bitstream_96x64_8bit_hevc::getpos(1));
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXBitstreamReader_Close(reader);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    remove(path.c_str());
+}
+
+TEST(BitstreamReader, JPEGImagesAreSplit) {
+    mfxU8 *stream    = test_bitstream_32x32_mjpeg::getdata();
+    mfxU32 length    = test_bitstream_32x32_mjpeg::getlen();
+    std::string path = WriteTempFile("reader_32x32.mjpeg", stream, length);
+
+    mfxCpuBitstreamReader reader = nullptr;
+    mfxU32 numFrames             = 0;
+    mfxStatus sts = MFXBitstreamReader_Open(path.c_str(), MFX_CODEC_JPEG, &reader, &numFrames);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(numFrames, 4);
+
+    mfxBitstream mfxBS;
+    sts = MFXBitstreamReader_GetFrame(reader, &mfxBS);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(mfxBS.DataLength,
+              test_bitstream_32x32_mjpeg::getpos(1) - test_bitstream_32x32_mjpeg::getpos(0));
+
+    sts = MFXBitstreamReader_Close(reader);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    remove(path.c_str());
+}
+
+// decodes every frame of the file with the default threading, the reader is closed
+// while the decoder still holds frames from it
+static void DecodeFromReader(const std::string &path,
+                             mfxU32 codecId,
+                             mfxU32 *numOutput,
+                             mfxExtCpuDecodeStat *decStat) {
+    mfxCpuBitstreamReader reader = nullptr;
+    mfxStatus sts = MFXBitstreamReader_Open(path.c_str(), codecId, &reader, nullptr);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVersion ver = {};
+    mfxSession session;
+    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    *numOutput = 0;
+    mfxBitstream mfxBS;
+    while (MFXBitstreamReader_GetFrame(reader, &mfxBS) == MFX_ERR_NONE) {
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxSyncPoint syncp               = {};
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+        if (sts == MFX_ERR_NONE) {
+            (*numOutput)++;
+            pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+        }
+        else {
+            ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+        }
     }
 
-    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
-    if (sts != MFX_ERR_NONE) {
-        if (decSurfaces)
-            delete[] decSurfaces;
-        ASSERT_EQ(sts, MFX_ERR_NONE);
+    sts = MFXBitstreamReader_Close(reader);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    for (;;) {
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxSyncPoint syncp               = {};
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, nullptr, nullptr, &pmfxOutSurface, &syncp);
+        if (sts != MFX_ERR_NONE)
+            break;
+        (*numOutput)++;
+        pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
     }
+    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
 
-    mfxBS.MaxLength = mfxBS.DataLength = 1;
-    mfxSyncPoint syncp;
-    int nIndex                       = 0;
-    mfxFrameSurface1 *pmfxOutSurface = nullptr;
-    sts                              = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          &mfxBS,
-                                          &decSurfaces[nIndex++],
-                                          &pmfxOutSurface,
-                                          &syncp);
-    EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
+    mfxExtBuffer *extBufs[] = { &decStat->Header };
+    mfxVideoParam par       = { 0 };
+    par.ExtParam            = extBufs;
+    par.NumExtParam         = 1;
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &par);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
     sts = MFXClose(session);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
 
-    delete[] DECoutbuf;
-    delete[] decSurfaces;
+TEST(BitstreamReader, AnnexBFramesAreNotCopied) {
+    std::string path = WriteTempFile("reader_nocopy_96x64.h265",
+                                     test_bitstream_96x64_8bit_hevc::getdata(),
+                                     test_bitstream_96x64_8bit_hevc::getlen());
+
+    mfxU32 numOutput            = 0;
+    mfxExtCpuDecodeStat decStat = {};
+    decStat.Header.BufferId     = MFX_EXTBUFF_CPU_DECODE_STAT;
+    decStat.Header.BufferSz     = sizeof(decStat);
+    ASSERT_NO_FATAL_FAILURE(DecodeFromReader(path, MFX_CODEC_HEVC, &numOutput, &decStat));
+    remove(path.c_str());
+
+    ASSERT_EQ(numOutput, 8);
+    ASSERT_EQ(decStat.NumCorrupted, 0);
+    ASSERT_EQ(decStat.BytesConsumed, test_bitstream_96x64_8bit_hevc::getlen());
+    ASSERT_EQ(decStat.BytesCopied, 0);
 }
 
-TEST(DecodeFrameAsync, NullSessionReturnsInvalidHandle) {
-    mfxStatus sts = MFXVideoDECODE_DecodeFrameAsync(0, nullptr, nullptr, nullptr, nullptr);
-    ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
+TEST(BitstreamReader, JPEGImagesAreNotCopied) {
+    std::string path = WriteTempFile("reader_nocopy_32x32.mjpeg",
+                                     test_bitstream_32x32_mjpeg::getdata(),
+                                     test_bitstream_32x32_mjpeg::getlen());
+
+    mfxU32 numOutput            = 0;
+    mfxExtCpuDecodeStat decStat = {};
+    decStat.Header.BufferId     = MFX_EXTBUFF_CPU_DECODE_STAT;
+    decStat.Header.BufferSz     = sizeof(decStat);
+    ASSERT_NO_FATAL_FAILURE(DecodeFromReader(path, MFX_CODEC_JPEG, &numOutput, &decStat));
+    remove(path.c_str());
+
+    ASSERT_EQ(numOutput, 4);
+    ASSERT_EQ(decStat.NumCorrupted, 0);
+    ASSERT_EQ(decStat.BytesCopied, 0);
 }
 
-TEST(DecodeFrameAsync, NullSurfaceOutReturnsErrNull) {
+TEST(BitstreamReader, MissingFileReturnsNotFound) {
+    std::string path             = testing::TempDir() + "reader_missing.h264";
+    mfxCpuBitstreamReader reader = nullptr;
+    mfxStatus sts = MFXBitstreamReader_Open(path.c_str(), MFX_CODEC_AVC, &reader, nullptr);
+    ASSERT_EQ(sts, MFX_ERR_NOT_FOUND);
+}
+
+TEST(EncodeFrameAsync, ReferenceOutputLendsPackets) {
     mfxVersion ver = {};
     mfxSession session;
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxVideoParam mfxDecParams;
-    memset(&mfxDecParams, 0, sizeof(mfxDecParams));
-    mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
-    mfxDecParams.IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxExtCpuEncodeOutput output = {};
+    output.Header.BufferId       = MFX_EXTBUFF_CPU_ENCODE_OUTPUT;
+    output.Header.BufferSz       = sizeof(output);
+    output.Mode                  = MFX_CPU_ENCODE_OUTPUT_REFERENCE;
+    mfxExtBuffer *extParam       = &output.Header;
 
-    mfxBitstream mfxBS = { 0 };
-    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
-    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+    mfxVideoParam mfxEncParams               = {};
+    mfxEncParams.mfx.CodecId                 = MFX_CODEC_JPEG;
+    mfxEncParams.mfx.FrameInfo.FourCC        = MFX_FOURCC_I420;
+    mfxEncParams.mfx.FrameInfo.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
+    mfxEncParams.mfx.FrameInfo.CropW         = 128;
+    mfxEncParams.mfx.FrameInfo.CropH         = 96;
+    mfxEncParams.mfx.FrameInfo.Width         = 128;
+    mfxEncParams.mfx.FrameInfo.Height        = 96;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtN = 30;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtD = 1;
+    mfxEncParams.IOPattern                   = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+    mfxEncParams.ExtParam                    = &extParam;
+    mfxEncParams.NumExtParam                 = 1;
 
-    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    sts = MFXVideoENCODE_Init(session, &mfxEncParams);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxU32 nSurfNumDec            = 8;
-    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
-    mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
-    mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
+    mfxU32 lumaSize = 128 * 96;
+    std::vector<mfxU8> frame(lumaSize * 3 / 2, 0);
 
-    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+    mfxFrameSurface1 surface = {};
+    surface.Info             = mfxEncParams.mfx.FrameInfo;
+    surface.Data.Y           = frame.data();
+    surface.Data.U           = surface.Data.Y + lumaSize;
+    surface.Data.V           = surface.Data.U + lumaSize / 4;
+    surface.Data.Pitch       = 128;
 
-    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
-        decSurfaces[i]            = { 0 };
-        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
-        int buf_offset            = i * surfW * surfH;
-        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
-        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
-        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
-        decSurfaces[i].Data.Pitch = surfW;
-    }
+    // no buffer of its own, the encoder's packet is handed out
+    mfxBitstream mfxBS = {};
+    mfxSyncPoint syncp;
+    sts = MFXVideoENCODE_EncodeFrameAsync(session, nullptr, &surface, &mfxBS, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(mfxBS.Data, nullptr);
+    ASSERT_GT(mfxBS.DataLength, (mfxU32)2);
+    EXPECT_EQ(mfxBS.Data[0], 0xFF);
+    EXPECT_EQ(mfxBS.Data[1], 0xD8);
 
-    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
-    if (sts != MFX_ERR_NONE) {
-        if (decSurfaces)
-            delete[] decSurfaces;
-        ASSERT_EQ(sts, MFX_ERR_NONE);
-    }
+    // a pending packet must be released before the next one
+    sts = MFXVideoENCODE_EncodeFrameAsync(session, nullptr, &surface, &mfxBS, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_UNDEFINED_BEHAVIOR);
 
-    mfxBS.MaxLength = mfxBS.DataLength = 1;
-    int nIndex                         = 0;
-    mfxFrameSurface1 *pmfxOutSurface   = nullptr;
-    sts                                = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          &mfxBS,
-                                          &decSurfaces[nIndex++],
-                                          &pmfxOutSurface,
-                                          nullptr);
-    EXPECT_EQ(sts, MFX_ERR_NULL_PTR);
+    mfxBitstream lent = mfxBS;
+    sts               = MFXVideoENCODE_ReleaseBitstream(session, &mfxBS);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(mfxBS.Data, nullptr);
+    ASSERT_EQ(mfxBS.DataLength, (mfxU32)0);
 
-    sts = MFXClose(session);
+    sts = MFXVideoENCODE_ReleaseBitstream(session, &lent);
+    ASSERT_EQ(sts, MFX_ERR_UNDEFINED_BEHAVIOR);
 
-    delete[] DECoutbuf;
-    delete[] decSurfaces;
+    // a packet not released is freed by Close()
+    sts = MFXVideoENCODE_EncodeFrameAsync(session, nullptr, &surface, &mfxBS, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(mfxBS.Data, nullptr);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
-TEST(DecodeFrameAsync, NullSyncpReturnsErrNull) {
+#endif // VPL_UTEST_LINK_RUNTIME
+
+TEST(DecodeGetPayload, UninitializedReturnsNotInitialized) {
     mfxVersion ver = {};
     mfxSession session;
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxVideoParam mfxDecParams;
-    memset(&mfxDecParams, 0, sizeof(mfxDecParams));
-    mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
-    mfxDecParams.IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
-
-    mfxBitstream mfxBS = { 0 };
-    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
-    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
-
-    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
-
-    mfxU32 nSurfNumDec            = 8;
-    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
-    mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
-    mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
+    mfxU8 data[64]     = {};
+    mfxPayload payload = {};
+    payload.Data       = data;
+    payload.BufSize    = sizeof(data);
+    mfxU64 ts          = 0;
 
-    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+    sts = MFXVideoDECODE_GetPayload(session, &ts, &payload);
+    ASSERT_EQ(sts, MFX_ERR_NOT_INITIALIZED);
 
-    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
-        decSurfaces[i]            = { 0 };
-        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
-        int buf_offset            = i * surfW * surfH;
-        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
-        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
-        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
-        decSurfaces[i].Data.Pitch = surfW;
-    }
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
 
-    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
-    if (sts != MFX_ERR_NONE) {
-        if (decSurfaces)
-            delete[] decSurfaces;
-        ASSERT_EQ(sts, MFX_ERR_NONE);
-    }
-    else {
-        mfxFrameSurface1 *pmfxOutSurface = nullptr;
-        mfxBS.MaxLength = mfxBS.DataLength = 1;
-        int nIndex                         = 0;
-        sts                                = MFXVideoDECODE_DecodeFrameAsync(session,
-                                              &mfxBS,
-                                              &decSurfaces[nIndex++],
-                                              &pmfxOutSurface,
-                                              nullptr);
-        EXPECT_EQ(sts, MFX_ERR_NULL_PTR);
+TEST(DecodeGetPayload, NullPayloadReturnsErrNull) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
-        sts = MFXClose(session);
+    sts = MFXVideoDECODE_GetPayload(session, nullptr, nullptr);
+    ASSERT_EQ(sts, MFX_ERR_NULL_PTR);
 
-        delete[] DECoutbuf;
-        delete[] decSurfaces;
-    }
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
-TEST(DecodeFrameAsync, NullSurfaceWorkReturnsErrMoreData) {
+TEST(DecodeGetPayload, DrainedDecoderReturnsEmptyPayload) {
     mfxVersion ver = {};
     mfxSession session;
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxVideoParam mfxDecParams;
-    memset(&mfxDecParams, 0, sizeof(mfxDecParams));
-    mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
-    mfxDecParams.IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
     mfxBitstream mfxBS = { 0 };
     mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
@@ -1035,16 +2987,59 @@ TEST(DecodeFrameAsync, NullSurfaceWorkReturnsErrMoreData) {
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
     sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxSyncPoint syncp;
     mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
     sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
-    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+    ASSERT_TRUE(sts == MFX_ERR_NONE || sts == MFX_ERR_MORE_DATA);
+    if (pmfxOutSurface)
+        pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
+
+    // drain whatever metadata the stream carried, then the ring reports empty
+    mfxU8 data[4096]   = {};
+    mfxPayload payload = {};
+    payload.Data       = data;
+    payload.BufSize    = sizeof(data);
+    mfxU64 ts          = 0;
+
+    int count = 0;
+    do {
+        sts = MFXVideoDECODE_GetPayload(session, &ts, &payload);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        ASSERT_LE(payload.NumBit, sizeof(data) * 8);
+    } while (payload.NumBit && ++count < 64);
+    ASSERT_EQ(payload.NumBit, 0);
 
     sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
-TEST(DecodeFrameAsync, DecodeUninitializedReturnsNotInitialized) {
+TEST(DecodeGetPayload, ClosedCaptionsReturnedAsRegisteredUserData) {
+    // ATSC A/53 caption SEI as an encoder writes it: T.35 header, GA94, two cc_data()
+    // triplets, marker bits
+    const mfxU8 userData[] = { 0xB5, 0x00, 0x31, 'G',  'A',  '9',  '4',
+                               0x03, 0x42, 0xFF, 0xFC, 0x94, 0x20, 0xFD,
+                               0x80, 0x80, 0xFF };
+    std::vector<mfxU8> sei = { 0x00, 0x00, 0x00, 0x01, 0x4E, 0x01, 0x04, sizeof(userData) };
+    sei.insert(sei.end(), userData, userData + sizeof(userData));
+    sei.push_back(0x80); // rbsp trailing bits
+
+    // the prefix SEI goes in front of the first slice
+    std::vector<mfxU8> stream(test_bitstream_96x64_8bit_hevc::getdata(),
+                              test_bitstream_96x64_8bit_hevc::getdata() +
+                                  test_bitstream_96x64_8bit_hevc::getlen());
+    size_t slice = 0;
+    for (size_t i = 0; i + 3 < stream.size(); i++) {
+        if (stream[i] == 0 && stream[i + 1] == 0 && stream[i + 2] == 1 &&
+            ((stream[i + 3] >> 1) & 0x3F) < 32) {
+            slice = (i > 0 && stream[i - 1] == 0) ? i - 1 : i;
+            break;
+        }
+    }
+    ASSERT_GT(slice, (size_t)0);
+    stream.insert(stream.begin() + slice, sei.begin(), sei.end());
+
     mfxVersion ver = {};
     mfxSession session;
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
@@ -1055,44 +3050,54 @@ TEST(DecodeFrameAsync, DecodeUninitializedReturnsNotInitialized) {
     mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
     mfxBitstream mfxBS = { 0 };
-    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
-    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+    mfxBS.Data         = stream.data();
+    mfxBS.DataLength   = (mfxU32)stream.size();
+    mfxBS.MaxLength    = (mfxU32)stream.size();
 
     sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxU32 nSurfNumDec            = 8;
-    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
-    mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
-    mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
-
-    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
-        decSurfaces[i]            = { 0 };
-        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
-        int buf_offset            = i * surfW * surfH;
-        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
-        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
-        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
-        decSurfaces[i].Data.Pitch = surfW;
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+    sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+    while (sts == MFX_ERR_MORE_DATA || (sts == MFX_ERR_NONE && !pmfxOutSurface)) {
+        sts = MFXVideoDECODE_DecodeFrameAsync(session,
+                                              mfxBS.DataLength ? &mfxBS : nullptr,
+                                              nullptr,
+                                              &pmfxOutSurface,
+                                              &syncp);
+        if (sts == MFX_ERR_MORE_DATA && !mfxBS.DataLength)
+            break;
     }
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(pmfxOutSurface, nullptr);
+    pmfxOutSurface->FrameInterface->Release(pmfxOutSurface);
 
-    mfxSyncPoint syncp;
-    int nIndex                       = 0;
-    mfxFrameSurface1 *pmfxOutSurface = nullptr;
-    sts                              = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          &mfxBS,
-                                          &decSurfaces[nIndex++],
-                                          &pmfxOutSurface,
-                                          &syncp);
-    EXPECT_EQ(sts, MFX_ERR_NOT_INITIALIZED);
+    mfxU8 data[4096]   = {};
+    mfxPayload payload = {};
+    payload.Data       = data;
+    payload.BufSize    = sizeof(data);
+    mfxU64 ts          = 0;
 
-    sts = MFXClose(session);
+    bool found = false;
+    do {
+        sts = MFXVideoDECODE_GetPayload(session, &ts, &payload);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        if (payload.NumBit && payload.Type == 4) {
+            ASSERT_EQ(payload.NumBit, sizeof(userData) * 8);
+            EXPECT_EQ(memcmp(payload.Data, userData, sizeof(userData)), 0);
+            found = true;
+        }
+    } while (payload.NumBit);
+    EXPECT_TRUE(found);
 
-    delete[] DECoutbuf;
-    delete[] decSurfaces;
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
 }
+
 /*!
    RunFrameVPPAsync overview
    Processes a single input frame to a single output frame. 
@@ -1408,6 +3413,93 @@ TEST(ProcessFrameAsync, ValidInputsReturnsErrNone) {
     delete[] surf_buf;
 }
 
+TEST(ProcessFrameAsync, I010ToI420DitherReturnsReducedPixels) {
+    mfxSession session;
+    mfxVersion ver = {};
+    ver.Major      = 2;
+    ver.Minor      = 1;
+
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // init VPP
+    mfxVideoParam mfxVPPParams;
+    memset(&mfxVPPParams, 0, sizeof(mfxVPPParams));
+    mfxVPPParams.IOPattern = MFX_IOPATTERN_IN_SYSTEM_MEMORY | MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxVPPParams.vpp.In.FourCC         = MFX_FOURCC_I010;
+    mfxVPPParams.vpp.In.ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+    mfxVPPParams.vpp.In.BitDepthLuma   = 10;
+    mfxVPPParams.vpp.In.BitDepthChroma = 10;
+    mfxVPPParams.vpp.In.Width          = 352;
+    mfxVPPParams.vpp.In.Height         = 288;
+    mfxVPPParams.vpp.In.CropH          = mfxVPPParams.vpp.In.Height;
+    mfxVPPParams.vpp.In.CropW          = mfxVPPParams.vpp.In.Width;
+    mfxVPPParams.vpp.In.FrameRateExtN  = 30;
+    mfxVPPParams.vpp.In.FrameRateExtD  = 1;
+
+    mfxVPPParams.vpp.Out                = mfxVPPParams.vpp.In;
+    mfxVPPParams.vpp.Out.FourCC         = MFX_FOURCC_I420;
+    mfxVPPParams.vpp.Out.BitDepthLuma   = 8;
+    mfxVPPParams.vpp.Out.BitDepthChroma = 8;
+
+    mfxExtCpuVPPDepthConversion depthConv = {};
+    depthConv.Header.BufferId             = MFX_EXTBUFF_CPU_VPP_DEPTH_CONVERSION;
+    depthConv.Header.BufferSz             = sizeof(depthConv);
+    depthConv.Method                      = MFX_CPU_DEPTH_CONVERSION_DITHER;
+    mfxExtBuffer *extParams[]             = { &depthConv.Header };
+    mfxVPPParams.ExtParam                 = extParams;
+    mfxVPPParams.NumExtParam              = 1;
+
+    sts = MFXVideoVPP_Init(session, &mfxVPPParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxFrameSurface1 *vppSurfaceIn = nullptr;
+    sts                            = MFXMemory_GetSurfaceForVPP(session, &vppSurfaceIn);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    sts = vppSurfaceIn->FrameInterface->Map(vppSurfaceIn, MFX_MAP_WRITE);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // 513 sits a quarter step above 8-bit level 128
+    mfxU32 pitch = vppSurfaceIn->Data.Pitch;
+    for (mfxU32 y = 0; y < mfxVPPParams.vpp.In.Height; y++) {
+        mfxU16 *row = (mfxU16 *)(vppSurfaceIn->Data.Y + y * pitch);
+        for (mfxU32 x = 0; x < mfxVPPParams.vpp.In.Width; x++)
+            row[x] = 513;
+    }
+    for (mfxU32 y = 0; y < mfxVPPParams.vpp.In.Height / 2; y++) {
+        mfxU16 *rowU = (mfxU16 *)(vppSurfaceIn->Data.U + y * pitch / 2);
+        mfxU16 *rowV = (mfxU16 *)(vppSurfaceIn->Data.V + y * pitch / 2);
+        for (mfxU32 x = 0; x < mfxVPPParams.vpp.In.Width / 2; x++) {
+            rowU[x] = 513;
+            rowV[x] = 1023;
+        }
+    }
+    vppSurfaceIn->FrameInterface->Unmap(vppSurfaceIn);
+
+    mfxFrameSurface1 *vppSurfaceOut = nullptr;
+    sts = MFXVideoVPP_ProcessFrameAsync(session, vppSurfaceIn, &vppSurfaceOut);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(vppSurfaceOut, nullptr);
+
+    // 2x2 ordered dither adds 0, 2 / 3, 1 before dropping two bits
+    mfxU8 *Y = vppSurfaceOut->Data.Y;
+    pitch    = vppSurfaceOut->Data.Pitch;
+    EXPECT_EQ(Y[0], 128);
+    EXPECT_EQ(Y[1], 128);
+    EXPECT_EQ(Y[pitch], 129);
+    EXPECT_EQ(Y[pitch + 1], 128);
+    EXPECT_EQ(vppSurfaceOut->Data.U[0], 128);
+    EXPECT_EQ(vppSurfaceOut->Data.V[0], 255);
+
+    vppSurfaceOut->FrameInterface->Unmap(vppSurfaceOut);
+    vppSurfaceOut->FrameInterface->Release(vppSurfaceOut);
+    vppSurfaceIn->FrameInterface->Release(vppSurfaceIn);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
 TEST(ProcessFrameAsync, NullSessionReturnsInvalidHandle) {
     mfxStatus sts = MFXVideoVPP_ProcessFrameAsync(0, nullptr, nullptr);
     ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);